@@ -1,11 +1,14 @@
+import 'dart:async';
 import 'dart:io';
 import 'dart:convert';
+import 'dart:ui' as ui;
 import 'package:flutter/material.dart';
 import 'package:shared_preferences/shared_preferences.dart';
 import 'package:vaxp_core/models/desktop_entry.dart';
 import 'package:vaxp_core/services/window_service.dart';
 import 'package:vaxp_core/services/window_matcher_service.dart';
 import 'package:vaxp_core/services/dock_service.dart';
+import 'package:vaxp_core/utils/icon_provider.dart';
 import 'package:hotkey_manager/hotkey_manager.dart';
 import 'services/dock_settings_service.dart';
 import 'widgets/dock/dock_panel.dart';
@@ -84,11 +87,21 @@ class DockHome extends StatefulWidget {
 
 class _DockHomeState extends State<DockHome> {
   List<DesktopEntry> _pinnedApps = [];
-  List<WindowInfo> _openWindows = [];
+  // Dock entries for open windows, keyed by window ID and patched from
+  // WindowService deltas so one window's change does not re-match the rest
+  final Map<String, WindowInfo> _openWindows = {};
+  final Map<String, DesktopEntry?> _windowMatches = {};
+  final Map<String, DesktopEntry> _transientEntries = {};
+  // _NET_WM_ICON images for windows without a desktop entry match
+  final Map<String, ui.Image> _windowIcons = {};
+  final Map<String, int> _windowIconHashes = {};
   bool _launcherVisible = false;
   bool _launcherMinimized = false;
   late final WindowService _windowService;
   late final WindowMatcherService _windowMatcher;
+  StreamSubscription<String>? _iconThemeSubscription;
+  StreamSubscription<Set<String>?>? _iconChangesSubscription;
+  StreamSubscription<void>? _entriesChangedSubscription;
   final DockSettingsService _settingsService = DockSettingsService();
   DockSettings _settings = DockSettings();
   
@@ -109,17 +122,32 @@ class _DockHomeState extends State<DockHome> {
 
     // Initialize window matcher and load desktop entries
     _windowMatcher = WindowMatcherService();
-    _windowMatcher.loadDesktopEntries();
+    _windowMatcher.loadDesktopEntries().then((_) {
+      // Windows seen before the entries loaded are still unmatched
+      if (!mounted) return;
+      setState(() {
+        for (final w in _openWindows.values) {
+          _matchWindow(w);
+        }
+      });
+    });
 
-    // Start window monitoring
-    _windowService = WindowService();
-    _windowService.start();
-    _windowService.onWindowsChanged.listen((windows) {
+    // Apps installed or removed meanwhile: windows may match differently
+    _entriesChangedSubscription = _windowMatcher.onEntriesChanged.listen((_) {
       if (!mounted) return;
       setState(() {
-        _openWindows = windows;
+        for (final w in _openWindows.values) {
+          _matchWindow(w);
+        }
       });
     });
+    _iconThemeSubscription = IconProvider.onThemeChanged.listen(_onIconThemeChanged);
+    _iconChangesSubscription = IconProvider.onIconsChanged.listen(_onIconsChanged);
+
+    // Start window monitoring
+    _windowService = WindowService();
+    _windowService.start();
+    _windowService.onWindowDeltas.listen(_onWindowDeltas);
 
     // Listen to settings changes
     _settingsService.addListener(_onSettingsChanged);
@@ -175,7 +203,9 @@ class _DockHomeState extends State<DockHome> {
     if (!mounted) return;
     setState(() {
       _settings = settings;
+      _rebuildTransientEntries();
     });
+    _windowService.setCurrentDesktopOnly(settings.currentWorkspaceOnly);
   }
 
   Future<void> _loadSettings() async {
@@ -184,7 +214,9 @@ class _DockHomeState extends State<DockHome> {
       _settings = _settingsService.settings;
       // Load theme files whenever settings load or change
       _loadThemeFiles();
+      _rebuildTransientEntries();
     });
+    _windowService.setCurrentDesktopOnly(_settings.currentWorkspaceOnly);
   }
 
   void _loadThemeFiles() {
@@ -219,6 +251,7 @@ class _DockHomeState extends State<DockHome> {
         _settings = settings;
         // Reload theme files if icon pack changed
         _loadThemeFiles();
+        _rebuildTransientEntries();
       });
     }
 
@@ -394,9 +427,16 @@ class _DockHomeState extends State<DockHome> {
   @override
   void dispose() {
     _settingsService.removeListener(_onSettingsChanged);
+    _iconThemeSubscription?.cancel();
+    _iconChangesSubscription?.cancel();
+    _entriesChangedSubscription?.cancel();
+    _windowMatcher.dispose();
     HotKeyManager.instance.unregisterAll();
     widget.dockService.dispose();
     _windowService.dispose();
+    for (final image in _windowIcons.values) {
+      image.dispose();
+    }
     super.dispose();
   }
 
@@ -409,6 +449,222 @@ class _DockHomeState extends State<DockHome> {
     }
   }
 
+  void _onWindowDeltas(List<WindowDelta> deltas) {
+    if (!mounted) return;
+    var changed = false;
+    for (final delta in deltas) {
+      switch (delta) {
+        case WindowAdded(:final window) || StateChanged(:final window):
+          _matchWindow(window);
+          changed = true;
+        case TitleChanged(:final window):
+          // Matched windows keep their entry and icon; only unmatched
+          // windows fall back to matching by the new title
+          final entry = _transientEntries[window.windowId];
+          if (entry == null || _windowMatches[window.windowId] == null) {
+            _matchWindow(window);
+          } else {
+            _openWindows[window.windowId] = window;
+            _transientEntries[window.windowId] = DesktopEntry(
+              name: window.title,
+              exec: entry.exec,
+              iconPath: entry.iconPath,
+              isSvgIcon: entry.isSvgIcon,
+            );
+          }
+          changed = true;
+        case WindowRemoved(:final window):
+          _openWindows.remove(window.windowId);
+          _windowMatches.remove(window.windowId);
+          _transientEntries.remove(window.windowId);
+          _dropWindowIcon(window.windowId);
+          changed = true;
+        case IconChanged(:final window):
+          if (_windowMatches[window.windowId] == null) _loadWindowIcon(window.windowId);
+        case FocusChanged() || DesktopChanged():
+          // The dock does not render focus; workspace filtering arrives as
+          // added/removed windows
+          break;
+      }
+    }
+    if (changed) setState(() {});
+  }
+
+  void _matchWindow(WindowInfo w) {
+    _openWindows[w.windowId] = w;
+    // Try to match window to desktop entry for icon
+    final matched = _windowMatcher.matchWindowToEntry(w);
+    _windowMatches[w.windowId] = matched;
+    _transientEntries[w.windowId] = _buildTransientEntry(w);
+    if (matched != null) {
+      _dropWindowIcon(w.windowId);
+    } else if (!_windowIcons.containsKey(w.windowId)) {
+      _loadWindowIcon(w.windowId);
+    }
+  }
+
+  /// Decode the window's own icon for unmatched windows. The pixels come
+  /// straight from the native buffer; windows sharing an icon share an image.
+  void _loadWindowIcon(String windowId) {
+    final dpr = WidgetsBinding.instance.platformDispatcher.views.first.devicePixelRatio;
+    final icon = _windowService.windowIcon(windowId, (40 * dpr).round());
+    if (icon == null) return;
+    if (_windowIconHashes[windowId] == icon.hash) return;
+
+    void apply(ui.Image image) {
+      if (!mounted || !_openWindows.containsKey(windowId)) {
+        image.dispose();
+        return;
+      }
+      setState(() {
+        _windowIcons.remove(windowId)?.dispose();
+        _windowIcons[windowId] = image;
+        _windowIconHashes[windowId] = icon.hash;
+      });
+    }
+
+    for (final entry in _windowIconHashes.entries) {
+      final shared = _windowIcons[entry.key];
+      if (entry.value == icon.hash && shared != null) {
+        apply(shared.clone());
+        return;
+      }
+    }
+    ui.decodeImageFromPixels(
+      icon.pixels,
+      icon.width,
+      icon.height,
+      ui.PixelFormat.rgba8888,
+      apply,
+    );
+  }
+
+  void _dropWindowIcon(String windowId) {
+    _windowIcons.remove(windowId)?.dispose();
+    _windowIconHashes.remove(windowId);
+  }
+
+  /// Theme icons resolved so far point into the old theme.
+  Future<void> _onIconThemeChanged(String theme) => _reloadIcons();
+
+  /// Icons were installed or removed. Only worth a reload if an icon in the
+  /// dock is missing or may have been replaced.
+  Future<void> _onIconsChanged(Set<String>? names) async {
+    if (names != null) {
+      final entries = [..._pinnedApps, ..._transientEntries.values];
+      final affected = entries.any((entry) {
+        final path = entry.iconPath;
+        if (path == null) return true;
+        final file = path.substring(path.lastIndexOf('/') + 1);
+        final dot = file.lastIndexOf('.');
+        return names.contains(dot > 0 ? file.substring(0, dot) : file);
+      });
+      if (!affected) return;
+    }
+    await _reloadIcons();
+  }
+
+  /// Reload the desktop entries, re-resolve pinned apps and open windows,
+  /// and evict only the old icon files from the image cache.
+  Future<void> _reloadIcons() async {
+    final oldPaths = <String>{
+      for (final app in _pinnedApps)
+        if (app.iconPath != null) app.iconPath!,
+      for (final entry in _transientEntries.values)
+        if (entry.iconPath != null) entry.iconPath!,
+    };
+    await _windowMatcher.reloadDesktopEntries();
+    if (!mounted) return;
+
+    setState(() {
+      _pinnedApps = [
+        for (final app in _pinnedApps)
+          switch (_windowMatcher.entryNamed(app.name)) {
+            final entry? when entry.iconPath != null => DesktopEntry(
+                name: app.name,
+                exec: app.exec,
+                iconPath: entry.iconPath,
+                isSvgIcon: entry.isSvgIcon,
+                autoRemoveOnExit: app.autoRemoveOnExit,
+              ),
+            _ => app,
+          },
+      ];
+      for (final w in _openWindows.values) {
+        _matchWindow(w);
+      }
+    });
+    _savePinnedApps();
+    for (final path in oldPaths) {
+      IconProvider.dockImage(path)?.evict();
+    }
+  }
+
+  /// Re-resolve icons for all open windows, e.g. after the icon pack or
+  /// custom mappings changed. Desktop entry matches are kept.
+  void _rebuildTransientEntries() {
+    for (final w in _openWindows.values) {
+      _transientEntries[w.windowId] = _buildTransientEntry(w);
+    }
+  }
+
+  DesktopEntry _buildTransientEntry(WindowInfo w) {
+    final matched = _windowMatches[w.windowId];
+    if (matched != null) {
+      // Check for custom icon from settings
+      String? finalIconPath = matched.iconPath;
+      bool isSvg = matched.isSvgIcon;
+      
+      // Check custom icon mappings first
+      if (_settings.iconMappings.containsKey(matched.name)) {
+        final customPath = _settings.iconMappings[matched.name];
+        if (customPath != null && File(customPath).existsSync()) {
+          finalIconPath = customPath;
+          isSvg = customPath.toLowerCase().endsWith('.svg');
+        }
+      } else if (_settings.iconPackPath != null && _themeFiles.isNotEmpty) {
+        // Use smart theme file search (like launcher does it)
+        final themedPath = _findIconInTheme(matched.name, matched.iconPath);
+        if (themedPath != null) {
+          finalIconPath = themedPath;
+          isSvg = themedPath.toLowerCase().endsWith('.svg');
+        }
+      }
+      
+      // Use window title as name to ensure windowIdMap lookup works
+      return DesktopEntry(
+        name: w.title,
+        exec: matched.exec,
+        iconPath: finalIconPath,
+        isSvgIcon: isSvg,
+      );
+    }
+    // Fallback: create entry with window title, but check custom icons
+    String? customIconPath;
+    bool isSvg = false;
+    if (_settings.iconMappings.containsKey(w.title)) {
+      final customPath = _settings.iconMappings[w.title];
+      if (customPath != null && File(customPath).existsSync()) {
+        customIconPath = customPath;
+        isSvg = customPath.toLowerCase().endsWith('.svg');
+      }
+    } else if (_settings.iconPackPath != null && _themeFiles.isNotEmpty) {
+      // Use smart theme file search (like launcher does it)
+      final themedPath = _findIconInTheme(w.title, null);
+      if (themedPath != null) {
+        customIconPath = themedPath;
+        isSvg = themedPath.toLowerCase().endsWith('.svg');
+      }
+    }
+    
+    return DesktopEntry(
+      name: w.title,
+      exec: null,
+      iconPath: customIconPath,
+      isSvgIcon: isSvg,
+    );
+  }
+
   /// Find an icon in the theme pack using smart candidate-based matching
   /// (similar to how the launcher does it)
   String? _findIconInTheme(String appName, String? iconPath) {
@@ -486,64 +742,11 @@ class _DockHomeState extends State<DockHome> {
               },
               pinnedApps: _pinnedApps,
               runningApps: [],
-              transientApps: _openWindows.map((w) {
-                // Try to match window to desktop entry for icon
-                final matched = _windowMatcher.matchWindowToEntry(w);
-                if (matched != null) {
-                  // Check for custom icon from settings
-                  String? finalIconPath = matched.iconPath;
-                  bool isSvg = matched.isSvgIcon;
-                  
-                  // Check custom icon mappings first
-                  if (_settings.iconMappings.containsKey(matched.name)) {
-                    final customPath = _settings.iconMappings[matched.name];
-                    if (customPath != null && File(customPath).existsSync()) {
-                      finalIconPath = customPath;
-                      isSvg = customPath.toLowerCase().endsWith('.svg');
-                    }
-                  } else if (_settings.iconPackPath != null && _themeFiles.isNotEmpty) {
-                    // Use smart theme file search (like launcher does it)
-                    final themedPath = _findIconInTheme(matched.name, matched.iconPath);
-                    if (themedPath != null) {
-                      finalIconPath = themedPath;
-                      isSvg = themedPath.toLowerCase().endsWith('.svg');
-                    }
-                  }
-                  
-                  // Use window title as name to ensure windowIdMap lookup works
-                  return DesktopEntry(
-                    name: w.title,
-                    exec: matched.exec,
-                    iconPath: finalIconPath,
-                    isSvgIcon: isSvg,
-                  );
-                }
-                // Fallback: create entry with window title, but check custom icons
-                String? customIconPath;
-                bool isSvg = false;
-                if (_settings.iconMappings.containsKey(w.title)) {
-                  final customPath = _settings.iconMappings[w.title];
-                  if (customPath != null && File(customPath).existsSync()) {
-                    customIconPath = customPath;
-                    isSvg = customPath.toLowerCase().endsWith('.svg');
-                  }
-                } else if (_settings.iconPackPath != null && _themeFiles.isNotEmpty) {
-                  // Use smart theme file search (like launcher does it)
-                  final themedPath = _findIconInTheme(w.title, null);
-                  if (themedPath != null) {
-                    customIconPath = themedPath;
-                    isSvg = themedPath.toLowerCase().endsWith('.svg');
-                  }
-                }
-                
-                return DesktopEntry(
-                  name: w.title,
-                  exec: null,
-                  iconPath: customIconPath,
-                  isSvgIcon: isSvg,
-                );
-              }).toList(),
-              windowIdMap: Map.fromEntries(_openWindows.map((w) => MapEntry(w.title, w.windowId))),
+              transientApps: _transientEntries.values.toList(),
+              windowIdMap: {
+                for (final w in _openWindows.values) w.title: w.windowId,
+              },
+              windowIcons: _windowIcons,
               onWindowActivate: _activateWindow,
               onUnpin: (name) => _handleUnpinRequest(name),
               onReorder: (oldIndex, newIndex) {
@@ -8,6 +8,7 @@ class DockSettings {
   final String? backgroundImagePath;
   final String? iconPackPath; // Directory path containing custom icons
   final Map<String, String> iconMappings; // App name -> icon file path
+  final bool currentWorkspaceOnly; // Only show windows on the current workspace
 
   DockSettings({
     Color? barColor,
@@ -15,9 +16,11 @@ class DockSettings {
     this.backgroundImagePath,
     this.iconPackPath,
     Map<String, String>? iconMappings,
+    bool? currentWorkspaceOnly,
   })  : barColor = barColor ?? Colors.black,
         transparency = transparency ?? 0.3,
-        iconMappings = iconMappings ?? {};
+        iconMappings = iconMappings ?? {},
+        currentWorkspaceOnly = currentWorkspaceOnly ?? false;
 
   Map<String, dynamic> toJson() => {
         'barColor': barColor.value,
@@ -25,6 +28,7 @@ class DockSettings {
         'backgroundImagePath': backgroundImagePath,
         'iconPackPath': iconPackPath,
         'iconMappings': iconMappings,
+        'currentWorkspaceOnly': currentWorkspaceOnly,
       };
 
   factory DockSettings.fromJson(Map<String, dynamic> json) => DockSettings(
@@ -37,6 +41,7 @@ class DockSettings {
         iconMappings: json['iconMappings'] != null
             ? Map<String, String>.from(json['iconMappings'] as Map)
             : null,
+        currentWorkspaceOnly: json['currentWorkspaceOnly'] as bool?,
       );
 
   DockSettings copyWith({
@@ -45,6 +50,7 @@ class DockSettings {
     String? backgroundImagePath,
     String? iconPackPath,
     Map<String, String>? iconMappings,
+    bool? currentWorkspaceOnly,
   }) {
     return DockSettings(
       barColor: barColor ?? this.barColor,
@@ -52,6 +58,7 @@ class DockSettings {
       backgroundImagePath: backgroundImagePath ?? this.backgroundImagePath,
       iconPackPath: iconPackPath ?? this.iconPackPath,
       iconMappings: iconMappings ?? this.iconMappings,
+      currentWorkspaceOnly: currentWorkspaceOnly ?? this.currentWorkspaceOnly,
     );
   }
 }
@@ -1,8 +1,10 @@
 import 'dart:io';
+import 'dart:ui' as ui;
 import 'package:flutter/material.dart';
 import 'package:flutter_svg/flutter_svg.dart';
 import 'package:desktop_multi_window/desktop_multi_window.dart';
 import 'package:vaxp_core/models/desktop_entry.dart';
+import 'package:vaxp_core/utils/icon_provider.dart';
 import 'package:vaxp_dock/widgets/dock/dock_settings_dialog.dart';
 import '../../services/dock_settings_service.dart';
 import 'dock_icon.dart';
@@ -19,6 +21,7 @@ class DockPanel extends StatefulWidget {
   final Function(int oldIndex, int newIndex)? onReorder;
   final Function(String windowId)? onWindowActivate; // window ID to activate
   final Map<String, String>? windowIdMap; // maps window title -> window ID
+  final Map<String, ui.Image>? windowIcons; // maps window ID -> _NET_WM_ICON image
   final DockSettings? settings;
   final Function(DockSettings)? onSettingsChanged;
   
@@ -35,6 +38,7 @@ class DockPanel extends StatefulWidget {
     this.onReorder,
     this.onWindowActivate,
     this.windowIdMap,
+    this.windowIcons,
     this.settings,
     this.onSettingsChanged,
   });
@@ -48,10 +52,11 @@ class _DockPanelState extends State<DockPanel> {
     return _buildDockIconWithHandler(entry, () => widget.onLaunch(entry));
   }
 
-  Widget _buildDockIconWithHandler(DesktopEntry entry, VoidCallback onTap) {
+  Widget _buildDockIconWithHandler(DesktopEntry entry, VoidCallback onTap, {ui.Image? windowIcon}) {
     final isRunning = _isEntryRunning(entry);
     if (entry.iconPath != null) {
-      if (entry.isSvgIcon) {
+      final image = IconProvider.dockImage(entry.iconPath!);
+      if (image == null) {
         return DockIcon(
           customChild: SvgPicture.file(
             File(entry.iconPath!),
@@ -64,12 +69,24 @@ class _DockPanelState extends State<DockPanel> {
         );
       } else {
         return DockIcon(
-          iconData: FileImage(File(entry.iconPath!)),
+          iconData: image,
           tooltip: entry.name,
           isRunning: isRunning,
           onTap: onTap,
         );
       }
+    } else if (windowIcon != null) {
+      return DockIcon(
+        customChild: RawImage(
+          image: windowIcon,
+          width: 40,
+          height: 40,
+          filterQuality: FilterQuality.medium,
+        ),
+        tooltip: entry.name,
+        isRunning: isRunning,
+        onTap: onTap,
+      );
     } else {
       return DockIcon(
         icon: Icons.window_rounded,
@@ -273,7 +290,11 @@ class _DockPanelState extends State<DockPanel> {
                       GestureDetector(
                         onTap: onTapHandler,
                         onSecondaryTapUp: (details) => _showDockIconMenu(context, details, entry.value),
-                        child: _buildDockIconWithHandler(entryWithHandler, onTapHandler),
+                        child: _buildDockIconWithHandler(
+                          entryWithHandler,
+                          onTapHandler,
+                          windowIcon: windowId != null ? widget.windowIcons?[windowId] : null,
+                        ),
                       ),
                       if (entry.key < widget.transientApps.length - 1)
                         Container(
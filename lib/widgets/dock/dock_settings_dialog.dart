@@ -232,6 +232,24 @@ class _DockSettingsDialogState extends State<DockSettingsDialog> {
         ),
         const SizedBox(height: 20),
 
+        // Windows
+        _buildSectionTitle('Windows'),
+        const SizedBox(height: 10),
+        SwitchListTile(
+          contentPadding: EdgeInsets.zero,
+          title: Text(
+            'Only show windows on the current workspace',
+            style: TextStyle(color: Colors.grey[300]),
+          ),
+          value: _settings.currentWorkspaceOnly,
+          onChanged: (value) {
+            setState(() {
+              _settings = _settings.copyWith(currentWorkspaceOnly: value);
+            });
+          },
+        ),
+        const SizedBox(height: 20),
+
         // Background Image
         _buildSectionTitle('Background Image'),
         const SizedBox(height: 10),
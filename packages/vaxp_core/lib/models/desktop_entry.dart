@@ -1,11 +1,17 @@
 import 'dart:io';
+import 'dart:isolate';
 import '../utils/icon_provider.dart';
+import '../utils/native_desktop_entries.dart';
 
 class DesktopEntry {
   final String name;
   final String? exec;
   late final String? iconPath;
   final bool isSvgIcon;
+  /// StartupWMClass, the window class the app's windows announce.
+  final String? startupWmClass;
+  /// The .desktop file the entry was read from.
+  final String? desktopFile;
   final bool autoRemoveOnExit;
 
   DesktopEntry({
@@ -13,34 +19,109 @@ class DesktopEntry {
     this.exec,
     this.iconPath,
     this.isSvgIcon = false,
+    this.startupWmClass,
+    this.desktopFile,
     this.autoRemoveOnExit = false,
   });
 
+  /// The desktop file ID, which the files in higher-precedence directories
+  /// take over: the .desktop file's path below its application directory
+  /// with '/' turned into '-', so kde4/kate.desktop is kde4-kate.desktop.
+  String? get desktopId {
+    final file = desktopFile;
+    if (file == null) return null;
+    for (final dir in _applicationDirs) {
+      if (file.startsWith('$dir/')) return idBelow(dir, file);
+    }
+    return file.substring(file.lastIndexOf('/') + 1);
+  }
+
+  static final List<String> _applicationDirs = applicationDirs();
+
+  /// The desktop file ID of [file] in application directory [dir].
+  static String idBelow(String dir, String file) =>
+      file.substring(dir.length + 1).replaceAll('/', '-');
+
+  /// The directories applications are loaded from, in precedence order:
+  /// the user's data dir, $XDG_DATA_DIRS, then the flatpak and snap export
+  /// directories unless $XDG_DATA_DIRS already names them.
+  static List<String> applicationDirs() {
+    final env = Platform.environment;
+    final home = env['HOME'];
+    final dataHome = env['XDG_DATA_HOME'] ?? (home != null ? '$home/.local/share' : null);
+    final dataDirs = env['XDG_DATA_DIRS'] ?? '';
+    final bases = [
+      if (dataHome != null && dataHome.isNotEmpty) dataHome,
+      for (final dir in (dataDirs.isNotEmpty ? dataDirs : '/usr/local/share:/usr/share').split(':'))
+        if (dir.isNotEmpty) dir,
+      if (home != null) '$home/.local/share/flatpak/exports/share',
+      '/var/lib/flatpak/exports/share',
+      '/var/lib/snapd/desktop',
+    ];
+    final dirs = <String>{};
+    for (final base in bases) {
+      var dir = '$base/applications';
+      while (dir.contains('//')) {
+        dir = dir.replaceAll('//', '/');
+      }
+      dirs.add(dir);
+    }
+    return dirs.toList();
+  }
+
   static Future<List<DesktopEntry>> loadAll() async {
-    final List<String> dirs = [
-      '/usr/share/applications',
-      '/usr/local/share/applications',
-      if (Platform.environment['XDG_DATA_HOME'] != null)
-        '${Platform.environment['XDG_DATA_HOME']!}/applications'
-      else
-        Platform.environment['HOME'] != null
-            ? '${Platform.environment['HOME']!}/.local/share/applications'
-            : '',
+    final dirs = applicationDirs();
+    final currentDesktop = Platform.environment['XDG_CURRENT_DESKTOP'];
+    // The native loader answers from its application database and parses
+    // only changed files, on several threads; run it off this isolate so the
+    // UI keeps going meanwhile.
+    final parsed = await Isolate.run(
+          () => NativeDesktopEntries.open()?.load(dirs, currentDesktop),
+        ) ??
+        await _parseAll(dirs);
+    final entries = await fromParsed(parsed);
+    entries.sort(
+      (a, b) => a.name.toLowerCase().compareTo(b.name.toLowerCase()),
+    );
+    return entries;
+  }
+
+  /// Entries for [parsed] with their icons resolved for the dock.
+  static Future<List<DesktopEntry>> fromParsed(List<ParsedDesktopEntry> parsed) async {
+    final iconPaths = await _resolveIcons([for (final entry in parsed) entry.icon]);
+    return [
+      for (var i = 0; i < parsed.length; i++)
+        DesktopEntry(
+          name: parsed[i].name,
+          exec: parsed[i].exec,
+          iconPath: iconPaths[i],
+          isSvgIcon: iconPaths[i]?.toLowerCase().endsWith('.svg') ?? false,
+          startupWmClass: parsed[i].wmClass,
+          desktopFile: parsed[i].path,
+        ),
     ];
+  }
 
+  /// Parse the .desktop files in Dart, for when the native library is
+  /// missing.
+  static Future<List<ParsedDesktopEntry>> _parseAll(List<String> dirs) async {
     final Set<String> seen = {};
-    final List<DesktopEntry> entries = [];
+    final List<ParsedDesktopEntry> parsed = [];
 
     for (final dir in dirs) {
       final d = Directory(dir);
       if (!await d.exists()) continue;
-      await for (final file in d.list()) {
-        if (!file.path.endsWith('.desktop')) continue;
+      await for (final file in d.list(recursive: true)) {
+        if (file is! File || !file.path.endsWith('.desktop')) continue;
+        // The first file of each desktop file ID decides, even if it hides
+        // the app.
+        if (!seen.add(idBelow(dir, file.path))) continue;
         try {
           final lines = await File(file.path).readAsLines();
           String? name;
           String? exec;
           String? icon;
+          String? wmClass;
           bool inDesktopEntry = false;
           bool shouldDisplay = true;
           String currentDesktop = Platform.environment['XDG_CURRENT_DESKTOP']?.toUpperCase() ?? '';
@@ -51,11 +132,14 @@ class DesktopEntry {
               inDesktopEntry = true;
               continue;
             }
+            // Action groups follow and have their own Name=
+            if (inDesktopEntry && l.startsWith('[')) break;
             if (!inDesktopEntry || l.startsWith('#')) continue;
             
             if (l.startsWith('Name=')) name = l.substring(5);
             if (l.startsWith('Exec=')) exec = l.substring(5);
             if (l.startsWith('Icon=')) icon = l.substring(5);
+            if (l.startsWith('StartupWMClass=')) wmClass = l.substring(15);
             
             if (l == 'NoDisplay=true' || l == 'Hidden=true') {
               shouldDisplay = false;
@@ -85,48 +169,47 @@ class DesktopEntry {
             }
           }
           
-          if (name != null && exec != null && shouldDisplay && !seen.contains(name)) {
-            seen.add(name);
-            if (icon != null) {
-              // IconProvider.findIcon handles symlinks automatically
-              // For absolute paths, check if file exists first, then resolve through IconProvider
-              String? iconPath;
-              if (icon.startsWith('/')) {
-                if (File(icon).existsSync()) {
-                  // Use IconProvider to resolve symlinks even for absolute paths
-                  iconPath = IconProvider.findIcon(icon);
-                }
-              } else {
-                // Icon name, search in icon theme
-                iconPath = IconProvider.findIcon(icon);
-              }
-              
-              if (iconPath != null) {
-                entries.add(
-                  DesktopEntry(
-                    name: name,
-                    exec: exec,
-                    iconPath: iconPath, // Already resolved symlink via IconProvider
-                    isSvgIcon: iconPath.toLowerCase().endsWith('.svg'),
-                  ),
-                );
-              } else {
-                entries.add(DesktopEntry(name: name, exec: exec));
-              }
-            } else {
-              entries.add(DesktopEntry(name: name, exec: exec));
-            }
+          if (name != null && exec != null && shouldDisplay) {
+            parsed.add((name: name, exec: exec, icon: icon, wmClass: wmClass, path: file.path));
           }
         } catch (_) {
           // Ignore parse errors
         }
       }
     }
-    
-    entries.sort(
-      (a, b) => a.name.toLowerCase().compareTo(b.name.toLowerCase()),
+    return parsed;
+  }
+
+  /// Resolve Icon= values to files sized for the dock at the current device
+  /// scale. Theme icon names go to the native icon index (GTK for its
+  /// misses) in a single batch on the native worker threads; absolute paths
+  /// and everything when the native library is missing go through
+  /// IconProvider.
+  static Future<List<String?>> _resolveIcons(List<String?> icons) async {
+    final scale = IconProvider.deviceScale();
+    final resolved = List<String?>.filled(icons.length, null);
+    final themed = <int>[];
+    for (var i = 0; i < icons.length; i++) {
+      final icon = icons[i];
+      if (icon == null || icon.isEmpty) continue;
+      if (icon.startsWith('/')) {
+        // IconProvider resolves symlinks even for absolute paths
+        if (File(icon).existsSync()) resolved[i] = IconProvider.findIcon(icon);
+      } else {
+        themed.add(i);
+      }
+    }
+
+    final found = await IconProvider.nativeLookup()?.lookupAsync(
+      [for (final i in themed) icons[i]!],
+      size: IconProvider.dockIconSize,
+      scale: scale,
     );
-    return entries;
+    for (var j = 0; j < themed.length; j++) {
+      final i = themed[j];
+      resolved[i] = found != null ? found[j] : IconProvider.findIcon(icons[i]!, scale: scale);
+    }
+    return resolved;
   }
 
   Map<String, dynamic> toJson() {
@@ -135,6 +218,8 @@ class DesktopEntry {
       'exec': exec,
       'iconPath': iconPath,
       'isSvgIcon': isSvgIcon,
+      'startupWmClass': startupWmClass,
+      'desktopFile': desktopFile,
       'autoRemoveOnExit': autoRemoveOnExit,
     };
   }
@@ -145,6 +230,8 @@ class DesktopEntry {
       exec: json['exec'] as String?,
       iconPath: json['iconPath'] as String?,
       isSvgIcon: json['isSvgIcon'] as bool? ?? false,
+      startupWmClass: json['startupWmClass'] as String?,
+      desktopFile: json['desktopFile'] as String?,
       autoRemoveOnExit: json['autoRemoveOnExit'] as bool? ?? false,
     );
   }
@@ -0,0 +1,304 @@
+import 'dart:ffi';
+import 'dart:typed_data';
+// ignore: depend_on_referenced_packages
+import 'package:ffi/ffi.dart';
+import '../utils/native_library.dart';
+import 'window_service.dart';
+
+/// Kinds of change reported by the native tracker (see src/window_tracker.h).
+/// For `focus` and `icon` only the window ID is set; for `focus` it is zero
+/// when nothing is active. For `desktop` only the desktop index is set: the
+/// new current desktop, -1 if unknown. `stopped` comes last, when the
+/// connection was lost; call [NativeWindowTracker.stop] then.
+enum NativeWindowEventType { added, removed, changed, focus, icon, desktop, stopped }
+
+final class _WindowRecord extends Struct {
+  @Uint32()
+  external int window;
+  @Int32()
+  external int pid;
+  @Int32()
+  external int desktop;
+  @Uint32()
+  external int state;
+  external Pointer<Utf8> title;
+  external Pointer<Utf8> wmClass;
+  external Pointer<Utf8> wmInstance;
+}
+
+final class _WindowEvent extends Struct {
+  @Int32()
+  external int type;
+  external _WindowRecord window;
+}
+
+final class _WindowList extends Struct {
+  @Int32()
+  external int count;
+  external Pointer<_WindowRecord> windows;
+}
+
+final class _WindowIcon extends Struct {
+  @Int32()
+  external int width;
+  @Int32()
+  external int height;
+  @Uint32()
+  external int hash;
+  external Pointer<Uint8> pixels;
+}
+
+/// A window's _NET_WM_ICON as premultiplied RGBA. [pixels] is a view of the
+/// native buffer, not a copy; the buffer is released when the view is
+/// garbage collected. Windows with identical icons share one buffer and
+/// report the same [hash].
+class NativeWindowIcon {
+  final int width;
+  final int height;
+  final int hash;
+  final Uint8List pixels;
+
+  const NativeWindowIcon(this.width, this.height, this.hash, this.pixels);
+}
+
+typedef _EventCallbackNative = Void Function(Pointer<_WindowEvent>);
+
+/// Event-driven window tracking through libicon_loader's window tracker.
+/// The native side watches _NET_CLIENT_LIST and client properties on X11, or
+/// the compositor's foreign-toplevel list on Wayland, on its own thread and
+/// only calls back into Dart when something actually changed.
+class NativeWindowTracker {
+  final int Function(Pointer<NativeFunction<_EventCallbackNative>>) _start;
+  final void Function() _stop;
+  final void Function(Pointer<_WindowEvent>) _freeEvent;
+  final Pointer<_WindowList> Function() _getWindowList;
+  final void Function(Pointer<_WindowList>) _freeWindowList;
+  final int Function(Pointer<Uint32>) _getActiveWindow;
+  final int Function(int) _activateWindow;
+  final int Function(int) _closeWindow;
+  final int Function(int) _minimizeWindow;
+  final int Function(int, int) _moveWindowToDesktop;
+  final int Function(Pointer<Utf8>) _activateWindowMatching;
+  final Pointer<_WindowIcon> Function(int, int) _getWindowIcon;
+  final Pointer<NativeFinalizerFunction> _releaseWindowIcon;
+  final void Function(int) _setWindowFilter;
+  NativeCallable<_EventCallbackNative>? _callable;
+
+  /// Filter bit: report only windows on the current desktop.
+  static const int filterCurrentDesktop = 1 << 0;
+
+  /// Filter bit: drop windows a taskbar should not show (skip-taskbar,
+  /// docks, menus, tooltips and other special window types).
+  static const int filterTaskbar = 1 << 1;
+
+  static NativeWindowTracker? _instance;
+  static bool _opened = false;
+
+  NativeWindowTracker._(DynamicLibrary lib)
+      : _start = lib.lookupFunction<
+            Int32 Function(Pointer<NativeFunction<_EventCallbackNative>>),
+            int Function(Pointer<NativeFunction<_EventCallbackNative>>)>('start_window_tracker'),
+        _stop = lib.lookupFunction<Void Function(), void Function()>('stop_window_tracker'),
+        _freeEvent = lib.lookupFunction<
+            Void Function(Pointer<_WindowEvent>),
+            void Function(Pointer<_WindowEvent>)>('free_window_event'),
+        _getWindowList = lib.lookupFunction<
+            Pointer<_WindowList> Function(),
+            Pointer<_WindowList> Function()>('get_window_list'),
+        _freeWindowList = lib.lookupFunction<
+            Void Function(Pointer<_WindowList>),
+            void Function(Pointer<_WindowList>)>('free_window_list'),
+        _getActiveWindow = lib.lookupFunction<
+            Int32 Function(Pointer<Uint32>),
+            int Function(Pointer<Uint32>)>('get_active_window'),
+        _activateWindow =
+            lib.lookupFunction<Int32 Function(Uint32), int Function(int)>('activate_window'),
+        _closeWindow =
+            lib.lookupFunction<Int32 Function(Uint32), int Function(int)>('close_window'),
+        _minimizeWindow =
+            lib.lookupFunction<Int32 Function(Uint32), int Function(int)>('minimize_window'),
+        _moveWindowToDesktop = lib.lookupFunction<
+            Int32 Function(Uint32, Int32),
+            int Function(int, int)>('move_window_to_desktop'),
+        _activateWindowMatching = lib.lookupFunction<
+            Int32 Function(Pointer<Utf8>),
+            int Function(Pointer<Utf8>)>('activate_window_matching'),
+        _getWindowIcon = lib.lookupFunction<
+            Pointer<_WindowIcon> Function(Uint32, Int32),
+            Pointer<_WindowIcon> Function(int, int)>('get_window_icon'),
+        _releaseWindowIcon = lib.lookup('release_window_icon'),
+        _setWindowFilter =
+            lib.lookupFunction<Void Function(Uint32), void Function(int)>('set_window_filter');
+
+  /// Shared instance. Returns null if the native library or its tracker
+  /// symbols are missing.
+  static NativeWindowTracker? open() {
+    if (_opened) return _instance;
+    _opened = true;
+    final lib = NativeLibrary.open();
+    if (lib == null) return null;
+    try {
+      _instance = NativeWindowTracker._(lib);
+    } catch (_) {
+      _instance = null;
+    }
+    return _instance;
+  }
+
+  /// Start tracking. The initial window set arrives as `added` events.
+  /// Returns false if no X connection could be made.
+  bool start(void Function(NativeWindowEventType type, WindowInfo window) onEvent) {
+    if (_callable != null) return true;
+    late final NativeCallable<_EventCallbackNative> callable;
+    callable = NativeCallable<_EventCallbackNative>.listener((Pointer<_WindowEvent> event) {
+      // The null event stop() sends comes after every queued one
+      if (event == nullptr) {
+        callable.close();
+        return;
+      }
+      _handleEvent(event, identical(_callable, callable) ? onEvent : null);
+    });
+    if (_start(callable.nativeFunction) != 0) {
+      callable.close();
+      return false;
+    }
+    _callable = callable;
+    return true;
+  }
+
+  void stop() {
+    final callable = _callable;
+    if (callable == null) return;
+    _callable = null;
+    // Joins the tracker thread, so nothing is sent after this. Events it
+    // sent that are still queued must be freed before the callable closes,
+    // which would drop them: queue a null event behind them and close on
+    // that.
+    _stop();
+    callable.nativeFunction.asFunction<void Function(Pointer<_WindowEvent>)>()(nullptr);
+  }
+
+  /// Fetch all client windows in one pipelined X round-trip, independent of
+  /// [start]. Returns null if no X connection could be made.
+  List<WindowInfo>? fetchWindows() {
+    final list = _getWindowList();
+    if (list == nullptr) return null;
+    try {
+      return [
+        for (var i = 0; i < list.ref.count; i++) _toWindowInfo(list.ref.windows[i]),
+      ];
+    } finally {
+      _freeWindowList(list);
+    }
+  }
+
+  /// The focused window, independent of [start]: '0x00000000' when nothing
+  /// is focused, null if no X connection could be made.
+  String? activeWindow() {
+    final window = calloc<Uint32>();
+    try {
+      if (_getActiveWindow(window) != 0) return null;
+      return _windowId(window.value);
+    } finally {
+      calloc.free(window);
+    }
+  }
+
+  /// Restrict the windows reported by the tracker and [fetchWindows] to
+  /// those passing the filter bits. A running tracker reports windows that
+  /// start or stop passing as added or removed.
+  void setFilter(int filter) => _setWindowFilter(filter);
+
+  // EWMH actions are sent to the window manager directly as ClientMessages,
+  // which avoids forking wmctrl/xdotool for every click.
+
+  bool activate(String windowId) => _withId(windowId, _activateWindow);
+
+  bool close(String windowId) => _withId(windowId, _closeWindow);
+
+  bool minimize(String windowId) => _withId(windowId, _minimizeWindow);
+
+  /// Pass -1 as [desktop] to show the window on all desktops.
+  bool moveToDesktop(String windowId, int desktop) =>
+      _withId(windowId, (id) => _moveWindowToDesktop(id, desktop));
+
+  /// Activate the first window whose title or class contains [needle],
+  /// ignoring case, like `wmctrl -a`.
+  bool activateMatching(String needle) {
+    final ptr = needle.toNativeUtf8();
+    try {
+      return _activateWindowMatching(ptr) == 0;
+    } finally {
+      malloc.free(ptr);
+    }
+  }
+
+  /// The window's own icon image best suited to [size] device pixels, or
+  /// null if it has none. Cached natively per window and size.
+  NativeWindowIcon? windowIcon(String windowId, int size) {
+    final id = parseWindowId(windowId);
+    if (id == null) return null;
+    final icon = _getWindowIcon(id, size);
+    if (icon == nullptr) return null;
+    final ref = icon.ref;
+    return NativeWindowIcon(
+      ref.width,
+      ref.height,
+      ref.hash,
+      ref.pixels.asTypedList(
+        ref.width * ref.height * 4,
+        finalizer: _releaseWindowIcon,
+        token: icon.cast(),
+      ),
+    );
+  }
+
+  static bool _withId(String windowId, int Function(int) action) {
+    final id = parseWindowId(windowId);
+    if (id == null) return false;
+    return action(id) == 0;
+  }
+
+  /// Parses the `0x...` IDs used throughout [WindowService].
+  static int? parseWindowId(String windowId) {
+    final hex = windowId.startsWith('0x') ? windowId.substring(2) : windowId;
+    return int.tryParse(hex, radix: 16);
+  }
+
+  /// Report [event] to [onEvent], if still listening, and free it.
+  void _handleEvent(Pointer<_WindowEvent> event,
+      void Function(NativeWindowEventType type, WindowInfo window)? onEvent) {
+    try {
+      if (onEvent == null) return;
+      final type = switch (event.ref.type) {
+        1 => NativeWindowEventType.added,
+        2 => NativeWindowEventType.removed,
+        4 => NativeWindowEventType.focus,
+        5 => NativeWindowEventType.icon,
+        6 => NativeWindowEventType.desktop,
+        7 => NativeWindowEventType.stopped,
+        _ => NativeWindowEventType.changed,
+      };
+      onEvent(type, _toWindowInfo(event.ref.window));
+    } finally {
+      _freeEvent(event);
+    }
+  }
+
+  static WindowInfo _toWindowInfo(_WindowRecord record) {
+    return WindowInfo(
+      windowId: _windowId(record.window),
+      title: _string(record.title) ?? '',
+      windowClass: _string(record.wmClass),
+      windowInstance: _string(record.wmInstance),
+      desktopIndex: record.desktop,
+      pid: record.pid == 0 ? null : record.pid,
+      state: record.state,
+      isActive: false,
+    );
+  }
+
+  static String _windowId(int window) => '0x${window.toRadixString(16).padLeft(8, '0')}';
+
+  static String? _string(Pointer<Utf8> ptr) => ptr == nullptr ? null : ptr.toDartString();
+}
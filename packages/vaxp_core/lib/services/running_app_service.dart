@@ -1,6 +1,7 @@
 import 'dart:async';
 import 'dart:io';
 import 'package:dbus/dbus.dart';
+import 'native_window_tracker.dart';
 
 /// Monitor active well-known DBus names via org.freedesktop.DBus
 /// This is a heuristic monitor: many GUI apps do not own DBus names, but
@@ -67,7 +68,8 @@ class RunningAppService {
   /// Strategies:
   ///  - call 'Activate' on interface 'org.freedesktop.Application' on the app's bus name
   ///  - call 'Activate' on path '/org/gtk/Application' as a fallback
-  ///  - run a window manager helper 'wmctrl -a <execBase>' if available
+  ///  - activate a window whose title/class matches execBase (native EWMH,
+  ///    falling back to 'wmctrl -a <execBase>')
   Future<bool> activateByBusName(String busName, {String? execBase}) async {
     try {
       // Try org.freedesktop.Application Activate
@@ -91,8 +93,9 @@ class RunningAppService {
       return true;
     } catch (_) {}
 
-    // Fallback: try wmctrl to focus a window by name/class
+    // Fallback: focus a window by name/class, natively or via wmctrl
     if (execBase != null && execBase.isNotEmpty) {
+      if (NativeWindowTracker.open()?.activateMatching(execBase) ?? false) return true;
       try {
         final res = await Process.run('wmctrl', ['-a', execBase]);
         if (res.exitCode == 0) return true;
@@ -1,18 +1,118 @@
+import 'dart:async';
 import 'dart:io';
 import '../models/desktop_entry.dart';
 import '../utils/icon_provider.dart';
+import '../utils/native_desktop_entries.dart';
 import 'window_service.dart';
 
 /// Service to match windows to desktop entries and resolve icons
 class WindowMatcherService {
   List<DesktopEntry> _desktopEntries = [];
   bool _entriesLoaded = false;
+  // Built by _setEntries() whenever the entries change, so matching a
+  // window is a few hash probes; the first entry in list order wins a key.
+  List<_IndexedEntry> _indexed = [];
+  final Map<String, DesktopEntry> _byWmClass = {};
+  final Map<String, DesktopEntry> _byDesktopId = {};
+  final Map<String, DesktopEntry> _byExec = {};
+  final Map<String, DesktopEntry> _byName = {};
+  StreamSubscription<List<DesktopEntryChange>>? _entryChanges;
+  // Changes are applied one after the other, each after its icons resolved.
+  Future<void> _applying = Future.value();
+  final _entriesChanged = StreamController<void>.broadcast();
 
-  /// Load all desktop entries (call this once at startup)
+  /// Fires after applications were installed, updated or removed and the
+  /// entries changed accordingly.
+  Stream<void> get onEntriesChanged => _entriesChanged.stream;
+
+  /// Load all desktop entries (call this once at startup). With the native
+  /// library the application directories are then followed, and entries
+  /// are added, updated and removed in place as .desktop files change.
   Future<void> loadDesktopEntries() async {
     if (_entriesLoaded) return;
-    _desktopEntries = await DesktopEntry.loadAll();
-    _entriesLoaded = true;
+    final changes = NativeDesktopEntries.open()?.watch(
+      DesktopEntry.applicationDirs(),
+      Platform.environment['XDG_CURRENT_DESKTOP'],
+    );
+    if (changes == null) {
+      _setEntries(await DesktopEntry.loadAll());
+      _entriesLoaded = true;
+      return;
+    }
+    // The first event carries every entry; the native watcher always sends
+    // it, empty if loading failed, and reports the entries once a retry
+    // succeeds.
+    final loaded = Completer<void>();
+    _entryChanges = changes.listen((diff) {
+      _applying = _applying.then((_) => _applyChanges(diff)).catchError((_) {}).then((_) {
+        if (!loaded.isCompleted) {
+          _entriesLoaded = true;
+          loaded.complete();
+        } else {
+          _entriesChanged.add(null);
+        }
+      });
+    }, onDone: () {
+      // Closed before the first event, by dispose() say
+      if (!loaded.isCompleted) loaded.complete();
+    });
+    await loaded.future;
+  }
+
+  Future<void> _applyChanges(List<DesktopEntryChange> diff) async {
+    final changed = await DesktopEntry.fromParsed([
+      for (final change in diff)
+        if (change.kind != DesktopEntryChangeKind.removed) change.entry,
+    ]);
+    final paths = {for (final change in diff) change.entry.path};
+    _setEntries([
+      for (final entry in _desktopEntries)
+        if (!paths.contains(entry.desktopFile)) entry,
+      ...changed,
+    ]..sort((a, b) => a.name.toLowerCase().compareTo(b.name.toLowerCase())));
+  }
+
+  void _setEntries(List<DesktopEntry> entries) {
+    _desktopEntries = entries;
+    _indexed = [for (final entry in entries) _IndexedEntry(entry)];
+    _byWmClass.clear();
+    _byDesktopId.clear();
+    _byExec.clear();
+    _byName.clear();
+    for (final indexed in _indexed) {
+      final entry = indexed.entry;
+      final wmClass = entry.startupWmClass?.toLowerCase();
+      if (wmClass != null && wmClass.isNotEmpty) _byWmClass.putIfAbsent(wmClass, () => entry);
+      final id = entry.desktopId?.toLowerCase();
+      if (id != null && id.endsWith('.desktop')) {
+        _byDesktopId.putIfAbsent(id.substring(0, id.length - 8), () => entry);
+      }
+      if (indexed.exec.isNotEmpty) _byExec.putIfAbsent(indexed.exec, () => entry);
+      if (indexed.name.isNotEmpty) _byName.putIfAbsent(indexed.name, () => entry);
+    }
+  }
+
+  /// Stop following the application directories.
+  void dispose() {
+    _entryChanges?.cancel();
+    _entryChanges = null;
+  }
+
+  /// Load the desktop entries again, e.g. after the icon theme changed and
+  /// their resolved icon paths went stale.
+  Future<void> reloadDesktopEntries() {
+    return _applying = _applying.then((_) async {
+      _setEntries(await DesktopEntry.loadAll());
+      _entriesLoaded = true;
+    });
+  }
+
+  /// The loaded entry with [name], if any.
+  DesktopEntry? entryNamed(String name) {
+    for (final entry in _desktopEntries) {
+      if (entry.name == name) return entry;
+    }
+    return null;
   }
 
   /// Match a window to a desktop entry and return it with icon resolved
@@ -40,57 +140,39 @@ class WindowMatcherService {
     return null;
   }
 
-  /// Match desktop entry by window class
+  /// Match desktop entry by window class: StartupWMClass, desktop file ID,
+  /// Exec basename and Name are hash probes with the class, then with the
+  /// instance; only a miss on all of them scans for partial matches.
   DesktopEntry? _matchByClass(String windowClass, String? windowInstance) {
     final lowerClass = windowClass.toLowerCase();
     final lowerInstance = windowInstance?.toLowerCase();
 
-    // Try exact match first (most reliable)
-    for (final entry in _desktopEntries) {
-      if (entry.exec == null) continue;
-      final execBase = _getExecBase(entry.exec!);
-      final lowerExec = execBase.toLowerCase();
-      
-      // Exact match
-      if (lowerExec == lowerClass) {
-        return entry;
-      }
-      
-      // Match without common prefixes/suffixes
-      if (_normalizeForMatch(lowerExec) == _normalizeForMatch(lowerClass)) {
-        return entry;
-      }
-    }
+    final byKey = _byWmClass[lowerClass] ??
+        _byDesktopId[lowerClass] ??
+        (lowerInstance != null ? _byWmClass[lowerInstance] ?? _byDesktopId[lowerInstance] : null);
+    if (byKey != null) return byKey;
 
-    // Try matching by instance if available (often more specific)
-    if (lowerInstance != null) {
-      for (final entry in _desktopEntries) {
-        if (entry.exec == null) continue;
-        final execBase = _getExecBase(entry.exec!);
-        final lowerExec = execBase.toLowerCase();
-        
-        if (lowerExec == lowerInstance || 
-            _normalizeForMatch(lowerExec) == _normalizeForMatch(lowerInstance)) {
-          return entry;
-        }
-      }
-    }
+    // Exec basename without dashes, underscores and spaces, as for the
+    // name below
+    final normalizedClass = _normalizeForMatch(lowerClass);
+    final normalizedInstance = lowerInstance != null ? _normalizeForMatch(lowerInstance) : null;
+    final byExec = _byExec[normalizedClass] ??
+        (normalizedInstance != null ? _byExec[normalizedInstance] : null) ??
+        _byName[normalizedClass];
+    if (byExec != null) return byExec;
 
     // Try partial match (less reliable but catches more cases)
-    for (final entry in _desktopEntries) {
-      if (entry.exec == null) continue;
-      final execBase = _getExecBase(entry.exec!);
-      final lowerExec = execBase.toLowerCase();
-      
+    for (final indexed in _indexed) {
+      if (indexed.entry.exec == null) continue;
+
       // Check if class contains exec or vice versa (with word boundaries)
-      if (_matchesPartially(lowerExec, lowerClass)) {
-        return entry;
+      if (_containsEither(indexed.exec, normalizedClass)) {
+        return indexed.entry;
       }
-      
+
       // Also check name (some apps have different exec vs name)
-      final lowerName = entry.name.toLowerCase();
-      if (_matchesPartially(lowerName, lowerClass)) {
-        return entry;
+      if (_containsEither(indexed.name, normalizedClass)) {
+        return indexed.entry;
       }
     }
 
@@ -98,18 +180,15 @@ class WindowMatcherService {
   }
 
   /// Normalize strings for matching (remove common variations)
-  String _normalizeForMatch(String str) {
+  static String _normalizeForMatch(String str) {
     return str
         .replaceAll(RegExp(r'[-_]'), '') // Remove dashes and underscores
         .replaceAll(RegExp(r'\s+'), '') // Remove spaces
         .toLowerCase();
   }
 
-  /// Check if two strings match partially (one contains the other or vice versa)
-  bool _matchesPartially(String str1, String str2) {
-    final norm1 = _normalizeForMatch(str1);
-    final norm2 = _normalizeForMatch(str2);
-    
+  /// Check if two normalized strings match partially (one contains the other)
+  bool _containsEither(String norm1, String norm2) {
     // Check if one contains the other (with minimum length to avoid false positives)
     if (norm1.length >= 3 && norm2.length >= 3) {
       return norm1.contains(norm2) || norm2.contains(norm1);
@@ -123,9 +202,9 @@ class WindowMatcherService {
     final lowerTitle = title.toLowerCase();
     
     // Strategy 1: Try exact match first
-    for (final entry in _desktopEntries) {
-      if (entry.name.toLowerCase() == lowerTitle) {
-        return entry;
+    for (final indexed in _indexed) {
+      if (indexed.lowerName == lowerTitle) {
+        return indexed.entry;
       }
     }
 
@@ -143,21 +222,19 @@ class WindowMatcherService {
     for (final suffix in commonSuffixes) {
       final cleanTitle = lowerTitle.replaceAll(suffix, '').trim();
       if (cleanTitle.isNotEmpty && cleanTitle != lowerTitle) {
-        for (final entry in _desktopEntries) {
-          if (entry.name.toLowerCase() == cleanTitle) {
-            return entry;
+        for (final indexed in _indexed) {
+          if (indexed.lowerName == cleanTitle) {
+            return indexed.entry;
           }
         }
       }
     }
 
     // Strategy 3: Try matching entry names against full title (substring match)
-    for (final entry in _desktopEntries) {
-      final lowerName = entry.name.toLowerCase();
-      
+    for (final indexed in _indexed) {
       // Check if entry name is in the title (like "Files" in "Downloads - Files")
-      if (lowerTitle.contains(lowerName)) {
-        return entry;
+      if (lowerTitle.contains(indexed.lowerName)) {
+        return indexed.entry;
       }
     }
 
@@ -165,10 +242,10 @@ class WindowMatcherService {
     final titleWords = lowerTitle.split(RegExp(r'[\s-]+'));
     final firstWord = titleWords.isNotEmpty ? titleWords.first : '';
     if (firstWord.isNotEmpty && firstWord.length > 2) { // Avoid matching single letters
-      for (final entry in _desktopEntries) {
-        final lowerName = entry.name.toLowerCase();
+      for (final indexed in _indexed) {
+        final lowerName = indexed.lowerName;
         if (lowerName == firstWord || lowerName.startsWith(firstWord)) {
-          return entry;
+          return indexed.entry;
         }
       }
     }
@@ -178,9 +255,9 @@ class WindowMatcherService {
       final parts = lowerTitle.split('-');
       final lastPart = parts.last.trim();
       if (lastPart.isNotEmpty && lastPart.length > 2) {
-        for (final entry in _desktopEntries) {
-          if (entry.name.toLowerCase() == lastPart) {
-            return entry;
+        for (final indexed in _indexed) {
+          if (indexed.lowerName == lastPart) {
+            return indexed.entry;
           }
         }
       }
@@ -191,21 +268,11 @@ class WindowMatcherService {
 
   /// Match desktop entry by window instance
   DesktopEntry? _matchByInstance(String instance) {
-    final lowerInstance = instance.toLowerCase();
-    
-    for (final entry in _desktopEntries) {
-      if (entry.exec == null) continue;
-      final execBase = _getExecBase(entry.exec!);
-      if (execBase.toLowerCase() == lowerInstance) {
-        return entry;
-      }
-    }
-
-    return null;
+    return _byExec[_normalizeForMatch(instance.toLowerCase())];
   }
 
   /// Extract executable base name from Exec field
-  String _getExecBase(String exec) {
+  static String _getExecBase(String exec) {
     // Remove placeholders like %U, %f, etc.
     final cleaned = exec.replaceAll(RegExp(r'%[a-zA-Z]'), '').trim();
     if (cleaned.isEmpty) return '';
@@ -231,6 +298,8 @@ class WindowMatcherService {
           exec: entry.exec,
           iconPath: resolvedPath,
           isSvgIcon: resolvedPath.toLowerCase().endsWith('.svg'),
+          startupWmClass: entry.startupWmClass,
+          desktopFile: entry.desktopFile,
           autoRemoveOnExit: entry.autoRemoveOnExit,
         );
       }
@@ -245,6 +314,8 @@ class WindowMatcherService {
         exec: entry.exec,
         iconPath: iconPath,
         isSvgIcon: iconPath.toLowerCase().endsWith('.svg'),
+        startupWmClass: entry.startupWmClass,
+        desktopFile: entry.desktopFile,
         autoRemoveOnExit: entry.autoRemoveOnExit,
       );
     }
@@ -260,6 +331,8 @@ class WindowMatcherService {
             exec: entry.exec,
             iconPath: execIconPath,
             isSvgIcon: execIconPath.toLowerCase().endsWith('.svg'),
+            startupWmClass: entry.startupWmClass,
+            desktopFile: entry.desktopFile,
             autoRemoveOnExit: entry.autoRemoveOnExit,
           );
         }
@@ -287,3 +360,18 @@ class WindowMatcherService {
   List<DesktopEntry> get desktopEntries => List.from(_desktopEntries);
 }
 
+/// An entry with the strings matching compares, computed once.
+class _IndexedEntry {
+  final DesktopEntry entry;
+  final String lowerName;
+  /// Name and Exec basename, lowercased without dashes, underscores and spaces
+  final String name;
+  final String exec;
+
+  _IndexedEntry(this.entry)
+      : lowerName = entry.name.toLowerCase(),
+        name = WindowMatcherService._normalizeForMatch(entry.name),
+        exec = entry.exec != null
+            ? WindowMatcherService._normalizeForMatch(WindowMatcherService._getExecBase(entry.exec!))
+            : '';
+}
@@ -1,5 +1,15 @@
 import 'dart:async';
 import 'dart:io';
+import 'native_window_tracker.dart';
+
+/// Bits of [WindowInfo.state] (see WINDOW_STATE_* in src/window_tracker.h).
+class WindowState {
+  static const int minimized = 1 << 0;
+  static const int skipTaskbar = 1 << 1;
+  static const int urgent = 1 << 2;
+  static const int fullscreen = 1 << 3;
+  static const int specialType = 1 << 4;
+}
 
 /// Represents a single open window with minimal transient info.
 /// Window ID is the primary key; info is not persisted.
@@ -8,7 +18,9 @@ class WindowInfo {
   final String title; // Window title from wmctrl
   final String? windowClass; // Window class (WM_CLASS) for matching
   final String? windowInstance; // Window instance (WM_CLASS) for matching
-  final int desktopIndex; // Desktop/workspace index
+  final int desktopIndex; // Desktop/workspace index (-1: all desktops/unknown)
+  final int? pid; // Owning process (_NET_WM_PID), if known
+  final int state; // WindowState bits; only reported by the native tracker
   final bool isActive; // Currently active window
 
   WindowInfo({
@@ -17,9 +29,15 @@ class WindowInfo {
     this.windowClass,
     this.windowInstance,
     required this.desktopIndex,
+    this.pid,
+    this.state = 0,
     required this.isActive,
   });
 
+  bool get isMinimized => state & WindowState.minimized != 0;
+  bool get isUrgent => state & WindowState.urgent != 0;
+  bool get isFullscreen => state & WindowState.fullscreen != 0;
+
   @override
   bool operator ==(Object other) =>
       identical(this, other) ||
@@ -37,6 +55,8 @@ class WindowInfo {
     String? windowClass,
     String? windowInstance,
     int? desktopIndex,
+    int? pid,
+    int? state,
     bool? isActive,
   }) {
     return WindowInfo(
@@ -45,26 +65,125 @@ class WindowInfo {
       windowClass: windowClass ?? this.windowClass,
       windowInstance: windowInstance ?? this.windowInstance,
       desktopIndex: desktopIndex ?? this.desktopIndex,
+      pid: pid ?? this.pid,
+      state: state ?? this.state,
       isActive: isActive ?? this.isActive,
     );
   }
 }
 
-/// Monitor all open GUI windows via wmctrl/xdotool.
-/// Polls periodically and exposes a stream of active windows.
+/// A single change to the set of open windows, emitted in batches on
+/// [WindowService.onWindowDeltas] so consumers can patch their view models
+/// instead of rebuilding them from a full list.
+sealed class WindowDelta {
+  const WindowDelta();
+}
+
+/// A window appeared (or became visible to the dock).
+class WindowAdded extends WindowDelta {
+  final WindowInfo window;
+  const WindowAdded(this.window);
+}
+
+/// A window closed (or is no longer shown by the dock).
+class WindowRemoved extends WindowDelta {
+  final WindowInfo window;
+  const WindowRemoved(this.window);
+}
+
+/// Only the title of a window changed.
+class TitleChanged extends WindowDelta {
+  final WindowInfo window;
+  final String previousTitle;
+  const TitleChanged(this.window, this.previousTitle);
+}
+
+/// The focused window changed; either ID may be null.
+class FocusChanged extends WindowDelta {
+  final String? previousWindowId;
+  final String? windowId;
+  const FocusChanged(this.previousWindowId, this.windowId);
+}
+
+/// The current desktop (workspace) changed; null when unknown.
+class DesktopChanged extends WindowDelta {
+  final int? previousDesktop;
+  final int? desktop;
+  const DesktopChanged(this.previousDesktop, this.desktop);
+}
+
+/// The window's own icon (_NET_WM_ICON) changed.
+class IconChanged extends WindowDelta {
+  final WindowInfo window;
+  const IconChanged(this.window);
+}
+
+/// Anything other than the title or focus changed: class, desktop, pid or
+/// state flags (minimized, urgent, ...).
+class StateChanged extends WindowDelta {
+  final WindowInfo window;
+  final WindowInfo previous;
+  const StateChanged(this.window, this.previous);
+}
+
+/// Monitor all open GUI windows.
+/// Uses the native tracker from libicon_loader when available (X11, or the
+/// foreign-toplevel protocols on wlroots-based Wayland compositors), which
+/// only reports changes; otherwise polls wmctrl/xdotool periodically.
 /// No persistence; window info exists only while the window is open.
 class WindowService {
   final StreamController<List<WindowInfo>> _controller = StreamController.broadcast();
-  List<WindowInfo> _activeWindows = [];
+  final StreamController<List<WindowDelta>> _deltaController = StreamController.broadcast();
+  final StreamController<String?> _activeController = StreamController.broadcast();
+  // Shown windows keyed by ID, in the order they were first seen
+  final Map<String, WindowInfo> _windows = {};
+  List<WindowDelta> _pendingDeltas = [];
+  bool _flushScheduled = false;
+  String? _activeWindowId;
+  int? _currentDesktop;
+  bool _currentDesktopOnly = false;
   Timer? _pollTimer;
   static const Duration _pollInterval = Duration(milliseconds: 500);
 
-  /// Stream of currently open windows.
+  NativeWindowTracker? _tracker;
+
+  /// Stream of currently open windows, emitted after every batch of deltas.
   Stream<List<WindowInfo>> get onWindowsChanged => _controller.stream;
 
+  /// Stream of batched changes to the open windows. A batch is emitted once
+  /// per event-loop turn in which anything changed.
+  Stream<List<WindowDelta>> get onWindowDeltas => _deltaController.stream;
+
+  /// Stream of the focused window ID (null when none).
+  Stream<String?> get onActiveWindowChanged => _activeController.stream;
+
+  /// Currently focused window ID, if known
+  String? get activeWindowId => _activeWindowId;
+
+  /// Current desktop (workspace) index, if known
+  int? get currentDesktop => _currentDesktop;
+
+  /// Show only windows on the current desktop (and sticky windows). With the
+  /// native tracker the filter runs before windows reach Dart, and switching
+  /// desktops arrives as ordinary added/removed deltas.
+  void setCurrentDesktopOnly(bool enabled) {
+    if (enabled == _currentDesktopOnly) return;
+    _currentDesktopOnly = enabled;
+    NativeWindowTracker.open()?.setFilter(_nativeFilter);
+  }
+
+  // Non-taskbar windows (docks, menus, skip-taskbar, ...) are always dropped
+  // natively, before anything is marshalled to Dart.
+  int get _nativeFilter =>
+      NativeWindowTracker.filterTaskbar |
+      (_currentDesktopOnly ? NativeWindowTracker.filterCurrentDesktop : 0);
+
   /// Start monitoring windows.
   Future<void> start() async {
     try {
+      // Event-driven tracking; no polling needed if it starts
+      if (_startNativeTracker()) return;
+
       // Initial poll
       await _pollWindows();
       // Poll periodically
@@ -76,18 +195,171 @@ class WindowService {
     }
   }
 
+  bool _startNativeTracker() {
+    final tracker = NativeWindowTracker.open();
+    if (tracker == null) return false;
+    tracker.setFilter(_nativeFilter);
+    if (!tracker.start(_onNativeEvent)) return false;
+    _tracker = tracker;
+    return true;
+  }
+
+  void _onNativeEvent(NativeWindowEventType type, WindowInfo window) {
+    switch (type) {
+      case NativeWindowEventType.focus:
+        _setActiveWindow(window.windowId == '0x00000000' ? null : window.windowId);
+      case NativeWindowEventType.desktop:
+        _setCurrentDesktop(window.desktopIndex < 0 ? null : window.desktopIndex);
+      case NativeWindowEventType.icon:
+        final current = _windows[window.windowId];
+        if (current != null) _queueDelta(IconChanged(current));
+      case NativeWindowEventType.removed:
+        _removeWindow(window.windowId);
+      case NativeWindowEventType.added:
+      case NativeWindowEventType.changed:
+        _putWindow(window, native: true);
+      case NativeWindowEventType.stopped:
+        _onNativeTrackerStopped();
+    }
+  }
+
+  /// The tracker lost its X server or compositor: poll from now on, which
+  /// keeps going (through the subprocess tools if need be) whatever came of
+  /// the connection.
+  void _onNativeTrackerStopped() {
+    _tracker?.stop();
+    _tracker = null;
+    if (_pollTimer != null) return;
+    _pollWindows();
+    _pollTimer = Timer.periodic(_pollInterval, (_) async {
+      await _pollWindows();
+    });
+  }
+
+  /// Insert or update one window, queueing the deltas that describe the
+  /// change. Windows that are (or became) ignored are removed instead.
+  void _putWindow(WindowInfo window, {bool native = false}) {
+    // Native windows are already filtered by type and state; only the
+    // subprocess fallbacks need the title heuristics
+    final ignored = native ? window.title.isEmpty : _isIgnoredTitle(window.title);
+    if (ignored) {
+      _removeWindow(window.windowId);
+      return;
+    }
+    final current = window.copyWith(isActive: window.windowId == _activeWindowId);
+    final previous = _windows[current.windowId];
+    _windows[current.windowId] = current;
+    if (previous == null) {
+      _queueDelta(WindowAdded(current));
+      return;
+    }
+    if (previous.title != current.title) {
+      _queueDelta(TitleChanged(current, previous.title));
+    }
+    if (previous.windowClass != current.windowClass ||
+        previous.windowInstance != current.windowInstance ||
+        previous.desktopIndex != current.desktopIndex ||
+        previous.pid != current.pid ||
+        previous.state != current.state) {
+      _queueDelta(StateChanged(current, previous));
+    }
+  }
+
+  void _removeWindow(String windowId) {
+    final previous = _windows.remove(windowId);
+    if (previous != null) _queueDelta(WindowRemoved(previous));
+  }
+
+  /// Reconcile a full polled snapshot against the keyed model in O(n).
+  void _updateWindows(List<WindowInfo> windows, {bool native = false}) {
+    final seen = <String>{};
+    for (final w in windows) {
+      seen.add(w.windowId);
+      _putWindow(w, native: native);
+    }
+    final gone = _windows.keys.where((id) => !seen.contains(id)).toList();
+    for (final id in gone) {
+      _removeWindow(id);
+    }
+  }
+
+  /// Record a focus change: patch isActive on the affected windows only.
+  void _setActiveWindow(String? windowId) {
+    if (windowId == _activeWindowId) return;
+    final previous = _activeWindowId;
+    _activeWindowId = windowId;
+    for (final id in [previous, windowId]) {
+      final w = _windows[id];
+      if (w != null) _windows[id!] = w.copyWith(isActive: id == windowId);
+    }
+    _queueDelta(FocusChanged(previous, windowId));
+    if (!_activeController.isClosed) _activeController.add(windowId);
+  }
+
+  void _setCurrentDesktop(int? desktop) {
+    if (desktop == _currentDesktop) return;
+    final previous = _currentDesktop;
+    _currentDesktop = desktop;
+    _queueDelta(DesktopChanged(previous, desktop));
+  }
+
+  // Coalesce bursts (e.g. the initial window set) into one batch
+  void _queueDelta(WindowDelta delta) {
+    _pendingDeltas.add(delta);
+    if (_flushScheduled) return;
+    _flushScheduled = true;
+    Timer.run(_flushDeltas);
+  }
+
+  void _flushDeltas() {
+    _flushScheduled = false;
+    final deltas = _pendingDeltas;
+    _pendingDeltas = [];
+    if (deltas.isEmpty || _deltaController.isClosed) return;
+    _deltaController.add(deltas);
+    // Focus, desktop and icons are not part of the list
+    if (_controller.hasListener &&
+        deltas.any((d) => d is WindowAdded || d is WindowRemoved ||
+            d is TitleChanged || d is StateChanged)) {
+      _controller.add(currentWindows());
+    }
+  }
+
+  /// Skip windows with no title, the dock itself, mutter guard windows and
+  /// internal Wayland windows
+  bool _isIgnoredTitle(String title) {
+    final lowerTitle = title.toLowerCase();
+    return lowerTitle.isEmpty ||
+        lowerTitle.contains('vaxp-dock') ||
+        lowerTitle.contains('mutter guard') ||
+        lowerTitle.contains('gnome-shell');
+  }
+
   /// Poll for current windows
-  /// Strategy: Use xdotool to enumerate ALL windows (Wayland-aware), 
+  /// Strategy: Fetch every window's properties natively in one X round-trip;
+  /// without the native library use xdotool to enumerate ALL windows,
   /// then supplement with wmctrl for X11-only windows
   Future<void> _pollWindows() async {
     try {
+      // Without a running tracker the native queries still answer in one
+      // round-trip each, with no subprocess per poll
+      final native = _nativeActions;
+      final nativeWindows = native?.fetchWindows();
+      if (nativeWindows != null) {
+        final activeWindowId = native!.activeWindow();
+        _setActiveWindow(activeWindowId == '0x00000000' ? null : activeWindowId);
+        _updateWindows(nativeWindows, native: true);
+        return;
+      }
+
       final newWindows = <WindowInfo>[];
 
-      // First, try xdotool to get all visible windows (works on both X11 and Wayland)
+      // First, try xdotool to get all visible windows (X11 and XWayland clients only)
       final xdotoolWindowIds = await _getWindowsViaXdotool();
       if (xdotoolWindowIds.isNotEmpty) {
         // Get active window once
         final activeWindowId = await _getActiveWindowId();
+        _setActiveWindow(activeWindowId);
 
         // Process each window from xdotool
         for (final windowId in xdotoolWindowIds) {
@@ -122,14 +394,8 @@ class WindowService {
               }
             }
 
-            // Skip windows with no title or dock windows
-            if (title.isEmpty || title.toLowerCase().contains('vaxp-dock')) continue;
-
-            // Skip mutter guard windows and internal Wayland windows
-            final lowerTitle = title.toLowerCase();
-            if (lowerTitle.contains('mutter guard') || 
-                lowerTitle.contains('gnome-shell') ||
-                lowerTitle.isEmpty) continue;
+            // Skip windows with no title, dock windows and internal windows
+            if (_isIgnoredTitle(title)) continue;
 
             // Convert window ID to hex format
             final hexId = _toHexWindowId(windowId);
@@ -157,7 +423,7 @@ class WindowService {
               windowId: hexId,
               title: title,
               windowClass: windowClass,
-              desktopIndex: 0, // Not available from xdotool
+              desktopIndex: -1, // Not available from xdotool
               isActive: isActive,
             ));
           } catch (_) {
@@ -167,7 +433,7 @@ class WindowService {
         }
 
         if (newWindows.isNotEmpty) {
-          _updateWindows(newWindows);
+          _updateWindows(await _filterToCurrentDesktop(newWindows));
           return;
         }
       }
@@ -180,7 +446,7 @@ class WindowService {
     }
   }
 
-  /// Get all visible window IDs via xdotool (works on Wayland)
+  /// Get all visible window IDs via xdotool (sees XWayland, not native Wayland clients)
   /// Also tries to find windows without proper visibility reporting
   Future<List<String>> _getWindowsViaXdotool() async {
     try {
@@ -231,6 +497,7 @@ class WindowService {
     try {
       // Get active window ID once
       final activeWindowId = await _getActiveWindowId();
+      _setActiveWindow(activeWindowId);
 
       final result = await Process.run('wmctrl', ['-l']);
       if (result.exitCode != 0) return;
@@ -302,12 +569,30 @@ class WindowService {
         ));
       }
 
-      _updateWindows(newWindows);
+      _updateWindows(await _filterToCurrentDesktop(newWindows));
     } catch (_) {
       // Both methods failed, ignore
     }
   }
 
+  /// Apply the current-desktop filter to windows polled without the native
+  /// library. Windows with an unknown desktop are kept.
+  Future<List<WindowInfo>> _filterToCurrentDesktop(List<WindowInfo> windows) async {
+    if (!_currentDesktopOnly) return windows;
+    try {
+      final result = await Process.run('xprop', ['-root', '_NET_CURRENT_DESKTOP']);
+      final match = RegExp(r'=\s*(\d+)').firstMatch(result.stdout.toString());
+      _setCurrentDesktop(match != null ? int.parse(match.group(1)!) : null);
+    } catch (_) {
+      // xprop not available
+    }
+    final desktop = _currentDesktop;
+    if (desktop == null) return windows;
+    return windows
+        .where((w) => w.desktopIndex < 0 || w.desktopIndex == desktop)
+        .toList();
+  }
+
   /// Get the currently active window ID (in hex format 0x...)
   Future<String?> _getActiveWindowId() async {
     try {
@@ -331,21 +616,12 @@ class WindowService {
     return null;
   }
 
-
-  void _updateWindows(List<WindowInfo> windows) {
-    // Only emit if the window list changed
-    if (windows.length != _activeWindows.length ||
-        !windows.every((w) => _activeWindows.contains(w))) {
-      _activeWindows = windows;
-      if (!_controller.isClosed) _controller.add(List<WindowInfo>.from(_activeWindows));
-    }
-  }
-
   /// Get current snapshot
-  List<WindowInfo> currentWindows() => List<WindowInfo>.from(_activeWindows);
+  List<WindowInfo> currentWindows() => _windows.values.toList();
 
   /// Activate (focus) a window by its ID
   Future<bool> activateWindow(String windowId) async {
+    if (_nativeActions?.activate(windowId) ?? false) return true;
     try {
       final result = await Process.run('wmctrl', ['-i', '-a', windowId]);
       return result.exitCode == 0;
@@ -356,6 +632,7 @@ class WindowService {
 
   /// Close a window by its ID
   Future<bool> closeWindow(String windowId) async {
+    if (_nativeActions?.close(windowId) ?? false) return true;
     try {
       final result = await Process.run('wmctrl', ['-i', '-c', windowId]);
       return result.exitCode == 0;
@@ -364,8 +641,40 @@ class WindowService {
     }
   }
 
+  /// Minimize (iconify) a window by its ID
+  Future<bool> minimizeWindow(String windowId) async {
+    if (_nativeActions?.minimize(windowId) ?? false) return true;
+    try {
+      final result = await Process.run('xdotool', ['windowminimize', windowId]);
+      return result.exitCode == 0;
+    } catch (_) {
+      return false;
+    }
+  }
+
+  /// Move a window to another desktop; -1 shows it on all desktops
+  Future<bool> moveWindowToDesktop(String windowId, int desktop) async {
+    if (_nativeActions?.moveToDesktop(windowId, desktop) ?? false) return true;
+    try {
+      final result = await Process.run('wmctrl', ['-i', '-r', windowId, '-t', '$desktop']);
+      return result.exitCode == 0;
+    } catch (_) {
+      return false;
+    }
+  }
+
+  /// The window's own icon image for drawing at [size] device pixels.
+  /// Only available with the native library.
+  NativeWindowIcon? windowIcon(String windowId, int size) =>
+      _nativeActions?.windowIcon(windowId, size);
+
+  NativeWindowTracker? get _nativeActions => NativeWindowTracker.open();
+
   void dispose() {
     _pollTimer?.cancel();
+    _tracker?.stop();
     _controller.close();
+    _deltaController.close();
+    _activeController.close();
   }
 }
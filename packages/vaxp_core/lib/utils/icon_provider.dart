@@ -1,7 +1,17 @@
 import 'dart:io';
+import 'dart:ui' as ui;
 import 'package:flutter/material.dart';
+import 'native_icon_image.dart';
+import 'native_icon_lookup.dart';
 
 class IconProvider {
+  /// Logical size the dock draws app icons at.
+  static const int dockIconSize = 40;
+
+  // Theme for the directory walk, detected once (or after a change)
+  static String? _theme;
+  static bool _themeDetected = false;
+
   /// Resolve a symbolic link to its target path
   /// Returns the resolved path, or the original path if not a symlink
   static String _resolveSymlink(String path) {
@@ -21,7 +31,12 @@ class IconProvider {
   /// Find an icon file in the system icon theme
   /// Handles symbolic links by resolving them to actual files
   /// Also checks custom icon pack if provided
-  static String? findIcon(String iconName, {String? customIconPackPath, Map<String, String>? iconMappings}) {
+  /// Theme icons come from the native theme index when libicon_loader is
+  /// available; the directory walk below is the fallback without it.
+  /// Theme icons are picked for [size] logical pixels at [scale] (defaults to
+  /// [deviceScale]): the smallest one at least that large, else a scalable
+  /// one, else the largest smaller one.
+  static String? findIcon(String iconName, {String? customIconPackPath, Map<String, String>? iconMappings, int size = dockIconSize, int? scale}) {
     if (iconName.isEmpty) return null;
     
     // 0. Check custom icon mappings first (app name -> icon path)
@@ -65,6 +80,12 @@ class IconProvider {
       }
     }
     
+    // 1.5. Native theme index: one hash probe instead of the stat cascade
+    if (!iconName.startsWith('/')) {
+      final native = nativeLookup();
+      if (native != null) return native.find(iconName, size: size, scale: scale ?? deviceScale());
+    }
+
     // 2. Additional system icon paths
     final systemPaths = [
       '/usr/share/icons',
@@ -79,8 +100,12 @@ class IconProvider {
     ].where((path) => Directory(path).existsSync()).toList();
     
     // 3. Theme search order (similar to GTK implementation)
+    if (!_themeDetected) {
+      _theme = _detectIconTheme();
+      _themeDetected = true;
+    }
     final themeSearchOrder = [
-      _detectIconTheme(),
+      _theme,
       'hicolor',
       'Adwaita',
       'gnome',
@@ -93,8 +118,15 @@ class IconProvider {
       'default',
     ].where((theme) => theme != null).toSet().toList();
     
-    // 4. Icon sizes to check (larger first for better quality)
-    final sizes = ['512x512', '256x256', '128x128', '96x96', '72x72', '64x64', '48x48', '32x32', '24x24', '22x22', '16x16', 'scalable'];
+    // 4. Icon sizes to check: the smallest that is not upscaled first, then
+    // scalable, then the smaller ones largest first
+    final pixels = size * (scale ?? deviceScale());
+    const sizeDirs = [16, 22, 24, 32, 48, 64, 72, 96, 128, 256, 512];
+    final sizes = [
+      for (final s in sizeDirs) if (s >= pixels) '${s}x$s',
+      'scalable',
+      for (final s in sizeDirs.reversed) if (s < pixels) '${s}x$s',
+    ];
     
     // 5. Icon categories to check
     final categories = ['apps', 'actions', 'devices', 'categories', 'places', 'status', 'emblems', 'mimetypes'];
@@ -178,16 +210,67 @@ class IconProvider {
     return null;
   }
 
+  /// The device pixel ratio of the dock's view rounded up, as the integer
+  /// scale icon themes are organised by. 1 before the view exists.
+  static int deviceScale() {
+    final views = ui.PlatformDispatcher.instance.views;
+    if (views.isEmpty) return 1;
+    return views.first.devicePixelRatio.ceil().clamp(1, 8);
+  }
+
+  /// The native icon lookup, which resolves and follows the icon theme
+  /// itself. Null without libicon_loader.
+  static NativeIconLookup? nativeLookup() => NativeIconLookup.open();
+
+  /// Icon theme changes, after the caches that depend on the theme were
+  /// dropped. Previously resolved icon paths may now be stale. Empty without
+  /// libicon_loader, where the theme is only detected once.
+  static Stream<String> get onThemeChanged {
+    final native = nativeLookup();
+    if (native == null) return const Stream.empty();
+    return native.onThemeChanged.map((theme) {
+      _theme = theme;
+      _themeDetected = true;
+      return theme;
+    });
+  }
+
+  /// Icon names installed or removed since they were resolved, or null when
+  /// any icon may have changed. Empty without libicon_loader.
+  static Stream<Set<String>?> get onIconsChanged =>
+      nativeLookup()?.onIconsChanged ?? const Stream.empty();
+
   /// Get an ImageProvider for the icon file
   static ImageProvider<Object>? getIcon(String iconName) {
     final path = findIcon(iconName);
     if (path != null) {
-      return FileImage(File(path));
+      return dockImage(path);
     }
     return null;
   }
 
-  // Icon theme detection
+  /// An icon file at the pixel size the dock draws it at, rather than at the
+  /// file's own size. Rendered natively (SVGs included) with libicon_loader;
+  /// without it raster files are decoded by Flutter and SVGs give null.
+  /// Evict through the same call.
+  static ImageProvider<Object>? dockImage(String path, {int? scale}) {
+    final pixelScale = scale ?? deviceScale();
+    if (nativeLookup() != null) {
+      return NativeIconImage(path, size: dockIconSize, scale: pixelScale);
+    }
+    if (path.toLowerCase().endsWith('.svg')) return null;
+    final pixels = dockIconSize * pixelScale;
+    return ResizeImage(
+      FileImage(File(path)),
+      width: pixels,
+      height: pixels,
+      policy: ResizeImagePolicy.fit,
+      allowUpscaling: false,
+    );
+  }
+
+  // Icon theme detection for the directory walk; forks gsettings, so the
+  // result is kept in _theme
   static String? _detectIconTheme() {
     try {
       // Try gsettings first (GNOME/Ubuntu)
@@ -0,0 +1,199 @@
+import 'dart:async';
+import 'dart:ffi';
+// ignore: depend_on_referenced_packages
+import 'package:ffi/ffi.dart';
+import 'native_library.dart';
+
+/// The raw Name, Exec, Icon and StartupWMClass values of a .desktop file at
+/// [path].
+typedef ParsedDesktopEntry = ({String name, String exec, String? icon, String? wmClass, String path});
+
+enum DesktopEntryChangeKind { added, updated, removed }
+
+/// An entry that changed; removed entries carry their last values.
+typedef DesktopEntryChange = ({DesktopEntryChangeKind kind, ParsedDesktopEntry entry});
+
+final class _DesktopEntryRecord extends Struct {
+  external Pointer<Utf8> name;
+  external Pointer<Utf8> exec;
+  external Pointer<Utf8> icon;
+  external Pointer<Utf8> path;
+  external Pointer<Utf8> wmClass;
+}
+
+final class _DesktopEntryList extends Struct {
+  @Int32()
+  external int count;
+  external Pointer<_DesktopEntryRecord> entries;
+}
+
+final class _DesktopEntryDiff extends Struct {
+  @Int32()
+  external int count;
+  external Pointer<_DesktopEntryRecord> entries;
+  external Pointer<Int32> changes;
+}
+
+typedef _DiffCallbackNative = Void Function(Pointer<_DesktopEntryDiff>);
+
+/// .desktop parsing through libicon_loader: files unchanged since the last
+/// load come from its application database, the others are mapped and
+/// their [Desktop Entry] group scanned in place, on several threads, and
+/// the visible entries come back in one array. [watch] follows the
+/// directories and reports only what changed.
+class NativeDesktopEntries {
+  final Pointer<_DesktopEntryList> Function(Pointer<Pointer<Utf8>>, int, Pointer<Utf8>)
+      _loadDesktopEntries;
+  final void Function(Pointer<_DesktopEntryList>) _freeDesktopEntries;
+  final int Function(Pointer<Pointer<Utf8>>, int, Pointer<Utf8>,
+      Pointer<NativeFunction<_DiffCallbackNative>>) _watchDesktopEntries;
+  final void Function() _unwatchDesktopEntries;
+  final void Function(Pointer<_DesktopEntryDiff>) _freeDesktopEntryDiff;
+  NativeCallable<_DiffCallbackNative>? _diffCallable;
+  StreamController<List<DesktopEntryChange>>? _changes;
+
+  static NativeDesktopEntries? _instance;
+  static bool _opened = false;
+
+  NativeDesktopEntries._(DynamicLibrary lib)
+      : _loadDesktopEntries = lib.lookupFunction<
+            Pointer<_DesktopEntryList> Function(Pointer<Pointer<Utf8>>, Int32, Pointer<Utf8>),
+            Pointer<_DesktopEntryList> Function(
+                Pointer<Pointer<Utf8>>, int, Pointer<Utf8>)>('load_desktop_entries'),
+        _freeDesktopEntries = lib.lookupFunction<
+            Void Function(Pointer<_DesktopEntryList>),
+            void Function(Pointer<_DesktopEntryList>)>('free_desktop_entries'),
+        _watchDesktopEntries = lib.lookupFunction<
+            Int32 Function(Pointer<Pointer<Utf8>>, Int32, Pointer<Utf8>,
+                Pointer<NativeFunction<_DiffCallbackNative>>),
+            int Function(Pointer<Pointer<Utf8>>, int, Pointer<Utf8>,
+                Pointer<NativeFunction<_DiffCallbackNative>>)>('watch_desktop_entries'),
+        _unwatchDesktopEntries =
+            lib.lookupFunction<Void Function(), void Function()>('unwatch_desktop_entries'),
+        _freeDesktopEntryDiff = lib.lookupFunction<
+            Void Function(Pointer<_DesktopEntryDiff>),
+            void Function(Pointer<_DesktopEntryDiff>)>('free_desktop_entry_diff');
+
+  /// Shared instance. Returns null if the native library or its symbols are
+  /// missing.
+  static NativeDesktopEntries? open() {
+    if (_opened) return _instance;
+    _opened = true;
+    final lib = NativeLibrary.open();
+    if (lib == null) return null;
+    try {
+      _instance = NativeDesktopEntries._(lib);
+    } catch (_) {
+      _instance = null;
+    }
+    return _instance;
+  }
+
+  /// The entries shown in [currentDesktop] (XDG_CURRENT_DESKTOP) from the
+  /// .desktop files in [dirs], given in precedence order; the first file of
+  /// each desktop file ID decides whether and how that app is shown.
+  /// Blocks while the files are read; returns null on failure.
+  List<ParsedDesktopEntry>? load(List<String> dirs, String? currentDesktop) {
+    return _withDirs(dirs, currentDesktop, (cDirs, cDesktop) {
+      final list = _loadDesktopEntries(cDirs, dirs.length, cDesktop);
+      if (list == nullptr) return null;
+      try {
+        return [
+          for (var i = 0; i < list.ref.count; i++) _read(list.ref.entries[i]),
+        ];
+      } finally {
+        _freeDesktopEntries(list);
+      }
+    });
+  }
+
+  /// Follow the entries [load] would return. The first event has every
+  /// entry as added; later ones come once a burst of filesystem changes
+  /// settled and hold only the entries added, updated or removed since,
+  /// keyed by path. Replaces the previous watch, whose stream is closed.
+  /// Returns null if the directories cannot be watched.
+  Stream<List<DesktopEntryChange>>? watch(List<String> dirs, String? currentDesktop) {
+    _unwatch();
+    late final StreamController<List<DesktopEntryChange>> changes;
+    changes = StreamController<List<DesktopEntryChange>>(onCancel: () {
+      if (identical(_changes, changes)) _unwatch();
+    });
+    late final NativeCallable<_DiffCallbackNative> callable;
+    callable = NativeCallable<_DiffCallbackNative>.listener((Pointer<_DesktopEntryDiff> diff) {
+      // The null diff _closeDrained() sends comes after every queued one
+      if (diff == nullptr) {
+        callable.close();
+        return;
+      }
+      try {
+        // Diffs of a replaced watch are only freed
+        if (changes.isClosed) return;
+        changes.add([
+          for (var i = 0; i < diff.ref.count; i++)
+            (
+              kind: DesktopEntryChangeKind.values[diff.ref.changes[i]],
+              entry: _read(diff.ref.entries[i]),
+            ),
+        ]);
+      } finally {
+        _freeDesktopEntryDiff(diff);
+      }
+    });
+    final result = _withDirs(dirs, currentDesktop,
+        (cDirs, cDesktop) => _watchDesktopEntries(cDirs, dirs.length, cDesktop, callable.nativeFunction));
+    if (result != 0) {
+      _unwatchDesktopEntries();
+      _closeDrained(callable);
+      return null;
+    }
+    _diffCallable = callable;
+    _changes = changes;
+    return changes.stream;
+  }
+
+  void _unwatch() {
+    _unwatchDesktopEntries();
+    final callable = _diffCallable;
+    _diffCallable = null;
+    if (callable != null) _closeDrained(callable);
+    _changes?.close();
+    _changes = null;
+  }
+
+  /// Close [callable] once the diffs queued for it were freed. Nothing is
+  /// sent after unwatch_desktop_entries() returns, but closing right away
+  /// would drop what is already queued, native allocations and all, so a
+  /// null diff is queued behind them and the callable closes on that.
+  static void _closeDrained(NativeCallable<_DiffCallbackNative> callable) {
+    callable.nativeFunction.asFunction<void Function(Pointer<_DesktopEntryDiff>)>()(nullptr);
+  }
+
+  /// Run [call] with [dirs] and [currentDesktop] as native strings.
+  T _withDirs<T>(
+      List<String> dirs, String? currentDesktop, T Function(Pointer<Pointer<Utf8>>, Pointer<Utf8>) call) {
+    final cDirs = calloc<Pointer<Utf8>>(dirs.length);
+    final cDesktop = currentDesktop?.toNativeUtf8() ?? nullptr;
+    try {
+      for (var i = 0; i < dirs.length; i++) {
+        cDirs[i] = dirs[i].toNativeUtf8();
+      }
+      return call(cDirs, cDesktop);
+    } finally {
+      for (var i = 0; i < dirs.length; i++) {
+        if (cDirs[i] != nullptr) malloc.free(cDirs[i]);
+      }
+      calloc.free(cDirs);
+      if (cDesktop != nullptr) malloc.free(cDesktop);
+    }
+  }
+
+  static ParsedDesktopEntry _read(_DesktopEntryRecord record) => (
+        name: record.name.toDartString(),
+        exec: record.exec.toDartString(),
+        icon: _optional(record.icon),
+        wmClass: _optional(record.wmClass),
+        path: record.path.toDartString(),
+      );
+
+  static String? _optional(Pointer<Utf8> s) => s == nullptr ? null : s.toDartString();
+}
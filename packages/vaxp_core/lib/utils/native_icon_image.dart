@@ -0,0 +1,63 @@
+import 'dart:ui' as ui;
+import 'package:flutter/foundation.dart';
+import 'package:flutter/painting.dart';
+import 'native_icon_lookup.dart';
+
+/// An icon file or theme icon name rendered by libicon_loader's worker
+/// threads at exactly [size] * [scale] device pixels and uploaded as raw
+/// pixels, so neither the file decode nor SVG parsing happens in Flutter.
+/// Images are cached by Flutter's image cache under (icon, size, scale).
+@immutable
+class NativeIconImage extends ImageProvider<NativeIconImage> {
+  final String icon;
+  final int size;
+  final int scale;
+
+  const NativeIconImage(this.icon, {required this.size, this.scale = 1});
+
+  @override
+  Future<NativeIconImage> obtainKey(ImageConfiguration configuration) =>
+      SynchronousFuture<NativeIconImage>(this);
+
+  @override
+  ImageStreamCompleter loadImage(NativeIconImage key, ImageDecoderCallback decode) =>
+      OneFrameImageStreamCompleter(_load(key));
+
+  static Future<ImageInfo> _load(NativeIconImage key) async {
+    final lookup = NativeIconLookup.open();
+    final pixels = await lookup?.loadPixelsAsync(key.icon, size: key.size, scale: key.scale);
+    if (pixels == null) throw StateError('Cannot render icon ${key.icon}');
+    // Awaited step by step rather than through decodeImageFromPixels, whose
+    // callback is never called when the upload fails, so errors reach the
+    // image stream instead of leaving it pending forever.
+    final buffer = await ui.ImmutableBuffer.fromUint8List(pixels.pixels);
+    final descriptor = ui.ImageDescriptor.raw(
+      buffer,
+      width: pixels.width,
+      height: pixels.height,
+      pixelFormat: ui.PixelFormat.rgba8888,
+    );
+    try {
+      final codec = await descriptor.instantiateCodec();
+      try {
+        final frame = await codec.getNextFrame();
+        return ImageInfo(image: frame.image, scale: key.scale.toDouble());
+      } finally {
+        codec.dispose();
+      }
+    } finally {
+      descriptor.dispose();
+      buffer.dispose();
+    }
+  }
+
+  @override
+  bool operator ==(Object other) =>
+      other is NativeIconImage && other.icon == icon && other.size == size && other.scale == scale;
+
+  @override
+  int get hashCode => Object.hash(icon, size, scale);
+
+  @override
+  String toString() => 'NativeIconImage("$icon", size: $size, scale: $scale)';
+}
@@ -0,0 +1,348 @@
+import 'dart:async';
+import 'dart:convert';
+import 'dart:ffi';
+import 'dart:typed_data';
+// ignore: depend_on_referenced_packages
+import 'package:ffi/ffi.dart';
+import 'native_library.dart';
+
+final class _IconPathList extends Struct {
+  @Int32()
+  external int count;
+  external Pointer<Pointer<Utf8>> paths;
+}
+
+final class _IconImage extends Struct {
+  @Int32()
+  external int width;
+  @Int32()
+  external int height;
+  external Pointer<Uint8> pixels;
+}
+
+/// An icon rendered natively as premultiplied RGBA. [pixels] is a view of
+/// the native buffer, released when the view is garbage collected.
+class NativeIconPixels {
+  final int width;
+  final int height;
+  final Uint8List pixels;
+
+  const NativeIconPixels(this.width, this.height, this.pixels);
+}
+
+typedef _ThemeCallbackNative = Void Function(Pointer<Utf8>);
+typedef _PathsCallbackNative = Void Function(Int64, Pointer<_IconPathList>);
+typedef _ImageCallbackNative = Void Function(Int64, Pointer<_IconImage>);
+typedef _RequestIconPathsNative = Int32 Function(Pointer<Pointer<Utf8>>, Pointer<Int32>, Int32,
+    Int32, Int64, Pointer<NativeFunction<_PathsCallbackNative>>);
+typedef _RequestIconPaths = int Function(Pointer<Pointer<Utf8>>, Pointer<Int32>, int, int, int,
+    Pointer<NativeFunction<_PathsCallbackNative>>);
+typedef _RequestIconRgbaNative = Int32 Function(
+    Pointer<Utf8>, Int32, Int32, Int64, Pointer<NativeFunction<_ImageCallbackNative>>);
+typedef _RequestIconRgba = int Function(
+    Pointer<Utf8>, int, int, int, Pointer<NativeFunction<_ImageCallbackNative>>);
+
+/// Icon theme lookups through libicon_loader. [find] probes the native theme
+/// index, built once from each theme's index.theme and one listing per icon
+/// directory; [lookup] batches many names into one call into native code.
+/// [lookupAsync] and [loadPixelsAsync] do the work on the library's worker
+/// threads and complete on this isolate.
+class NativeIconLookup {
+  final Pointer<Utf8> Function(Pointer<Utf8>, int, int) _findIconPath;
+  final void Function(Pointer<Utf8>) _freeIconPath;
+  final void Function(Pointer<Utf8>) _setIconTheme;
+  final Pointer<Utf8> Function() _getIconTheme;
+  final void Function(Pointer<NativeFunction<_ThemeCallbackNative>>) _watchIconTheme;
+  final void Function() _unwatchIconTheme;
+  NativeCallable<_ThemeCallbackNative>? _themeCallable;
+  late final StreamController<String> _themeChanges =
+      StreamController<String>.broadcast(onListen: _watchTheme, onCancel: _unwatchTheme);
+  final void Function(Pointer<NativeFunction<_ThemeCallbackNative>>) _watchIconChanges;
+  final void Function() _unwatchIconChanges;
+  NativeCallable<_ThemeCallbackNative>? _iconsCallable;
+  late final StreamController<Set<String>?> _iconChanges = StreamController<Set<String>?>.broadcast(
+      onListen: _watchIcons, onCancel: _unwatchIcons);
+  final Pointer<_IconPathList> Function(Pointer<Pointer<Utf8>>, Pointer<Int32>, int, int) _getIconPaths;
+  final void Function(Pointer<_IconPathList>) _freeIconPaths;
+  final Pointer<_IconImage> Function(Pointer<Utf8>, int, int) _loadIconRgba;
+  final Pointer<NativeFinalizerFunction> _releaseIconImage;
+  final _RequestIconPaths _requestIconPaths;
+  final _RequestIconRgba _requestIconRgba;
+  final _pendingPaths = <int, Completer<List<String?>?>>{};
+  final _pendingPixels = <int, Completer<NativeIconPixels?>>{};
+  var _nextRequest = 0;
+  // Opened on first use and kept for the isolate's lifetime; they do not
+  // keep the isolate alive.
+  late final NativeCallable<_PathsCallbackNative> _pathsCallable =
+      NativeCallable<_PathsCallbackNative>.listener(_completePaths)..keepIsolateAlive = false;
+  late final NativeCallable<_ImageCallbackNative> _pixelsCallable =
+      NativeCallable<_ImageCallbackNative>.listener(_completePixels)..keepIsolateAlive = false;
+
+  static NativeIconLookup? _instance;
+  static bool _opened = false;
+
+  NativeIconLookup._(DynamicLibrary lib)
+      : _findIconPath = lib.lookupFunction<
+            Pointer<Utf8> Function(Pointer<Utf8>, Int32, Int32),
+            Pointer<Utf8> Function(Pointer<Utf8>, int, int)>('find_icon_path'),
+        _freeIconPath = lib.lookupFunction<
+            Void Function(Pointer<Utf8>),
+            void Function(Pointer<Utf8>)>('free_icon_path'),
+        _setIconTheme = lib.lookupFunction<
+            Void Function(Pointer<Utf8>),
+            void Function(Pointer<Utf8>)>('set_icon_theme'),
+        _getIconTheme = lib.lookupFunction<Pointer<Utf8> Function(), Pointer<Utf8> Function()>(
+            'get_icon_theme'),
+        _watchIconTheme = lib.lookupFunction<
+            Void Function(Pointer<NativeFunction<_ThemeCallbackNative>>),
+            void Function(Pointer<NativeFunction<_ThemeCallbackNative>>)>('watch_icon_theme'),
+        _unwatchIconTheme =
+            lib.lookupFunction<Void Function(), void Function()>('unwatch_icon_theme'),
+        _watchIconChanges = lib.lookupFunction<
+            Void Function(Pointer<NativeFunction<_ThemeCallbackNative>>),
+            void Function(Pointer<NativeFunction<_ThemeCallbackNative>>)>('watch_icon_changes'),
+        _unwatchIconChanges =
+            lib.lookupFunction<Void Function(), void Function()>('unwatch_icon_changes'),
+        _getIconPaths = lib.lookupFunction<
+            Pointer<_IconPathList> Function(Pointer<Pointer<Utf8>>, Pointer<Int32>, Int32, Int32),
+            Pointer<_IconPathList> Function(
+                Pointer<Pointer<Utf8>>, Pointer<Int32>, int, int)>('get_icon_paths'),
+        _freeIconPaths = lib.lookupFunction<
+            Void Function(Pointer<_IconPathList>),
+            void Function(Pointer<_IconPathList>)>('free_icon_paths'),
+        _loadIconRgba = lib.lookupFunction<
+            Pointer<_IconImage> Function(Pointer<Utf8>, Int32, Int32),
+            Pointer<_IconImage> Function(Pointer<Utf8>, int, int)>('load_icon_rgba'),
+        _releaseIconImage = lib.lookup('release_icon_image'),
+        _requestIconPaths =
+            lib.lookupFunction<_RequestIconPathsNative, _RequestIconPaths>('request_icon_paths'),
+        _requestIconRgba =
+            lib.lookupFunction<_RequestIconRgbaNative, _RequestIconRgba>('request_icon_rgba');
+
+  /// Shared instance. Returns null if the native library or its lookup
+  /// symbols are missing.
+  static NativeIconLookup? open() {
+    if (_opened) return _instance;
+    _opened = true;
+    final lib = NativeLibrary.open();
+    if (lib == null) return null;
+    try {
+      _instance = NativeIconLookup._(lib);
+    } catch (_) {
+      _instance = null;
+    }
+    return _instance;
+  }
+
+  /// The icon theme lookups use: the GTK setting once [onThemeChanged] has a
+  /// listener, the settings.ini theme before that, or an explicit [setTheme].
+  String themeName() {
+    final result = _getIconTheme();
+    try {
+      return result.toDartString();
+    } finally {
+      _freeIconPath(result);
+    }
+  }
+
+  /// New theme names, after the native side dropped its theme-dependent
+  /// caches. Listening starts following GtkSettings gtk-icon-theme-name,
+  /// which may itself report a change from the settings.ini default.
+  Stream<String> get onThemeChanged => _themeChanges.stream;
+
+  void _watchTheme() {
+    final callable = NativeCallable<_ThemeCallbackNative>.listener((Pointer<Utf8> theme) {
+      final name = theme.toDartString();
+      _freeIconPath(theme);
+      _themeChanges.add(name);
+    });
+    _themeCallable = callable;
+    _watchIconTheme(callable.nativeFunction);
+  }
+
+  void _unwatchTheme() {
+    // No callback runs once this returns, so the callable can be closed.
+    _unwatchIconTheme();
+    _themeCallable?.close();
+    _themeCallable = null;
+  }
+
+  /// Icon names whose files were installed or removed since they were last
+  /// looked up, or null when any icon may have changed (a theme or icon
+  /// directory appeared, or an icon cache was rewritten). The native index
+  /// and caches are already up to date when an event arrives; only results
+  /// held elsewhere need resolving again.
+  Stream<Set<String>?> get onIconsChanged => _iconChanges.stream;
+
+  void _watchIcons() {
+    final callable = NativeCallable<_ThemeCallbackNative>.listener((Pointer<Utf8> names) {
+      if (names == nullptr) {
+        _iconChanges.add(null);
+        return;
+      }
+      final list = names.toDartString();
+      _freeIconPath(names);
+      _iconChanges.add(list.split('\n').where((name) => name.isNotEmpty).toSet());
+    });
+    _iconsCallable = callable;
+    _watchIconChanges(callable.nativeFunction);
+  }
+
+  void _unwatchIcons() {
+    // No callback runs once this returns, so the callable can be closed.
+    _unwatchIconChanges();
+    _iconsCallable?.close();
+    _iconsCallable = null;
+  }
+
+  /// Override the theme for lookups; null goes back to the settings.ini
+  /// theme. The index is rebuilt on the next lookup if the theme changed.
+  void setTheme(String? theme) {
+    final themePtr = theme == null ? nullptr : theme.toNativeUtf8();
+    try {
+      _setIconTheme(themePtr);
+    } finally {
+      if (themePtr != nullptr) malloc.free(themePtr);
+    }
+  }
+
+  /// Resolve one icon name (optionally with an extension) drawn at [size]
+  /// logical pixels on a display with the integer [scale] (device pixel
+  /// ratio rounded up). Picks the smallest bitmap at least size * scale
+  /// pixels large, or a scalable one, before falling back to smaller ones.
+  /// Returns the path with symlinks resolved, or null.
+  String? find(String name, {int size = 48, int scale = 1}) {
+    final namePtr = name.toNativeUtf8();
+    try {
+      final result = _findIconPath(namePtr, size, scale);
+      if (result == nullptr) return null;
+      try {
+        return result.toDartString();
+      } finally {
+        _freeIconPath(result);
+      }
+    } finally {
+      malloc.free(namePtr);
+    }
+  }
+
+  /// Resolve [names] at [size] logical pixels and [scale] as in [find],
+  /// returning a path (symlinks resolved) or null per name, in order.
+  /// Only the native index is searched; [lookupAsync] also has GTK answer
+  /// its misses. Returns null if the lookup itself failed.
+  List<String?>? lookup(List<String> names, {int size = 48, int scale = 1}) {
+    if (names.isEmpty) return const [];
+    return _withNames(names, size, (namePointers, sizes) {
+      return _readPaths(_getIconPaths(namePointers, sizes, names.length, scale));
+    });
+  }
+
+  /// [lookup] on the native worker threads, so resolving a whole app list
+  /// does not hold up this isolate. GTK answers names the native index
+  /// misses on the GTK main thread.
+  Future<List<String?>?> lookupAsync(List<String> names, {int size = 48, int scale = 1}) {
+    if (names.isEmpty) return Future.value(const []);
+    final id = _nextRequest++;
+    final completer = Completer<List<String?>?>();
+    _pendingPaths[id] = completer;
+    final queued = _withNames(names, size, (namePointers, sizes) {
+      return _requestIconPaths(
+          namePointers, sizes, names.length, scale, id, _pathsCallable.nativeFunction);
+    });
+    if (queued != 0) {
+      _pendingPaths.remove(id);
+      return Future.value(null);
+    }
+    return completer.future;
+  }
+
+  void _completePaths(int id, Pointer<_IconPathList> list) {
+    _pendingPaths.remove(id)?.complete(_readPaths(list));
+  }
+
+  /// Run [call] with [names] and [size] for each laid out natively.
+  /// Pointers, sizes and NUL-terminated names share one allocation.
+  T _withNames<T>(List<String> names, int size, T Function(Pointer<Pointer<Utf8>>, Pointer<Int32>) call) {
+    final encoded = [for (final name in names) utf8.encode(name)];
+    final stringBytes = encoded.fold<int>(0, (sum, bytes) => sum + bytes.length + 1);
+    final pointerBytes = names.length * sizeOf<Pointer>();
+    final sizeBytes = names.length * sizeOf<Int32>();
+    final block = calloc<Uint8>(pointerBytes + sizeBytes + stringBytes);
+    try {
+      final namePointers = block.cast<Pointer<Utf8>>();
+      final sizes = (block + pointerBytes).cast<Int32>();
+      final stringBase = block + pointerBytes + sizeBytes;
+      final strings = stringBase.asTypedList(stringBytes);
+      var offset = 0;
+      for (var i = 0; i < names.length; i++) {
+        namePointers[i] = (stringBase + offset).cast<Utf8>();
+        sizes[i] = size;
+        strings.setAll(offset, encoded[i]);
+        offset += encoded[i].length + 1;
+      }
+      return call(namePointers, sizes);
+    } finally {
+      calloc.free(block);
+    }
+  }
+
+  /// Copy out and free a native path list.
+  List<String?>? _readPaths(Pointer<_IconPathList> list) {
+    if (list == nullptr) return null;
+    try {
+      return [
+        for (var i = 0; i < list.ref.count; i++)
+          list.ref.paths[i] == nullptr ? null : list.ref.paths[i].toDartString(),
+      ];
+    } finally {
+      _freeIconPaths(list);
+    }
+  }
+
+  /// Render [icon] (a file path or theme icon name) at exactly [size] * [scale]
+  /// device pixels square, SVGs included, without going through Flutter's
+  /// decoders. Returns null if the icon is missing or cannot be decoded.
+  NativeIconPixels? loadPixels(String icon, {int size = 48, int scale = 1}) {
+    final iconPtr = icon.toNativeUtf8();
+    try {
+      return _wrapPixels(_loadIconRgba(iconPtr, size, scale));
+    } finally {
+      malloc.free(iconPtr);
+    }
+  }
+
+  /// [loadPixels] on the native worker threads.
+  Future<NativeIconPixels?> loadPixelsAsync(String icon, {int size = 48, int scale = 1}) {
+    final id = _nextRequest++;
+    final completer = Completer<NativeIconPixels?>();
+    _pendingPixels[id] = completer;
+    final iconPtr = icon.toNativeUtf8();
+    try {
+      if (_requestIconRgba(iconPtr, size, scale, id, _pixelsCallable.nativeFunction) != 0) {
+        _pendingPixels.remove(id);
+        return Future.value(null);
+      }
+    } finally {
+      malloc.free(iconPtr);
+    }
+    return completer.future;
+  }
+
+  void _completePixels(int id, Pointer<_IconImage> image) {
+    _pendingPixels.remove(id)?.complete(_wrapPixels(image));
+  }
+
+  NativeIconPixels? _wrapPixels(Pointer<_IconImage> image) {
+    if (image == nullptr) return null;
+    final ref = image.ref;
+    return NativeIconPixels(
+      ref.width,
+      ref.height,
+      ref.pixels.asTypedList(
+        ref.width * ref.height * 4,
+        finalizer: _releaseIconImage,
+        token: image.cast(),
+      ),
+    );
+  }
+}
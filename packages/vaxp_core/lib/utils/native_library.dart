@@ -0,0 +1,41 @@
+import 'dart:ffi';
+import 'dart:io' show Platform, Directory, File;
+
+/// Locates and opens libicon_loader.so, the native helper library built from
+/// src/. Returns null when the library is not installed so callers can fall
+/// back to their pure-Dart paths.
+class NativeLibrary {
+  static DynamicLibrary? _lib;
+  static bool _searched = false;
+
+  static DynamicLibrary? open() {
+    if (_searched) return _lib;
+    _searched = true;
+
+    if (!Platform.isLinux) return null;
+
+    const libName = 'libicon_loader.so';
+    final locations = [
+      // Bundle lib directory next to the executable
+      '${File(Platform.resolvedExecutable).parent.path}/lib/$libName',
+      // Build directory
+      '${Directory.current.path}/build/lib/$libName',
+      // Local lib directory
+      '${Directory.current.path}/lib/$libName',
+      // System library paths
+      '/usr/local/lib/$libName',
+      '/usr/lib/$libName',
+    ];
+
+    for (final location in locations) {
+      if (!File(location).existsSync()) continue;
+      try {
+        _lib = DynamicLibrary.open(location);
+        return _lib;
+      } catch (_) {
+        // Try the next location
+      }
+    }
+    return null;
+  }
+}
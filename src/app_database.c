@@ -0,0 +1,269 @@
+#define _GNU_SOURCE
+#include "app_database.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File layout, host byte order, every section 8-byte aligned and addressed
+// by offsets from the start:
+//   db_header
+//   db_dir[n_dirs]
+//   db_record[n_records]    grouped by directory, sorted by file name
+//   strings                 NUL-terminated, referenced by offset
+#define DB_MAGIC "VXAPPDB"
+#define DB_VERSION 2
+#define NO_STRING 0xffffffffu
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t file_size;
+    uint32_t n_dirs;
+    uint32_t dirs;
+    uint32_t n_records;
+    uint32_t records;
+    uint32_t strings;
+    uint32_t reserved;
+} db_header;
+
+typedef struct {
+    uint32_t path;  // String offset
+    uint32_t exists;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint32_t first;  // Index of its first record
+    uint32_t count;
+} db_dir;
+
+typedef struct {
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t size;
+    uint32_t flags;
+    uint32_t file;  // String offsets from here on, NO_STRING if absent
+    uint32_t name;
+    uint32_t exec;
+    uint32_t icon;
+    uint32_t wm_class;
+    uint32_t only_show_in;
+    uint32_t not_show_in;
+} db_record;
+
+static struct {
+    const uint8_t* data;
+    size_t size;
+} db;
+
+static int db_path(char* out, size_t size, int create_dir) {
+    const char* base = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    char dir[PATH_MAX];
+    if (base && *base) snprintf(dir, sizeof(dir), "%s/vaxp", base);
+    else if (home) snprintf(dir, sizeof(dir), "%s/.cache/vaxp", home);
+    else return -1;
+    if (create_dir) {
+        char parent[PATH_MAX];
+        snprintf(parent, sizeof(parent), "%.*s", (int)(strrchr(dir, '/') - dir), dir);
+        mkdir(parent, 0700);
+        if (mkdir(dir, 0700) != 0 && errno != EEXIST) return -1;
+    }
+    snprintf(out, size, "%s/apps.db", dir);
+    return 0;
+}
+
+static const db_header* header() {
+    return (const db_header*)db.data;
+}
+
+static const char* string_at(uint32_t offset) {
+    if (offset < header()->strings || offset >= db.size) return NULL;
+    if (!memchr(db.data + offset, '\0', db.size - offset)) return NULL;
+    return (const char*)db.data + offset;
+}
+
+static text_span span_at(uint32_t offset) {
+    const char* s = offset == NO_STRING ? NULL : string_at(offset);
+    return s ? (text_span){ s, strlen(s) } : (text_span){ NULL, 0 };
+}
+
+static int section_fits(uint32_t offset, uint32_t count, size_t item) {
+    return offset % 8 == 0 && offset <= db.size && count <= (db.size - offset) / item;
+}
+
+// Check the header, the section bounds and that every directory's records
+// lie within the record section and have a file name.
+static int validate() {
+    const db_header* h = header();
+    if (db.size < sizeof(db_header) || memcmp(h->magic, DB_MAGIC, 8) != 0 ||
+        h->version != DB_VERSION || h->file_size != db.size ||
+        !section_fits(h->dirs, h->n_dirs, sizeof(db_dir)) ||
+        !section_fits(h->records, h->n_records, sizeof(db_record)) || h->strings > db.size) {
+        return 0;
+    }
+    const db_dir* dirs = (const db_dir*)(db.data + h->dirs);
+    for (uint32_t i = 0; i < h->n_dirs; i++) {
+        if (!string_at(dirs[i].path) || dirs[i].first > h->n_records ||
+            dirs[i].count > h->n_records - dirs[i].first) {
+            return 0;
+        }
+    }
+    const db_record* records = (const db_record*)(db.data + h->records);
+    for (uint32_t i = 0; i < h->n_records; i++) {
+        if (!string_at(records[i].file)) return 0;
+    }
+    return 1;
+}
+
+int app_database_open() {
+    app_database_close();
+    char path[PATH_MAX];
+    if (db_path(path, sizeof(path), 0) != 0) return 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            db.data = data;
+            db.size = st.st_size;
+        }
+    }
+    close(fd);
+    if (db.data && !validate()) app_database_close();
+    return db.data != NULL;
+}
+
+void app_database_close() {
+    if (db.data) munmap((void*)db.data, db.size);
+    db.data = NULL;
+    db.size = 0;
+}
+
+int app_database_find_dir(const char* dir, app_dir* seen, int* first, int* count) {
+    if (!db.data) return 0;
+    const db_dir* dirs = (const db_dir*)(db.data + header()->dirs);
+    for (uint32_t i = 0; i < header()->n_dirs; i++) {
+        const char* path = string_at(dirs[i].path);
+        if (strcmp(path, dir) != 0) continue;
+        *seen = (app_dir){ path, dirs[i].exists, { dirs[i].mtime_sec, dirs[i].mtime_nsec } };
+        *first = dirs[i].first;
+        *count = dirs[i].count;
+        return 1;
+    }
+    return 0;
+}
+
+void app_database_record(int index, app_record* out) {
+    const db_record* r = (const db_record*)(db.data + header()->records) + index;
+    *out = (app_record){
+        .file = string_at(r->file),
+        .ino = r->ino,
+        .mtime = { r->mtime_sec, r->mtime_nsec },
+        .size = r->size,
+        .flags = r->flags,
+        .name = span_at(r->name),
+        .exec = span_at(r->exec),
+        .icon = span_at(r->icon),
+        .wm_class = span_at(r->wm_class),
+        .only_show_in = span_at(r->only_show_in),
+        .not_show_in = span_at(r->not_show_in),
+    };
+}
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+static size_t span_bytes(text_span s) {
+    return s.len ? s.len + 1 : 0;
+}
+
+// Appends s to the string section, returning its offset.
+static uint32_t put_span(uint8_t* file, size_t* end, text_span s) {
+    if (!s.len) return NO_STRING;
+    memcpy(file + *end, s.start, s.len);
+    file[*end + s.len] = '\0';
+    uint32_t offset = *end;
+    *end += s.len + 1;
+    return offset;
+}
+
+static uint32_t put_string(uint8_t* file, size_t* end, const char* s) {
+    return put_span(file, end, (text_span){ s, strlen(s) });
+}
+
+int app_database_save(const app_dir* dirs, int n_dirs, const app_record* records,
+                      const int* record_dirs, int n_records) {
+    size_t strings_len = 0;
+    for (int i = 0; i < n_dirs; i++) strings_len += strlen(dirs[i].path) + 1;
+    for (int i = 0; i < n_records; i++) {
+        const app_record* r = &records[i];
+        strings_len += strlen(r->file) + 1 + span_bytes(r->name) + span_bytes(r->exec) +
+                       span_bytes(r->icon) + span_bytes(r->wm_class) +
+                       span_bytes(r->only_show_in) + span_bytes(r->not_show_in);
+    }
+
+    size_t dirs_at = align8(sizeof(db_header));
+    size_t records_at = align8(dirs_at + n_dirs * sizeof(db_dir));
+    size_t strings = align8(records_at + n_records * sizeof(db_record));
+    size_t size = strings + strings_len;
+    if (size > UINT32_MAX) return -1;
+    uint8_t* file = calloc(1, size);
+    if (!file) return -1;
+
+    db_header* h = (db_header*)file;
+    memcpy(h->magic, DB_MAGIC, 8);
+    h->version = DB_VERSION;
+    h->file_size = size;
+    h->n_dirs = n_dirs;
+    h->dirs = dirs_at;
+    h->n_records = n_records;
+    h->records = records_at;
+    h->strings = strings;
+    size_t end = strings;
+
+    db_dir* out_dirs = (db_dir*)(file + dirs_at);
+    for (int i = 0; i < n_dirs; i++) {
+        out_dirs[i] = (db_dir){ put_string(file, &end, dirs[i].path), dirs[i].exists,
+                                dirs[i].mtime.tv_sec, dirs[i].mtime.tv_nsec, n_records, 0 };
+    }
+    db_record* out_records = (db_record*)(file + records_at);
+    for (int i = 0; i < n_records; i++) {
+        const app_record* r = &records[i];
+        db_dir* d = &out_dirs[record_dirs[i]];
+        if (!d->count) d->first = i;
+        d->count++;
+        out_records[i] = (db_record){
+            r->ino, r->mtime.tv_sec, r->mtime.tv_nsec, r->size, r->flags,
+            put_string(file, &end, r->file), put_span(file, &end, r->name),
+            put_span(file, &end, r->exec), put_span(file, &end, r->icon),
+            put_span(file, &end, r->wm_class), put_span(file, &end, r->only_show_in),
+            put_span(file, &end, r->not_show_in),
+        };
+    }
+
+    // Write a new file and rename it over the old one, so the mapping and
+    // other readers stay intact.
+    char path[PATH_MAX] = "", tmp[PATH_MAX + 16];
+    int result = -1;
+    if (db_path(path, sizeof(path), 1) == 0) {
+        snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+        FILE* f = fopen(tmp, "wb");
+        if (f) {
+            int written = fwrite(file, 1, size, f) == size;
+            if (fclose(f) == 0 && written && rename(tmp, path) == 0) result = 0;
+            else unlink(tmp);
+        }
+    }
+    free(file);
+    if (result != 0) fprintf(stderr, "app database: cannot write %s\n", path);
+    return result;
+}
@@ -0,0 +1,65 @@
+#ifndef APP_DATABASE_H
+#define APP_DATABASE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Internal to libicon_loader: the parsed .desktop files of the application
+// directories persisted in $XDG_CACHE_HOME/vaxp/apps.db, so a warm start
+// needs no parsing. Each directory is recorded with its mtime and each file
+// with its (inode, mtime, size); desktop_entries.c re-lists only changed
+// directories and re-parses only changed files. Not thread-safe;
+// desktop_entries.c calls it under its lock.
+
+// Record flags.
+#define APP_NO_DISPLAY 1
+#define APP_HIDDEN 2
+#define APP_NO_ENTRY 4  // No [Desktop Entry] group with Name and Exec
+#define APP_SUBDIR 8    // A subdirectory, recorded as its own directory too
+
+// A string that is not necessarily NUL-terminated; len 0 if absent.
+typedef struct {
+    const char* start;
+    size_t len;
+} text_span;
+
+typedef struct {
+    const char* file;  // Name within its directory, NUL-terminated
+    uint64_t ino;
+    struct timespec mtime;
+    int64_t size;
+    uint32_t flags;
+    text_span name;
+    text_span exec;
+    text_span icon;
+    text_span wm_class;      // StartupWMClass
+    text_span only_show_in;  // Raw semicolon-separated lists
+    text_span not_show_in;
+} app_record;
+
+// One application directory as last seen.
+typedef struct {
+    const char* path;
+    int exists;
+    struct timespec mtime;
+} app_dir;
+
+// Map the database file. Returns 1 if it is there and well-formed.
+int app_database_open();
+void app_database_close();
+
+// Find dir in the mapped database. Returns 1 and fills *seen, *first and
+// *count (its records, sorted by file name) if it is recorded, else 0.
+int app_database_find_dir(const char* dir, app_dir* seen, int* first, int* count);
+
+// The mapped record at index; strings point into the mapping.
+void app_database_record(int index, app_record* out);
+
+// Write dirs and their records to a new database file; records[i] belongs
+// to dirs[record_dirs[i]] and each directory's records are contiguous and
+// sorted by file name. Returns 0 on success.
+int app_database_save(const app_dir* dirs, int n_dirs, const app_record* records,
+                      const int* record_dirs, int n_records);
+
+#endif
@@ -0,0 +1,114 @@
+#!/bin/sh
+# Checks the Wayland window tracker against a private headless sway: opens
+# two foot windows, retitles one, moves focus between them and closes one,
+# and expects window_events_probe to report each as added, changed, focus
+# and removed events. Exits non-zero on the first missing event.
+#
+# Usage: run_wayland_check.sh <window_events_probe>
+# Needs sway, swaymsg and foot.
+set -eu
+
+probe=${1:?usage: $0 <window_events_probe>}
+for tool in sway swaymsg foot; do
+    command -v "$tool" >/dev/null || { echo "$tool not found" >&2; exit 2; }
+done
+
+dir=$(mktemp -d)
+pids=
+cleanup() {
+    # shellcheck disable=SC2086
+    [ -n "$pids" ] && kill $pids 2>/dev/null
+    rm -rf "$dir"
+}
+trap cleanup EXIT INT TERM
+
+mkdir -m 700 "$dir/runtime"
+export XDG_RUNTIME_DIR="$dir/runtime"
+export WLR_BACKENDS=headless WLR_HEADLESS_OUTPUTS=1 WLR_LIBINPUT_NO_DEVICES=1
+export WLR_RENDERER=pixman
+unset DISPLAY WAYLAND_DISPLAY SWAYSOCK
+printf 'xwayland disable\n' >"$dir/sway.conf"
+sway -c "$dir/sway.conf" >"$dir/sway.log" 2>&1 &
+pids="$!"
+
+# Wait until $1 succeeds, for up to five seconds.
+wait_for() {
+    for _ in $(seq 50); do
+        if eval "$1"; then return 0; fi
+        sleep 0.1
+    done
+    return 1
+}
+
+fail() {
+    echo "FAIL: $1" >&2
+    echo "--- events" >&2
+    cat "$dir/events" >&2
+    exit 1
+}
+
+wait_for 'ls "$XDG_RUNTIME_DIR"/wayland-[0-9] >/dev/null 2>&1' ||
+    { cat "$dir/sway.log" >&2; echo "FAIL: sway did not start" >&2; exit 1; }
+WAYLAND_DISPLAY=$(basename "$(ls "$XDG_RUNTIME_DIR"/wayland-[0-9] | head -n1)")
+export WAYLAND_DISPLAY
+wait_for 'ls "$XDG_RUNTIME_DIR"/sway-ipc.*.sock >/dev/null 2>&1' || fail "no sway IPC socket"
+SWAYSOCK=$(ls "$XDG_RUNTIME_DIR"/sway-ipc.*.sock | head -n1)
+export SWAYSOCK
+
+VAXP_WINDOW_BACKEND=wayland "$probe" >"$dir/events" &
+pids="$pids $!"
+
+# The ID of the window first added with title $1, empty until it was.
+window_id() {
+    grep '"event": "added"' "$dir/events" | grep -F "\"title\": \"$1\"" |
+        sed -n 's/.*"window": "\([^"]*\)".*/\1/p' | head -n1
+}
+
+# Only events reported after the last call count for expect.
+mark() {
+    seen=$(wc -l <"$dir/events")
+}
+
+# Wait for an event named $1 for window $2, with title $3 if given.
+expect() {
+    pattern="\"event\": \"$1\", \"window\": \"$2\""
+    title=
+    [ $# -ge 3 ] && title="\"title\": \"$3\""
+    wait_for "tail -n +$((seen + 1)) \"\$dir/events\" | grep -F '$pattern' | grep -qF '$title'" ||
+        fail "no $1 event for $2 ${3:-}"
+}
+
+# Each window retitles itself once $dir/retitle-<title> exists.
+open_window() {
+    foot -T "$1" sh -c "while [ ! -e '$dir/retitle-$1' ]; do sleep 0.1; done
+        printf '\\033]2;%s\\007' '$1-renamed'; exec sleep 600" >/dev/null 2>&1 &
+    pids="$pids $!"
+}
+
+open_window vaxp-check-a
+wait_for '[ -n "$(window_id vaxp-check-a)" ]' || fail "vaxp-check-a was not added"
+a=$(window_id vaxp-check-a)
+open_window vaxp-check-b
+wait_for '[ -n "$(window_id vaxp-check-b)" ]' || fail "vaxp-check-b was not added"
+b=$(window_id vaxp-check-b)
+echo "added: a=$a b=$b" >&2
+
+mark
+touch "$dir/retitle-vaxp-check-a"
+expect changed "$a" vaxp-check-a-renamed
+echo "title change reported" >&2
+
+mark
+swaymsg -q "[title=\"^vaxp-check-a\"] focus"
+expect focus "$a"
+mark
+swaymsg -q "[title=\"^vaxp-check-b\"] focus"
+expect focus "$b"
+echo "focus changes reported" >&2
+
+mark
+swaymsg -q "[title=\"^vaxp-check-a\"] kill"
+expect removed "$a"
+echo "removal reported" >&2
+
+echo "PASS" >&2
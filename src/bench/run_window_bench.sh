@@ -0,0 +1,51 @@
+#!/bin/sh
+# Runs window_tracker_bench on a private Xvfb server for 10, 100 and 1000
+# windows and every tracking mode, and writes one JSON report.
+#
+# Usage: run_window_bench.sh <window_tracker_bench> [report.json]
+# Environment: SECONDS_PER_RUN (default 5), RATE (changes/s, default 50),
+# WINDOW_COUNTS, MODES.
+set -eu
+
+bench=${1:?usage: $0 <window_tracker_bench> [report.json]}
+report=${2:-window_bench_report.json}
+seconds=${SECONDS_PER_RUN:-5}
+rate=${RATE:-50}
+counts=${WINDOW_COUNTS:-"10 100 1000"}
+modes=${MODES:-"subprocess native-list native-events"}
+
+display=99
+while [ -e "/tmp/.X11-unix/X$display" ] || [ -e "/tmp/.X$display-lock" ]; do
+    display=$((display + 1))
+done
+Xvfb ":$display" -screen 0 1280x800x24 -nolisten tcp >/dev/null 2>&1 &
+xvfb=$!
+trap 'kill $xvfb 2>/dev/null' EXIT INT TERM
+export DISPLAY=":$display"
+# The native tracker would prefer a Wayland session the shell happens to be in.
+export VAXP_WINDOW_BACKEND=x11
+unset WAYLAND_DISPLAY
+
+for _ in $(seq 50); do
+    [ -e "/tmp/.X11-unix/X$display" ] && break
+    sleep 0.1
+done
+
+{
+    printf '{"date": "%s", "host": "%s", "cpus": %s, "runs": [' \
+        "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$(uname -n)" "$(nproc)"
+    separator=
+    for count in $counts; do
+        for mode in $modes; do
+            if [ "$mode" = subprocess ] && ! command -v xdotool >/dev/null; then
+                echo "skipping subprocess mode: xdotool not found" >&2
+                continue
+            fi
+            echo "$mode, $count windows" >&2
+            printf '%s\n  %s' "$separator" "$("$bench" "$mode" "$count" "$seconds" "$rate")"
+            separator=,
+        done
+    done
+    printf '\n]}\n'
+} >"$report"
+echo "wrote $report" >&2
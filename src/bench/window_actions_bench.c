@@ -0,0 +1,110 @@
+// Compares click-to-request latency of the native EWMH actions in
+// libicon_loader with the `wmctrl -i -a` subprocess they replace.
+//
+// Usage: window_actions_bench [iterations] [window-id...]
+// Without window IDs the first two clients of _NET_CLIENT_LIST are used and
+// activated alternately. Prints one JSON object to stdout.
+
+#include "../window_tracker.h"
+
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+
+extern char** environ;
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void print_stats(const char* name, double* samples, int n, int last) {
+    qsort(samples, n, sizeof(double), compare_doubles);
+    double sum = 0;
+    for (int i = 0; i < n; i++) sum += samples[i];
+    printf("    \"%s\": {\"min_us\": %.1f, \"median_us\": %.1f, \"p99_us\": %.1f, \"mean_us\": %.1f}%s\n",
+           name, samples[0], samples[n / 2], samples[(n * 99) / 100], sum / n, last ? "" : ",");
+}
+
+static int run_wmctrl(uint32_t window) {
+    char id[16];
+    snprintf(id, sizeof(id), "0x%08x", window);
+    char* argv[] = { "wmctrl", "-i", "-a", id, NULL };
+    pid_t pid;
+    if (posix_spawnp(&pid, "wmctrl", NULL, NULL, argv, environ) != 0) return -1;
+    int status;
+    if (waitpid(pid, &status, 0) < 0) return -1;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    if (iterations <= 0) iterations = 200;
+
+    uint32_t windows[16];
+    int n_windows = 0;
+    for (int i = 2; i < argc && n_windows < 16; i++) {
+        windows[n_windows++] = (uint32_t)strtoul(argv[i], NULL, 0);
+    }
+    if (n_windows == 0) {
+        window_list* list = get_window_list();
+        if (!list) {
+            fprintf(stderr, "no X connection\n");
+            return 1;
+        }
+        for (int i = 0; i < list->count && n_windows < 2; i++) {
+            windows[n_windows++] = list->windows[i].window;
+        }
+        free_window_list(list);
+    }
+    if (n_windows == 0) {
+        fprintf(stderr, "no client windows to activate\n");
+        return 1;
+    }
+
+    double* native = malloc(iterations * sizeof(double));
+    double* wmctrl = malloc(iterations * sizeof(double));
+    if (!native || !wmctrl) return 1;
+
+    // Warm up the query connection so its setup is not counted.
+    activate_window(windows[0]);
+
+    for (int i = 0; i < iterations; i++) {
+        double start = now_us();
+        if (activate_window(windows[i % n_windows]) != 0) {
+            fprintf(stderr, "activate_window failed\n");
+            return 1;
+        }
+        native[i] = now_us() - start;
+    }
+
+    int wmctrl_ok = 1;
+    for (int i = 0; i < iterations; i++) {
+        double start = now_us();
+        if (run_wmctrl(windows[i % n_windows]) != 0) {
+            wmctrl_ok = 0;
+            break;
+        }
+        wmctrl[i] = now_us() - start;
+    }
+
+    printf("{\n  \"benchmark\": \"window_actions\",\n  \"iterations\": %d,\n  \"windows\": %d,\n",
+           iterations, n_windows);
+    printf("  \"results\": {\n");
+    print_stats("native_activate", native, iterations, !wmctrl_ok);
+    if (wmctrl_ok) print_stats("wmctrl_activate", wmctrl, iterations, 1);
+    printf("  }\n}\n");
+
+    free(native);
+    free(wmctrl);
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Prints the window tracker's event stream as JSON lines, one per event,
+// with a monotonic timestamp. Runs against whichever backend
+// start_window_tracker() selects, so it works the same under a headless
+// compositor (e.g. `WLR_BACKENDS=headless sway`) or Xvfb.
+//
+// Usage: window_events_probe [seconds]
+// Without a duration it runs until interrupted.
+
+#include "../window_tracker.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t done;
+
+static void on_signal(int sig) {
+    (void)sig;
+    done = 1;
+}
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void print_json_string(const char* s) {
+    if (!s) {
+        fputs("null", stdout);
+        return;
+    }
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') printf("\\%c", c);
+        else if (c < 0x20) printf("\\u%04x", c);
+        else putchar(c);
+    }
+    putchar('"');
+}
+
+static const char* event_name(int type) {
+    switch (type) {
+    case WINDOW_EVENT_ADDED: return "added";
+    case WINDOW_EVENT_REMOVED: return "removed";
+    case WINDOW_EVENT_CHANGED: return "changed";
+    case WINDOW_EVENT_FOCUS: return "focus";
+    case WINDOW_EVENT_ICON: return "icon";
+    case WINDOW_EVENT_DESKTOP: return "desktop";
+    default: return "unknown";
+    }
+}
+
+// Called on the tracker thread; stdout is locked per call by stdio.
+static void on_event(window_event* event) {
+    const window_record* w = &event->window;
+    flockfile(stdout);
+    printf("{\"t_ms\": %.3f, \"event\": \"%s\", \"window\": \"0x%08x\", \"pid\": %d, "
+           "\"desktop\": %d, \"state\": %u, \"title\": ",
+           now_ms(), event_name(event->type), w->window, w->pid, w->desktop, w->state);
+    print_json_string(w->title);
+    fputs(", \"class\": ", stdout);
+    print_json_string(w->wm_class);
+    fputs("}\n", stdout);
+    fflush(stdout);
+    funlockfile(stdout);
+    free_window_event(event);
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 0;
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    if (start_window_tracker(on_event) != 0) {
+        fprintf(stderr, "no X server or foreign-toplevel compositor\n");
+        return 1;
+    }
+    double end = now_ms() + seconds * 1e3;
+    while (!done && (seconds <= 0 || now_ms() < end)) usleep(10000);
+    stop_window_tracker();
+    return 0;
+}
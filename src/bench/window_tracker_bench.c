@@ -0,0 +1,399 @@
+// Measures what window tracking costs as the number of client windows grows.
+//
+// The process plays a minimal EWMH window manager: it creates synthetic
+// client windows, publishes them in _NET_CLIENT_LIST and keeps renaming them
+// (and now and then changing their WM_CLASS). An observer tracks the
+// windows the way the dock would, and the run reports its CPU time,
+// context switches, forks and the latency from each title change until the
+// observer saw it. Run it on a throwaway X server; run_window_bench.sh
+// starts Xvfb and sweeps window counts.
+//
+// Usage: window_tracker_bench <mode> [windows] [seconds] [changes-per-second]
+// Modes:
+//   subprocess     the xdotool/xprop polling fallback of WindowService,
+//                  every 500 ms
+//   native-list    get_window_list() every 500 ms
+//   native-events  the event-driven tracker (start_window_tracker)
+// Prints one JSON object to stdout.
+
+#define _GNU_SOURCE
+#include "../window_tracker.h"
+
+#include <xcb/xcb.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char** environ;
+
+#define POLL_INTERVAL_MS 500
+#define DESKTOPS 4
+
+enum { MODE_SUBPROCESS, MODE_NATIVE_LIST, MODE_NATIVE_EVENTS };
+
+static const char* mode_names[] = { "subprocess", "native-list", "native-events" };
+
+static struct {
+    int mode;
+    int n_windows;
+    uint32_t* windows;
+    // Send time of each title change, indexed by its sequence number.
+    double* sent_ms;
+    int max_changes;
+    int changes_sent;
+} bench;
+
+// Observer-side results, written from the observer thread or callback.
+static struct {
+    pthread_mutex_t lock;
+    double* latency_ms;
+    char* seen;
+    int changes_seen;
+    long events;
+    long polls;
+    long forks;
+    volatile int stop;
+} observed = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void sleep_ms(double ms) {
+    struct timespec ts = { (time_t)(ms / 1e3), (long)((ms - (time_t)(ms / 1e3) * 1e3) * 1e6) };
+    nanosleep(&ts, NULL);
+}
+
+// Record that the observer saw a title. Titles set by the churn loop are
+// "bench <seq>"; others are ignored.
+static void saw_title(const char* title) {
+    if (!title || strncmp(title, "bench ", 6) != 0) return;
+    int seq = atoi(title + 6);
+    if (seq < 0 || seq >= bench.max_changes) return;
+    double t = now_ms();
+    pthread_mutex_lock(&observed.lock);
+    if (seq < bench.changes_sent && !observed.seen[seq]) {
+        observed.seen[seq] = 1;
+        observed.latency_ms[observed.changes_seen++] = t - bench.sent_ms[seq];
+    }
+    pthread_mutex_unlock(&observed.lock);
+}
+
+// Window manager stand-in
+
+static xcb_atom_t intern(xcb_connection_t* conn, const char* name) {
+    xcb_intern_atom_reply_t* reply =
+        xcb_intern_atom_reply(conn, xcb_intern_atom(conn, 0, strlen(name), name), NULL);
+    xcb_atom_t atom = reply ? reply->atom : XCB_ATOM_NONE;
+    free(reply);
+    return atom;
+}
+
+static struct {
+    xcb_connection_t* conn;
+    xcb_window_t root;
+    xcb_atom_t net_wm_name;
+    xcb_atom_t utf8_string;
+} wm;
+
+static void set_title(uint32_t window, const char* title) {
+    xcb_change_property(wm.conn, XCB_PROP_MODE_REPLACE, window, wm.net_wm_name,
+                        wm.utf8_string, 8, strlen(title), title);
+    xcb_change_property(wm.conn, XCB_PROP_MODE_REPLACE, window, XCB_ATOM_WM_NAME,
+                        XCB_ATOM_STRING, 8, strlen(title), title);
+}
+
+static void set_class(uint32_t window, const char* instance, const char* cls) {
+    char value[128];
+    int len = snprintf(value, sizeof(value), "%s%c%s", instance, '\0', cls) + 1;
+    xcb_change_property(wm.conn, XCB_PROP_MODE_REPLACE, window, XCB_ATOM_WM_CLASS,
+                        XCB_ATOM_STRING, 8, len, value);
+}
+
+static void set_cardinal(uint32_t window, xcb_atom_t property, xcb_atom_t type, uint32_t value) {
+    xcb_change_property(wm.conn, XCB_PROP_MODE_REPLACE, window, property, type, 32, 1, &value);
+}
+
+static int start_window_manager() {
+    int screen_num;
+    wm.conn = xcb_connect(NULL, &screen_num);
+    if (xcb_connection_has_error(wm.conn)) return -1;
+    xcb_screen_t* screen = xcb_setup_roots_iterator(xcb_get_setup(wm.conn)).data;
+    wm.root = screen->root;
+    wm.net_wm_name = intern(wm.conn, "_NET_WM_NAME");
+    wm.utf8_string = intern(wm.conn, "UTF8_STRING");
+
+    xcb_atom_t client_list = intern(wm.conn, "_NET_CLIENT_LIST");
+    xcb_atom_t active = intern(wm.conn, "_NET_ACTIVE_WINDOW");
+    xcb_atom_t current_desktop = intern(wm.conn, "_NET_CURRENT_DESKTOP");
+    xcb_atom_t n_desktops = intern(wm.conn, "_NET_NUMBER_OF_DESKTOPS");
+    xcb_atom_t wm_desktop = intern(wm.conn, "_NET_WM_DESKTOP");
+    xcb_atom_t wm_pid = intern(wm.conn, "_NET_WM_PID");
+    xcb_atom_t supported = intern(wm.conn, "_NET_SUPPORTED");
+    xcb_atom_t supporting = intern(wm.conn, "_NET_SUPPORTING_WM_CHECK");
+
+    // A check window, as a real window manager would publish.
+    uint32_t check = xcb_generate_id(wm.conn);
+    xcb_create_window(wm.conn, XCB_COPY_FROM_PARENT, check, wm.root, -1, -1, 1, 1, 0,
+                      XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual, 0, NULL);
+    set_cardinal(wm.root, supporting, XCB_ATOM_WINDOW, check);
+    set_cardinal(check, supporting, XCB_ATOM_WINDOW, check);
+    set_title(check, "bench-wm");
+    xcb_atom_t supported_atoms[] = {
+        client_list, active, current_desktop, n_desktops, wm_desktop, wm_pid, wm.net_wm_name,
+    };
+    xcb_change_property(wm.conn, XCB_PROP_MODE_REPLACE, wm.root, supported, XCB_ATOM_ATOM, 32,
+                        sizeof(supported_atoms) / sizeof(xcb_atom_t), supported_atoms);
+    set_cardinal(wm.root, n_desktops, XCB_ATOM_CARDINAL, DESKTOPS);
+    set_cardinal(wm.root, current_desktop, XCB_ATOM_CARDINAL, 0);
+
+    bench.windows = malloc(bench.n_windows * sizeof(uint32_t));
+    if (!bench.windows) return -1;
+    for (int i = 0; i < bench.n_windows; i++) {
+        uint32_t w = xcb_generate_id(wm.conn);
+        bench.windows[i] = w;
+        xcb_create_window(wm.conn, XCB_COPY_FROM_PARENT, w, wm.root, (i % 40) * 20,
+                          (i / 40) * 20, 16, 16, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                          screen->root_visual, 0, NULL);
+        char title[32];
+        snprintf(title, sizeof(title), "window %d", i);
+        set_title(w, title);
+        set_class(w, "bench", "Bench");
+        set_cardinal(w, wm_pid, XCB_ATOM_CARDINAL, getpid());
+        set_cardinal(w, wm_desktop, XCB_ATOM_CARDINAL, i % DESKTOPS);
+        xcb_map_window(wm.conn, w);
+    }
+    xcb_change_property(wm.conn, XCB_PROP_MODE_REPLACE, wm.root, client_list, XCB_ATOM_WINDOW,
+                        32, bench.n_windows, bench.windows);
+    set_cardinal(wm.root, active, XCB_ATOM_WINDOW, bench.windows[0]);
+    free(xcb_get_input_focus_reply(wm.conn, xcb_get_input_focus(wm.conn), NULL));
+    return 0;
+}
+
+// Rename windows round-robin at the given rate; every tenth change also
+// switches WM_CLASS.
+static void churn(double seconds, int rate) {
+    double interval = 1e3 / rate;
+    double start = now_ms();
+    double next = start;
+    for (int seq = 0; seq < bench.max_changes && now_ms() - start < seconds * 1e3; seq++) {
+        uint32_t w = bench.windows[seq % bench.n_windows];
+        char title[32];
+        snprintf(title, sizeof(title), "bench %d", seq);
+
+        pthread_mutex_lock(&observed.lock);
+        bench.sent_ms[seq] = now_ms();
+        bench.changes_sent = seq + 1;
+        pthread_mutex_unlock(&observed.lock);
+
+        set_title(w, title);
+        if (seq % 10 == 0) {
+            char instance[32], cls[32];
+            snprintf(instance, sizeof(instance), "bench%d", seq % 7);
+            snprintf(cls, sizeof(cls), "Bench%d", seq % 7);
+            set_class(w, instance, cls);
+        }
+        xcb_flush(wm.conn);
+
+        next += interval;
+        double wait = next - now_ms();
+        if (wait > 0) sleep_ms(wait);
+    }
+}
+
+// Observers
+
+// Run a command and return its stdout (at most size - 1 bytes).
+static int run_command(char* const argv[], char* out, size_t size) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) return -1;
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, pipe_fds[0]);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    pid_t pid;
+    int spawned = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipe_fds[1]);
+    if (spawned != 0) {
+        close(pipe_fds[0]);
+        return -1;
+    }
+    observed.forks++;
+
+    size_t len = 0;
+    ssize_t r;
+    while ((r = read(pipe_fds[0], out + len, size - 1 - len)) > 0) {
+        len += r;
+        if (len == size - 1) break;
+    }
+    out[len] = '\0';
+    close(pipe_fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// One cycle of WindowService._pollWindows() without the native library:
+// list windows with xdotool, then query each one's title and class.
+static void poll_subprocess() {
+    static char ids[1 << 16];
+    char buffer[1024];
+    char* search[] = { "xdotool", "search", "--onlyvisible", "--class", "", NULL };
+    if (run_command(search, ids, sizeof(ids)) != 0) return;
+    char* active[] = { "xdotool", "getactivewindow", NULL };
+    run_command(active, buffer, sizeof(buffer));
+
+    char* save;
+    for (char* id = strtok_r(ids, "\n", &save); id; id = strtok_r(NULL, "\n", &save)) {
+        char* name[] = { "xdotool", "getwindowname", id, NULL };
+        if (run_command(name, buffer, sizeof(buffer)) == 0) {
+            buffer[strcspn(buffer, "\n")] = '\0';
+            saw_title(buffer);
+        }
+        char* wm_class[] = { "xprop", "-id", id, "WM_CLASS", NULL };
+        run_command(wm_class, buffer, sizeof(buffer));
+    }
+}
+
+static void poll_native_list() {
+    window_list* list = get_window_list();
+    if (!list) return;
+    for (int i = 0; i < list->count; i++) saw_title(list->windows[i].title);
+    free_window_list(list);
+}
+
+static void* poll_thread(void* arg) {
+    (void)arg;
+    while (!observed.stop) {
+        double start = now_ms();
+        if (bench.mode == MODE_SUBPROCESS) poll_subprocess();
+        else poll_native_list();
+        observed.polls++;
+        // Like Timer.periodic: the next cycle starts one interval after the
+        // last one started, or right away if it overran.
+        double wait = POLL_INTERVAL_MS - (now_ms() - start);
+        while (wait > 0 && !observed.stop) {
+            sleep_ms(wait < 50 ? wait : 50);
+            wait = POLL_INTERVAL_MS - (now_ms() - start);
+        }
+    }
+    return NULL;
+}
+
+static void on_event(window_event* event) {
+    observed.events++;
+    if (event->type == WINDOW_EVENT_CHANGED) saw_title(event->window.title);
+    free_window_event(event);
+}
+
+// Report
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const double* sorted, int n, int p) {
+    return n ? sorted[(n - 1) * p / 100] : 0;
+}
+
+static double timeval_ms(struct timeval tv) {
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s subprocess|native-list|native-events [windows] [seconds] [rate]\n",
+                argv[0]);
+        return 2;
+    }
+    bench.mode = -1;
+    for (int i = 0; i < 3; i++) {
+        if (strcmp(argv[1], mode_names[i]) == 0) bench.mode = i;
+    }
+    if (bench.mode < 0) {
+        fprintf(stderr, "unknown mode: %s\n", argv[1]);
+        return 2;
+    }
+    bench.n_windows = argc > 2 ? atoi(argv[2]) : 100;
+    double seconds = argc > 3 ? atof(argv[3]) : 5;
+    int rate = argc > 4 ? atoi(argv[4]) : 50;
+    if (bench.n_windows <= 0 || seconds <= 0 || rate <= 0) return 2;
+
+    bench.max_changes = (int)(seconds * rate) + 1;
+    bench.sent_ms = calloc(bench.max_changes, sizeof(double));
+    observed.latency_ms = calloc(bench.max_changes, sizeof(double));
+    observed.seen = calloc(bench.max_changes, 1);
+    if (!bench.sent_ms || !observed.latency_ms || !observed.seen) return 1;
+
+    if (start_window_manager() != 0) {
+        fprintf(stderr, "cannot connect to the X server\n");
+        return 1;
+    }
+
+    // Everything but the churn loop on this thread counts as observer cost.
+    struct rusage self_before, driver_before, children_before;
+    getrusage(RUSAGE_SELF, &self_before);
+    getrusage(RUSAGE_THREAD, &driver_before);
+    getrusage(RUSAGE_CHILDREN, &children_before);
+
+    pthread_t poller;
+    if (bench.mode == MODE_NATIVE_EVENTS) {
+        if (start_window_tracker(on_event) != 0) {
+            fprintf(stderr, "window tracker failed to start\n");
+            return 1;
+        }
+    } else if (pthread_create(&poller, NULL, poll_thread, NULL) != 0) {
+        return 1;
+    }
+
+    churn(seconds, rate);
+    // Give the last changes one more poll cycle to be seen.
+    sleep_ms(2 * POLL_INTERVAL_MS);
+
+    observed.stop = 1;
+    if (bench.mode == MODE_NATIVE_EVENTS) stop_window_tracker();
+    else pthread_join(poller, NULL);
+
+    struct rusage self_after, driver_after, children_after;
+    getrusage(RUSAGE_SELF, &self_after);
+    getrusage(RUSAGE_THREAD, &driver_after);
+    getrusage(RUSAGE_CHILDREN, &children_after);
+
+    double self_cpu = timeval_ms(self_after.ru_utime) + timeval_ms(self_after.ru_stime) -
+                      timeval_ms(self_before.ru_utime) - timeval_ms(self_before.ru_stime);
+    double driver_cpu = timeval_ms(driver_after.ru_utime) + timeval_ms(driver_after.ru_stime) -
+                        timeval_ms(driver_before.ru_utime) - timeval_ms(driver_before.ru_stime);
+    double children_cpu =
+        timeval_ms(children_after.ru_utime) + timeval_ms(children_after.ru_stime) -
+        timeval_ms(children_before.ru_utime) - timeval_ms(children_before.ru_stime);
+    long wakeups = (self_after.ru_nvcsw - self_before.ru_nvcsw) -
+                   (driver_after.ru_nvcsw - driver_before.ru_nvcsw) +
+                   (children_after.ru_nvcsw - children_before.ru_nvcsw);
+
+    int n = observed.changes_seen;
+    qsort(observed.latency_ms, n, sizeof(double), compare_doubles);
+    printf("{\"mode\": \"%s\", \"windows\": %d, \"seconds\": %.1f, \"rate\": %d, "
+           "\"changes_sent\": %d, \"changes_seen\": %d, \"events\": %ld, \"polls\": %ld, "
+           "\"cpu_ms\": %.1f, \"wakeups\": %ld, \"forks\": %ld, "
+           "\"latency_ms\": {\"p50\": %.2f, \"p95\": %.2f, \"p99\": %.2f, \"max\": %.2f}}\n",
+           mode_names[bench.mode], bench.n_windows, seconds, rate, bench.changes_sent, n,
+           observed.events, observed.polls, self_cpu - driver_cpu + children_cpu, wakeups,
+           observed.forks, percentile(observed.latency_ms, n, 50),
+           percentile(observed.latency_ms, n, 95), percentile(observed.latency_ms, n, 99),
+           n ? observed.latency_ms[n - 1] : 0);
+
+    xcb_disconnect(wm.conn);
+    return 0;
+}
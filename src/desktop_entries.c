@@ -0,0 +1,535 @@
+#define _GNU_SOURCE
+#include "desktop_entries.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "app_database.h"
+
+#define MAX_PARSERS 8
+// Subdirectory levels scanned below each application directory.
+#define MAX_DEPTH 8
+
+typedef struct {
+    app_record r;
+    int dir;
+    int parse;   // Changed since the database was written
+    char* file;  // Owned name when r.file is not in the database
+    void* data;  // Mapping of a parsed file
+    size_t size;
+    int missing;  // Not a regular file (yet), e.g. a dangling symlink
+    int shown;
+} file_state;
+
+// An application directory or one of its subdirectories. Each application
+// directory is directly followed by its subdirectories, depth first, so
+// files come in precedence order.
+typedef struct {
+    char* path;
+    size_t root_len;  // Of the application directory's path
+} scan_dir_state;
+
+typedef struct {
+    scan_dir_state* dirs;
+    app_dir* seen;  // As found now, for each of dirs
+    int n_dirs, dirs_cap;
+    file_state* files;
+    int n_files, cap;
+    int dirty;  // The database needs writing
+} load_state;
+
+typedef struct {
+    load_state* load;
+    atomic_int next;
+} parse_job;
+
+// Serializes loads, which share the mapped database.
+static pthread_mutex_t load_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int span_is(text_span s, const char* text) {
+    return s.len == strlen(text) && memcmp(s.start, text, s.len) == 0;
+}
+
+static int same_time(struct timespec a, struct timespec b) {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+// Whether the semicolon-separated list names one of the colon-separated
+// desktops, ignoring case.
+static int lists_desktop(text_span list, const char* desktops) {
+    const char* end = list.start + list.len;
+    for (const char* p = list.start; p < end;) {
+        const char* item_end = memchr(p, ';', end - p);
+        if (!item_end) item_end = end;
+        size_t len = item_end - p;
+        for (const char* d = desktops; len && *d;) {
+            size_t d_len = strcspn(d, ":");
+            if (d_len == len && strncasecmp(d, p, len) == 0) return 1;
+            d += d_len + (d[d_len] == ':');
+        }
+        p = item_end + 1;
+    }
+    return 0;
+}
+
+static int is_shown(const app_record* r, const char* current_desktop) {
+    if (r->flags & (APP_NO_DISPLAY | APP_HIDDEN | APP_NO_ENTRY)) return 0;
+    if (r->only_show_in.len && (!current_desktop || !lists_desktop(r->only_show_in, current_desktop))) {
+        return 0;
+    }
+    return !(r->not_show_in.len && current_desktop && lists_desktop(r->not_show_in, current_desktop));
+}
+
+// Scan the [Desktop Entry] group in place. Keys may have blanks around
+// '='; localized keys (Name[de]) are skipped, as are comments.
+static void parse_entry(file_state* f) {
+    const char* p = f->data;
+    const char* end = p + f->size;
+    app_record* r = &f->r;
+    int in_group = 0;
+    while (p < end) {
+        const char* line_end = memchr(p, '\n', end - p);
+        if (!line_end) line_end = end;
+        const char* line = p;
+        p = line_end + 1;
+        while (line < line_end && (*line == ' ' || *line == '\t')) line++;
+        const char* last = line_end;
+        while (last > line && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r')) last--;
+        if (line == last || *line == '#') continue;
+
+        if (*line == '[') {
+            // Only the first group counts, and it has to be this one.
+            if (in_group) break;
+            in_group = span_is((text_span){ line, last - line }, "[Desktop Entry]");
+            if (!in_group) break;
+            continue;
+        }
+        if (!in_group) continue;
+
+        const char* eq = memchr(line, '=', last - line);
+        if (!eq) continue;
+        const char* key_end = eq;
+        while (key_end > line && (key_end[-1] == ' ' || key_end[-1] == '\t')) key_end--;
+        const char* value = eq + 1;
+        while (value < last && (*value == ' ' || *value == '\t')) value++;
+        text_span key = { line, key_end - line };
+        text_span v = { value, last - value };
+
+        if (span_is(key, "Name")) r->name = v;
+        else if (span_is(key, "Exec")) r->exec = v;
+        else if (span_is(key, "Icon")) r->icon = v;
+        else if (span_is(key, "StartupWMClass")) r->wm_class = v;
+        else if (span_is(key, "OnlyShowIn")) r->only_show_in = v;
+        else if (span_is(key, "NotShowIn")) r->not_show_in = v;
+        else if (span_is(key, "NoDisplay") && span_is(v, "true")) r->flags |= APP_NO_DISPLAY;
+        else if (span_is(key, "Hidden") && span_is(v, "true")) r->flags |= APP_HIDDEN;
+    }
+    if (!in_group || !r->name.len || !r->exec.len) r->flags |= APP_NO_ENTRY;
+}
+
+static void parse_file(load_state* s, file_state* f) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", s->dirs[f->dir].path, f->r.file);
+    f->r.flags = APP_NO_ENTRY;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        // Record what was actually read.
+        f->r.ino = st.st_ino;
+        f->r.mtime = st.st_mtim;
+        f->r.size = st.st_size;
+        if (S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                f->data = data;
+                f->size = st.st_size;
+            }
+        }
+    }
+    close(fd);
+    if (f->data) {
+        f->r.flags = 0;
+        parse_entry(f);
+    }
+}
+
+static void* parser_main(void* data) {
+    parse_job* job = data;
+    int i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->load->n_files) {
+        if (job->load->files[i].parse) parse_file(job->load, &job->load->files[i]);
+    }
+    return NULL;
+}
+
+// Parse the changed files on up to MAX_PARSERS threads. Files are handed
+// out one at a time, so a slow one holds up nobody.
+static void parse_changed(load_state* s, int n_changed) {
+    parse_job job = { s, 0 };
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int n_threads = cpus > 1 ? (int)cpus : 1;
+    if (n_threads > MAX_PARSERS) n_threads = MAX_PARSERS;
+    if (n_threads > n_changed / 16) n_threads = n_changed / 16;
+    pthread_t threads[MAX_PARSERS];
+    int started = 0;
+    while (started < n_threads && pthread_create(&threads[started], NULL, parser_main, &job) == 0) {
+        started++;
+    }
+    parser_main(&job);
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int is_subdir(DIR* d, const struct dirent* e) {
+    if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) return 0;
+    if (e->d_type == DT_DIR) return 1;
+    if (e->d_type != DT_LNK && e->d_type != DT_UNKNOWN) return 0;
+    struct stat st;
+    return fstatat(dirfd(d), e->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+}
+
+// The .desktop files and subdirectories in dir, sorted and malloc'd; NULL
+// if there are none.
+static char** list_dir(const char* dir, int* n) {
+    *n = 0;
+    DIR* d = opendir(dir);
+    if (!d) return NULL;
+    char** names = NULL;
+    int cap = 0;
+    struct dirent* e;
+    while ((e = readdir(d))) {
+        size_t len = strlen(e->d_name);
+        int desktop = len > 8 && strcmp(e->d_name + len - 8, ".desktop") == 0;
+        if (!desktop && !is_subdir(d, e)) continue;
+        if (*n == cap) {
+            cap = cap ? cap * 2 : 64;
+            char** grown = realloc(names, cap * sizeof(char*));
+            if (!grown) break;
+            names = grown;
+        }
+        if ((names[*n] = strdup(e->d_name))) (*n)++;
+    }
+    closedir(d);
+    if (names) qsort(names, *n, sizeof(char*), compare_names);
+    return names;
+}
+
+// The database record for file among the count records from first, which
+// are sorted by name, or -1.
+static int find_record(int first, int count, const char* file) {
+    int lo = first, hi = first + count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        app_record r;
+        app_database_record(mid, &r);
+        int c = strcmp(r.file, file);
+        if (c == 0) return mid;
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return -1;
+}
+
+static file_state* push_file(load_state* s) {
+    if (s->n_files == s->cap) {
+        int cap = s->cap ? s->cap * 2 : 256;
+        file_state* grown = realloc(s->files, cap * sizeof(file_state));
+        if (!grown) return NULL;
+        s->files = grown;
+        s->cap = cap;
+    }
+    file_state* f = &s->files[s->n_files++];
+    memset(f, 0, sizeof(*f));
+    return f;
+}
+
+// Add a directory to scan. Returns its index, or -1 if memory ran out.
+static int add_dir(load_state* s, const char* path, size_t root_len) {
+    if (s->n_dirs == s->dirs_cap) {
+        int cap = s->dirs_cap ? s->dirs_cap * 2 : 16;
+        scan_dir_state* dirs = realloc(s->dirs, cap * sizeof(scan_dir_state));
+        if (dirs) s->dirs = dirs;
+        app_dir* seen = realloc(s->seen, cap * sizeof(app_dir));
+        if (seen) s->seen = seen;
+        if (!dirs || !seen) return -1;
+        s->dirs_cap = cap;
+    }
+    char* copy = strdup(path);
+    if (!copy) return -1;
+    s->dirs[s->n_dirs] = (scan_dir_state){ copy, root_len };
+    return s->n_dirs++;
+}
+
+// A directory being scanned and those above it.
+typedef struct dir_chain {
+    dev_t dev;
+    ino_t ino;
+    const struct dir_chain* up;
+} dir_chain;
+
+static int on_chain(const dir_chain* c, const struct stat* st) {
+    for (; c; c = c->up) {
+        if (c->dev == st->st_dev && c->ino == st->st_ino) return 1;
+    }
+    return 0;
+}
+
+// Collect directory dir's files, taking each from the database if its
+// (inode, mtime, size) still match and marking it for parsing otherwise,
+// then those of its subdirectories. The directory is listed only if its
+// mtime changed; subdirectories are recorded too (flagged APP_SUBDIR), so
+// an unchanged one is found without listing its parent. Symlinks back to
+// a directory above are not followed. up is the chain of the directories
+// above, depth its length.
+static int scan_dir(load_state* s, int dir, const dir_chain* up, int depth) {
+    const char* path = s->dirs[dir].path;
+    struct stat st;
+    app_dir* seen = &s->seen[dir];
+    *seen = (app_dir){ path, stat(path, &st) == 0 && S_ISDIR(st.st_mode), { 0, 0 } };
+    if (seen->exists) seen->mtime = st.st_mtim;
+
+    app_dir known;
+    int first = 0, count = 0;
+    int recorded = app_database_find_dir(path, &known, &first, &count);
+    int current = recorded && known.exists == seen->exists && same_time(known.mtime, seen->mtime);
+    if (!current) s->dirty = 1;
+    if (!seen->exists) return 0;
+    dir_chain here = { st.st_dev, st.st_ino, up };
+
+    int n_names = 0;
+    char** names = NULL;
+    if (current) n_names = count;
+    else names = list_dir(path, &n_names);
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int n_changed = 0;
+    int first_file = s->n_files;
+    for (int i = 0; i < n_names && fd >= 0; i++) {
+        app_record r = { 0 };
+        int index = current ? first + i : recorded ? find_record(first, count, names[i]) : -1;
+        if (index >= 0) app_database_record(index, &r);
+        const char* file = current ? r.file : names[i];
+        file_state* f = push_file(s);
+        if (!f) break;
+        f->dir = dir;
+        // Follows symlinks, like the packaging exports that use them. Files
+        // that are not there are recorded without a stamp, so the next load
+        // looks at them again even while the directory stays unchanged: an
+        // export symlink may dangle until its target is installed.
+        int found = fstatat(fd, file, &st, 0) == 0;
+        if (found && S_ISDIR(st.st_mode)) {
+            // Neither shown nor hiding anything; scanned below.
+            f->missing = 1;
+            if (index >= 0 && (r.flags & APP_SUBDIR)) {
+                f->r = r;
+                continue;
+            }
+            f->r.file = f->file = strdup(file);
+            if (!f->file) {
+                s->n_files--;
+                continue;
+            }
+            f->r.flags = APP_SUBDIR;
+            s->dirty = 1;
+            continue;
+        }
+        if (!found || !S_ISREG(st.st_mode)) {
+            f->missing = 1;
+            if (index >= 0 && r.ino == 0 && (r.flags & APP_NO_ENTRY)) {
+                f->r = r;
+                continue;
+            }
+            f->r.file = f->file = strdup(file);
+            if (!f->file) {
+                s->n_files--;
+                continue;
+            }
+            f->r.flags = APP_NO_ENTRY;
+            s->dirty = 1;
+            continue;
+        }
+        if (index >= 0 && r.ino == st.st_ino && same_time(r.mtime, st.st_mtim) && r.size == st.st_size) {
+            f->r = r;
+            continue;
+        }
+        f->r.file = f->file = strdup(file);
+        if (!f->file) {
+            s->n_files--;
+            continue;
+        }
+        f->parse = 1;
+        n_changed++;
+        s->dirty = 1;
+    }
+    if (fd >= 0) close(fd);
+    for (int i = 0; names && i < n_names; i++) free(names[i]);
+    free(names);
+
+    for (int i = first_file, last = s->n_files; i < last && depth < MAX_DEPTH; i++) {
+        if (!(s->files[i].r.flags & APP_SUBDIR)) continue;
+        char sub[PATH_MAX];
+        snprintf(sub, sizeof(sub), "%s/%s", s->dirs[dir].path, s->files[i].r.file);
+        if (stat(sub, &st) != 0 || on_chain(&here, &st)) continue;
+        int child = add_dir(s, sub, s->dirs[dir].root_len);
+        if (child >= 0) n_changed += scan_dir(s, child, &here, depth + 1);
+    }
+    return n_changed;
+}
+
+static uint32_t hash_string(const char* s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+// f's desktop file ID: its path below the application directory with '/'
+// turned into '-', so kde4/kate.desktop is kde4-kate.desktop.
+static void desktop_id(const load_state* s, const file_state* f, char* out, size_t size) {
+    const char* sub = s->dirs[f->dir].path + s->dirs[f->dir].root_len;
+    if (*sub == '/') sub++;
+    snprintf(out, size, "%s%s%s", sub, *sub ? "/" : "", f->r.file);
+    for (char* p = out; *p; p++) {
+        if (*p == '/') *p = '-';
+    }
+}
+
+// Clear shown on every file whose desktop file ID an earlier file already
+// has, using an open-addressed table of file indexes (-1 = empty).
+static void drop_shadowed(load_state* s) {
+    size_t mask = 63;
+    while (mask < (size_t)s->n_files * 2) mask = mask * 2 + 1;
+    int* slots = malloc((mask + 1) * sizeof(int));
+    if (!slots) return;
+    memset(slots, 0xff, (mask + 1) * sizeof(int));
+    for (int i = 0; i < s->n_files; i++) {
+        file_state* f = &s->files[i];
+        if (!f->shown) continue;
+        char id[PATH_MAX], other[PATH_MAX];
+        desktop_id(s, f, id, sizeof(id));
+        size_t slot = hash_string(id) & mask;
+        for (; slots[slot] >= 0; slot = (slot + 1) & mask) {
+            desktop_id(s, &s->files[slots[slot]], other, sizeof(other));
+            if (strcmp(other, id) == 0) {
+                f->shown = 0;
+                break;
+            }
+        }
+        if (f->shown) slots[slot] = i;
+    }
+    free(slots);
+}
+
+static char* put_span(char** strings, text_span s) {
+    char* out = *strings;
+    memcpy(out, s.start, s.len);
+    out[s.len] = '\0';
+    *strings += s.len + 1;
+    return out;
+}
+
+static desktop_entry_list* build_list(load_state* s, const char* current_desktop) {
+    // The first file of each ID decides, even when it hides the app: that
+    // is how a user's copy with Hidden=true removes a system one.
+    // Missing files hide nothing.
+    for (int i = 0; i < s->n_files; i++) s->files[i].shown = !s->files[i].missing;
+    drop_shadowed(s);
+    for (int i = 0; i < s->n_files; i++) {
+        if (s->files[i].shown) s->files[i].shown = is_shown(&s->files[i].r, current_desktop);
+    }
+    // Size the result exactly.
+    int count = 0;
+    size_t bytes = 0;
+    for (int i = 0; i < s->n_files; i++) {
+        file_state* f = &s->files[i];
+        if (!f->shown) continue;
+        count++;
+        bytes += f->r.name.len + f->r.exec.len + strlen(s->dirs[f->dir].path) + strlen(f->r.file) + 4;
+        if (f->r.icon.len) bytes += f->r.icon.len + 1;
+        if (f->r.wm_class.len) bytes += f->r.wm_class.len + 1;
+    }
+
+    desktop_entry_list* list =
+        malloc(sizeof(desktop_entry_list) + count * sizeof(desktop_entry_record) + bytes);
+    if (!list) return NULL;
+    list->count = count;
+    list->entries = (desktop_entry_record*)(list + 1);
+    char* strings = (char*)(list->entries + count);
+    int n = 0;
+    for (int i = 0; i < s->n_files; i++) {
+        file_state* f = &s->files[i];
+        if (!f->shown) continue;
+        desktop_entry_record* r = &list->entries[n++];
+        r->name = put_span(&strings, f->r.name);
+        r->exec = put_span(&strings, f->r.exec);
+        r->icon = f->r.icon.len ? put_span(&strings, f->r.icon) : NULL;
+        r->path = strings;
+        strings += sprintf(strings, "%s/%s", s->dirs[f->dir].path, f->r.file) + 1;
+        r->wm_class = f->r.wm_class.len ? put_span(&strings, f->r.wm_class) : NULL;
+    }
+    return list;
+}
+
+static void save_database(load_state* s) {
+    app_record* records = malloc(s->n_files * sizeof(app_record) + 1);
+    int* record_dirs = malloc(s->n_files * sizeof(int) + 1);
+    if (records && record_dirs) {
+        for (int i = 0; i < s->n_files; i++) {
+            records[i] = s->files[i].r;
+            record_dirs[i] = s->files[i].dir;
+        }
+        app_database_save(s->seen, s->n_dirs, records, record_dirs, s->n_files);
+    }
+    free(records);
+    free(record_dirs);
+}
+
+desktop_entry_list* load_desktop_entries(const char* const* dirs, int32_t n_dirs,
+                                         const char* current_desktop) {
+    if (current_desktop && !*current_desktop) current_desktop = NULL;
+    load_state s = { 0 };
+
+    pthread_mutex_lock(&load_lock);
+    app_database_open();
+    int n_changed = 0;
+    for (int32_t i = 0; i < n_dirs; i++) {
+        if (!dirs[i] || !*dirs[i]) continue;
+        int dir = add_dir(&s, dirs[i], strlen(dirs[i]));
+        if (dir >= 0) n_changed += scan_dir(&s, dir, NULL, 0);
+    }
+    if (n_changed) parse_changed(&s, n_changed);
+
+    desktop_entry_list* list = build_list(&s, current_desktop);
+    // Parsed strings point into the file mappings and unchanged ones into
+    // the database mapping, so write before unmapping either.
+    if (s.dirty) save_database(&s);
+    app_database_close();
+    pthread_mutex_unlock(&load_lock);
+
+    for (int i = 0; i < s.n_files; i++) {
+        if (s.files[i].data) munmap(s.files[i].data, s.files[i].size);
+        free(s.files[i].file);
+    }
+    free(s.files);
+    for (int i = 0; i < s.n_dirs; i++) free(s.dirs[i].path);
+    free(s.dirs);
+    free(s.seen);
+    return list;
+}
+
+void free_desktop_entries(desktop_entry_list* list) {
+    free(list);
+}
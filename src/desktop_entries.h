@@ -0,0 +1,67 @@
+#ifndef DESKTOP_ENTRIES_H
+#define DESKTOP_ENTRIES_H
+
+#include <stdint.h>
+
+// One application from a .desktop file. Strings are the raw values of the
+// [Desktop Entry] group's Name, Exec and Icon keys; icon is NULL if the
+// entry has none.
+typedef struct {
+    const char* name;
+    const char* exec;
+    const char* icon;
+    const char* path;      // The .desktop file
+    const char* wm_class;  // StartupWMClass, NULL if none
+} desktop_entry_record;
+
+// Records and strings live in the same allocation; release it with
+// free_desktop_entries().
+typedef struct {
+    int32_t count;
+    desktop_entry_record* entries;
+} desktop_entry_list;
+
+// Load every *.desktop file in the n_dirs directories and their
+// subdirectories, given in precedence order. Files unchanged since the
+// last load come from the application database in
+// $XDG_CACHE_HOME/vaxp/apps.db; the others are parsed on several threads,
+// each mapped and only its [Desktop Entry] group scanned, in place. Of the
+// files sharing a desktop file ID (the path below the directory with '/'
+// as '-', e.g. kde4-kate.desktop) only the first counts, and it may hide
+// the application. Entries without Name or Exec, with NoDisplay=true or
+// Hidden=true, or hidden from current_desktop (a colon-separated
+// XDG_CURRENT_DESKTOP value, may be NULL) by OnlyShowIn/NotShowIn are left
+// out. Returns NULL on allocation failure.
+desktop_entry_list* load_desktop_entries(const char* const* dirs, int32_t n_dirs,
+                                         const char* current_desktop);
+void free_desktop_entries(desktop_entry_list* list);
+
+#define DESKTOP_ENTRY_ADDED 0
+#define DESKTOP_ENTRY_UPDATED 1
+#define DESKTOP_ENTRY_REMOVED 2
+
+// Entries that changed, each with one of DESKTOP_ENTRY_* in changes.
+// Entries are identified by path; removed ones carry their last values.
+// One allocation, released with free_desktop_entry_diff().
+typedef struct {
+    int32_t count;
+    desktop_entry_record* entries;
+    int32_t* changes;
+} desktop_entry_diff;
+
+// Called from the watcher thread; the callee frees diff.
+typedef void (*desktop_entry_diff_callback)(desktop_entry_diff* diff);
+
+// Load the entries as load_desktop_entries() does and follow the
+// directories with inotify, replacing any earlier watch. callback gets every
+// entry as added first, then, once each burst of changes (a package
+// manager transaction, say) has been quiet for a moment, what was added,
+// updated or removed since. Only changed files are parsed again. Returns 0,
+// or -1 if inotify is unavailable.
+int watch_desktop_entries(const char* const* dirs, int32_t n_dirs, const char* current_desktop,
+                          desktop_entry_diff_callback callback);
+// No callback runs once this returns.
+void unwatch_desktop_entries();
+void free_desktop_entry_diff(desktop_entry_diff* diff);
+
+#endif
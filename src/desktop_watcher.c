@@ -0,0 +1,408 @@
+#define _GNU_SOURCE
+#include "desktop_entries.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <libgen.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// A burst of changes is applied once it has been quiet for QUIET_MS, or
+// MAX_DELAY_MS after it began if it keeps going.
+#define QUIET_MS 300
+#define MAX_DELAY_MS 2000
+#define DIR_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | \
+                  IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#define PARENT_MASK (IN_CREATE | IN_MOVED_TO | IN_ONLYDIR | IN_MASK_ADD)
+// Subdirectory levels watched, as many as desktop_entries.c scans.
+#define MAX_DEPTH 8
+
+typedef struct {
+    int wd;
+    // For the parent of a missing application directory: the directory's
+    // name, whose appearance is all that matters. NULL otherwise.
+    char* child;
+} dir_watch;
+
+static struct {
+    pthread_mutex_t lock;
+    int inotify_fd;  // -1 until the first watch
+    int wake_fd;     // Signalled when the watch was replaced
+    char** dirs;
+    int n_dirs;
+    char* current_desktop;
+    desktop_entry_diff_callback callback;
+    int reset;  // Report every entry as added on the next refresh
+    dir_watch* watches;
+    int n_watches, watches_cap;
+    desktop_entry_list* entries;  // As last reported
+} watcher = { .lock = PTHREAD_MUTEX_INITIALIZER, .inotify_fd = -1, .wake_fd = -1 };
+
+static int64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void remember_watch(int wd, const char* child) {
+    for (int i = 0; i < watcher.n_watches; i++) {
+        const dir_watch* w = &watcher.watches[i];
+        if (w->wd == wd && (w->child ? child && strcmp(w->child, child) == 0 : !child)) return;
+    }
+    if (watcher.n_watches == watcher.watches_cap) {
+        int cap = watcher.watches_cap ? watcher.watches_cap * 2 : 16;
+        dir_watch* grown = realloc(watcher.watches, cap * sizeof(dir_watch));
+        if (!grown) return;
+        watcher.watches = grown;
+        watcher.watches_cap = cap;
+    }
+    char* copy = child ? strdup(child) : NULL;
+    if (child && !copy) return;
+    watcher.watches[watcher.n_watches++] = (dir_watch){ wd, copy };
+}
+
+// A directory being watched and those above it.
+typedef struct dir_chain {
+    dev_t dev;
+    ino_t ino;
+    const struct dir_chain* up;
+} dir_chain;
+
+// Watch dir and its subdirectories, except symlinks back to a directory in
+// up, the chain of those above (depth long). Returns -1 with errno set if
+// dir itself cannot be watched. Call with watcher.lock held.
+static int watch_tree(const char* dir, const dir_chain* up, int depth) {
+    int wd = inotify_add_watch(watcher.inotify_fd, dir, DIR_MASK);
+    if (wd < 0) return -1;
+    remember_watch(wd, NULL);
+    struct stat st;
+    DIR* d = depth < MAX_DEPTH && stat(dir, &st) == 0 ? opendir(dir) : NULL;
+    if (!d) return 0;
+    dir_chain here = { st.st_dev, st.st_ino, up };
+    struct dirent* e;
+    while ((e = readdir(d))) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        if (e->d_type != DT_DIR && e->d_type != DT_LNK && e->d_type != DT_UNKNOWN) continue;
+        if (fstatat(dirfd(d), e->d_name, &st, 0) != 0 || !S_ISDIR(st.st_mode)) continue;
+        const dir_chain* c = &here;
+        while (c && (c->dev != st.st_dev || c->ino != st.st_ino)) c = c->up;
+        if (c) continue;
+        char sub[PATH_MAX];
+        snprintf(sub, sizeof(sub), "%s/%s", dir, e->d_name);
+        watch_tree(sub, &here, depth + 1);
+    }
+    closedir(d);
+    return 0;
+}
+
+// Watch each application directory with its subdirectories, or the parent
+// of one that does not exist yet. Adding a watch again is harmless, so this
+// runs on every refresh to pick up directories that appeared. Call with
+// watcher.lock held.
+static void add_watches() {
+    for (int i = 0; i < watcher.n_dirs; i++) {
+        const char* dir = watcher.dirs[i];
+        if (!*dir) continue;
+        if (watch_tree(dir, NULL, 0) == 0) continue;
+        if (errno != ENOENT) continue;
+        char parent[PATH_MAX], child[PATH_MAX];
+        snprintf(parent, sizeof(parent), "%s", dir);
+        snprintf(child, sizeof(child), "%s", dir);
+        int wd = inotify_add_watch(watcher.inotify_fd, dirname(parent), PARENT_MASK);
+        if (wd >= 0) remember_watch(wd, basename(child));
+    }
+}
+
+// Call with watcher.lock held.
+static void remove_watches() {
+    for (int i = 0; i < watcher.n_watches; i++) {
+        inotify_rm_watch(watcher.inotify_fd, watcher.watches[i].wd);
+        free(watcher.watches[i].child);
+    }
+    watcher.n_watches = 0;
+}
+
+static int is_desktop_file(const char* name) {
+    size_t len = strlen(name);
+    return len > 8 && strcmp(name + len - 8, ".desktop") == 0;
+}
+
+// Whether e may have changed the entries: a .desktop file, a subdirectory
+// or a watched directory itself changed, or a missing directory appeared.
+static int is_relevant(const struct inotify_event* e) {
+    if (e->mask & IN_Q_OVERFLOW) return 1;
+    if (e->mask & IN_IGNORED) return 0;
+    int relevant = 0;
+    pthread_mutex_lock(&watcher.lock);
+    for (int i = 0; i < watcher.n_watches && !relevant; i++) {
+        const dir_watch* w = &watcher.watches[i];
+        if (w->wd != e->wd) continue;
+        if (w->child) relevant = e->len && strcmp(e->name, w->child) == 0;
+        else relevant = (e->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_ISDIR)) ||
+                        (e->len && is_desktop_file(e->name));
+    }
+    pthread_mutex_unlock(&watcher.lock);
+    return relevant;
+}
+
+static int same_string(const char* a, const char* b) {
+    return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+static int same_entry(const desktop_entry_record* a, const desktop_entry_record* b) {
+    return strcmp(a->name, b->name) == 0 && strcmp(a->exec, b->exec) == 0 &&
+           same_string(a->icon, b->icon) && same_string(a->wm_class, b->wm_class);
+}
+
+static int compare_paths(const void* a, const void* b) {
+    return strcmp((*(desktop_entry_record* const*)a)->path,
+                  (*(desktop_entry_record* const*)b)->path);
+}
+
+static size_t optional_len(const char* s) {
+    return s ? strlen(s) + 1 : 0;
+}
+
+static const char* copy_string(char** strings, const char* s) {
+    if (!s) return NULL;
+    char* out = *strings;
+    size_t len = strlen(s) + 1;
+    memcpy(out, s, len);
+    *strings += len;
+    return out;
+}
+
+// The entries added, updated or removed from old to new, both sorted by
+// path; every entry of new when old is NULL.
+static desktop_entry_diff* make_diff(desktop_entry_record** old, int n_old,
+                                     desktop_entry_record** new, int n_new) {
+    desktop_entry_record** changed = malloc((n_old + n_new + 1) * sizeof(*changed));
+    int32_t* kinds = malloc((n_old + n_new + 1) * sizeof(int32_t));
+    desktop_entry_diff* diff = NULL;
+    if (!changed || !kinds) goto out;
+
+    int count = 0;
+    size_t bytes = 0;
+    for (int i = 0, j = 0; i < n_old || j < n_new;) {
+        int c = i == n_old ? 1 : j == n_new ? -1 : strcmp(old[i]->path, new[j]->path);
+        desktop_entry_record* r;
+        int kind;
+        if (c < 0) {
+            r = old[i++];
+            kind = DESKTOP_ENTRY_REMOVED;
+        } else if (c > 0) {
+            r = new[j++];
+            kind = DESKTOP_ENTRY_ADDED;
+        } else {
+            r = new[j++];
+            kind = DESKTOP_ENTRY_UPDATED;
+            if (same_entry(old[i++], r)) continue;
+        }
+        changed[count] = r;
+        kinds[count++] = kind;
+        bytes += strlen(r->name) + strlen(r->exec) + strlen(r->path) + 3 + optional_len(r->icon) +
+                 optional_len(r->wm_class);
+    }
+
+    diff = malloc(sizeof(desktop_entry_diff) + count * (sizeof(desktop_entry_record) + sizeof(int32_t)) +
+                  bytes);
+    if (!diff) goto out;
+    diff->count = count;
+    diff->entries = (desktop_entry_record*)(diff + 1);
+    diff->changes = (int32_t*)(diff->entries + count);
+    char* strings = (char*)(diff->changes + count);
+    for (int i = 0; i < count; i++) {
+        desktop_entry_record* r = &diff->entries[i];
+        r->name = copy_string(&strings, changed[i]->name);
+        r->exec = copy_string(&strings, changed[i]->exec);
+        r->icon = copy_string(&strings, changed[i]->icon);
+        r->path = copy_string(&strings, changed[i]->path);
+        r->wm_class = copy_string(&strings, changed[i]->wm_class);
+        diff->changes[i] = kinds[i];
+    }
+out:
+    free(changed);
+    free(kinds);
+    return diff;
+}
+
+// Pointers to list's entries, sorted by path. NULL for a NULL list.
+static desktop_entry_record** by_path(desktop_entry_list* list) {
+    if (!list) return NULL;
+    desktop_entry_record** sorted = malloc((list->count + 1) * sizeof(*sorted));
+    if (!sorted) return NULL;
+    for (int i = 0; i < list->count; i++) sorted[i] = &list->entries[i];
+    qsort(sorted, list->count, sizeof(*sorted), compare_paths);
+    return sorted;
+}
+
+// Load the entries again and report the difference to the last report.
+// The application database keeps this to a stat per file plus parsing the
+// changed ones. Returns -1 if that failed for lack of memory and should be
+// retried.
+static int refresh() {
+    pthread_mutex_lock(&watcher.lock);
+    if (!watcher.callback) {
+        pthread_mutex_unlock(&watcher.lock);
+        return 0;
+    }
+    if (watcher.reset) {
+        free_desktop_entries(watcher.entries);
+        watcher.entries = NULL;
+    }
+    add_watches();
+    desktop_entry_list* entries = load_desktop_entries((const char* const*)watcher.dirs,
+                                                       watcher.n_dirs, watcher.current_desktop);
+    desktop_entry_record** old = by_path(watcher.entries);
+    desktop_entry_record** new = by_path(entries);
+    desktop_entry_diff* diff = NULL;
+    if (new && (old || !watcher.entries)) {
+        diff = make_diff(old, old ? watcher.entries->count : 0, new, entries->count);
+    }
+    int failed = !diff;
+    if (diff && (diff->count || watcher.reset)) {
+        free_desktop_entries(watcher.entries);
+        watcher.entries = entries;
+        entries = NULL;
+        watcher.reset = 0;
+        watcher.callback(diff);
+    } else if (!diff && watcher.reset && (diff = calloc(1, sizeof(desktop_entry_diff)))) {
+        // The first report is never left out, or the caller would wait for
+        // it forever: it comes empty, and the retry reports everything.
+        watcher.callback(diff);
+    } else {
+        free(diff);
+    }
+    free(old);
+    free(new);
+    free_desktop_entries(entries);
+    pthread_mutex_unlock(&watcher.lock);
+    return failed ? -1 : 0;
+}
+
+// Waits for inotify events for the life of the process, collecting bursts
+// of relevant ones before refreshing, and refreshes right away when the
+// watch was replaced.
+static void* watch_main(void* data) {
+    (void)data;
+    struct pollfd fds[2] = { { watcher.inotify_fd, POLLIN, 0 }, { watcher.wake_fd, POLLIN, 0 } };
+    int64_t first = 0, last = 0;  // Of the pending burst, 0 if none
+    for (;;) {
+        int timeout = -1;
+        if (first) {
+            int64_t deadline = last + QUIET_MS < first + MAX_DELAY_MS ? last + QUIET_MS
+                                                                       : first + MAX_DELAY_MS;
+            int64_t left = deadline - now_ms();
+            timeout = left > 0 ? (int)left : 0;
+        }
+        int ready = poll(fds, 2, timeout);
+        if (ready < 0 && errno != EINTR) break;
+        if (ready > 0 && (fds[1].revents & POLLIN)) {
+            uint64_t n;
+            if (read(watcher.wake_fd, &n, sizeof(n)) > 0) {
+                first = last = 0;
+                // Failures are retried like a burst of changes.
+                if (refresh() != 0) first = last = now_ms();
+            }
+        }
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            ssize_t n = read(watcher.inotify_fd, buf, sizeof(buf));
+            for (ssize_t offset = 0; offset < n;) {
+                const struct inotify_event* e = (const struct inotify_event*)(buf + offset);
+                offset += sizeof(struct inotify_event) + e->len;
+                if (!is_relevant(e)) continue;
+                last = now_ms();
+                if (!first) first = last;
+            }
+        }
+        int64_t now = now_ms();
+        if (first && (now >= last + QUIET_MS || now >= first + MAX_DELAY_MS)) {
+            first = last = 0;
+            if (refresh() != 0) first = last = now_ms();
+        }
+    }
+    return NULL;
+}
+
+// Start the watcher thread. Call with watcher.lock held.
+static int start_watcher() {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    int wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0 || wake < 0) goto fail;
+    watcher.inotify_fd = fd;
+    watcher.wake_fd = wake;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int failed = pthread_create(&thread, &attr, watch_main, NULL);
+    pthread_attr_destroy(&attr);
+    if (!failed) return 0;
+    watcher.inotify_fd = watcher.wake_fd = -1;
+fail:
+    if (fd >= 0) close(fd);
+    if (wake >= 0) close(wake);
+    fprintf(stderr, "desktop entries: cannot watch the application directories\n");
+    return -1;
+}
+
+static void clear_dirs() {
+    for (int i = 0; i < watcher.n_dirs; i++) free(watcher.dirs[i]);
+    free(watcher.dirs);
+    free(watcher.current_desktop);
+    watcher.dirs = NULL;
+    watcher.n_dirs = 0;
+    watcher.current_desktop = NULL;
+}
+
+int watch_desktop_entries(const char* const* dirs, int32_t n_dirs, const char* current_desktop,
+                          desktop_entry_diff_callback callback) {
+    pthread_mutex_lock(&watcher.lock);
+    if (watcher.inotify_fd < 0 && start_watcher() != 0) {
+        pthread_mutex_unlock(&watcher.lock);
+        return -1;
+    }
+    remove_watches();
+    clear_dirs();
+    watcher.dirs = calloc(n_dirs + 1, sizeof(char*));
+    for (int32_t i = 0; watcher.dirs && i < n_dirs; i++) {
+        if ((watcher.dirs[watcher.n_dirs] = strdup(dirs[i] ? dirs[i] : ""))) watcher.n_dirs++;
+    }
+    watcher.current_desktop = current_desktop ? strdup(current_desktop) : NULL;
+    watcher.callback = callback;
+    watcher.reset = 1;
+    pthread_mutex_unlock(&watcher.lock);
+
+    uint64_t one = 1;
+    if (write(watcher.wake_fd, &one, sizeof(one)) < 0) {
+        // Nothing would ever be reported.
+        unwatch_desktop_entries();
+        return -1;
+    }
+    return 0;
+}
+
+void unwatch_desktop_entries() {
+    pthread_mutex_lock(&watcher.lock);
+    watcher.callback = NULL;
+    remove_watches();
+    clear_dirs();
+    free_desktop_entries(watcher.entries);
+    watcher.entries = NULL;
+    pthread_mutex_unlock(&watcher.lock);
+}
+
+void free_desktop_entry_diff(desktop_entry_diff* diff) {
+    free(diff);
+}
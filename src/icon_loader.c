@@ -1,5 +1,10 @@
+#include "icon_loader.h"
+#include "icon_theme.h"
+#include "icon_worker.h"
+
 #include <gtk/gtk.h>
 #include <gdk/gdk.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -25,7 +30,264 @@ char* get_icon_path(const char* icon_name, int size) {
     return result;
 }
 
+char* find_icon_path(const char* icon_name, int size, int scale) {
+    char* path = icon_theme_lookup(icon_name, size, scale);
+    icon_theme_save_cache_later();
+    return path;
+}
+
+void set_icon_theme(const char* theme) {
+    icon_theme_set_name(theme);
+}
+
+char* get_icon_theme() {
+    return icon_theme_name();
+}
+
+// Theme tracking. GtkSettings (or GSettings without a display) is read and
+// watched on the GTK main thread; the callback may be called from there.
+static struct {
+    pthread_mutex_t lock;
+    icon_theme_callback callback;
+    int connected;
+    GtkSettings* settings;
+    GSettings* gsettings;
+    gulong handler;
+} theme_watch = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void apply_theme_name(char* name) {
+    if (!name || !*name || strcmp(name, "default") == 0) {
+        g_free(name);
+        return;
+    }
+    if (icon_theme_set_name(name)) {
+        pthread_mutex_lock(&theme_watch.lock);
+        if (theme_watch.callback) theme_watch.callback(strdup(name));
+        pthread_mutex_unlock(&theme_watch.lock);
+    }
+    g_free(name);
+}
+
+static void on_gtk_theme_changed(GObject* settings, GParamSpec* pspec, gpointer data) {
+    (void)pspec;
+    (void)data;
+    char* name = NULL;
+    g_object_get(settings, "gtk-icon-theme-name", &name, NULL);
+    apply_theme_name(name);
+}
+
+static void on_gsettings_theme_changed(GSettings* settings, const char* key, gpointer data) {
+    (void)data;
+    apply_theme_name(g_settings_get_string(settings, key));
+}
+
+static gboolean connect_theme_settings(gpointer data) {
+    (void)data;
+    if (theme_watch.connected) return G_SOURCE_REMOVE;
+    theme_watch.connected = 1;
+    theme_watch.settings = gtk_settings_get_default();
+    if (theme_watch.settings) {
+        theme_watch.handler = g_signal_connect(theme_watch.settings, "notify::gtk-icon-theme-name",
+                                               G_CALLBACK(on_gtk_theme_changed), NULL);
+        on_gtk_theme_changed(G_OBJECT(theme_watch.settings), NULL, NULL);
+        return G_SOURCE_REMOVE;
+    }
+    GSettingsSchemaSource* source = g_settings_schema_source_get_default();
+    GSettingsSchema* schema =
+        source ? g_settings_schema_source_lookup(source, "org.gnome.desktop.interface", TRUE) : NULL;
+    if (schema) {
+        theme_watch.gsettings = g_settings_new("org.gnome.desktop.interface");
+        theme_watch.handler = g_signal_connect(theme_watch.gsettings, "changed::icon-theme",
+                                               G_CALLBACK(on_gsettings_theme_changed), NULL);
+        on_gsettings_theme_changed(theme_watch.gsettings, "icon-theme", NULL);
+        g_settings_schema_unref(schema);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void watch_icon_theme(icon_theme_callback callback) {
+    pthread_mutex_lock(&theme_watch.lock);
+    theme_watch.callback = callback;
+    pthread_mutex_unlock(&theme_watch.lock);
+    // Runs right away when called on the main thread, else on its next
+    // iteration.
+    g_main_context_invoke(NULL, connect_theme_settings, NULL);
+}
+
+void unwatch_icon_theme() {
+    // The settings stay connected (the theme index still follows them);
+    // only notifications stop. No callback runs once this returns.
+    pthread_mutex_lock(&theme_watch.lock);
+    theme_watch.callback = NULL;
+    pthread_mutex_unlock(&theme_watch.lock);
+}
+
+static struct {
+    pthread_mutex_t lock;
+    icon_change_callback callback;
+} change_watch = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void on_icons_changed(const char* names) {
+    pthread_mutex_lock(&change_watch.lock);
+    if (change_watch.callback) change_watch.callback(names ? strdup(names) : NULL);
+    pthread_mutex_unlock(&change_watch.lock);
+}
+
+void watch_icon_changes(icon_change_callback callback) {
+    pthread_mutex_lock(&change_watch.lock);
+    change_watch.callback = callback;
+    pthread_mutex_unlock(&change_watch.lock);
+    icon_theme_watch_changes(on_icons_changed);
+}
+
+void unwatch_icon_changes() {
+    // No callback runs once this returns.
+    pthread_mutex_lock(&change_watch.lock);
+    change_watch.callback = NULL;
+    pthread_mutex_unlock(&change_watch.lock);
+}
+
 // Free the memory allocated for the icon path
 void free_icon_path(char* path) {
     free(path);
-}
\ No newline at end of file
+}
+
+// GTK's answer for a name the native index missed, symlinks resolved. Call
+// on the GTK main thread.
+static char* gtk_lookup(GtkIconTheme* theme, const char* icon_name, int size, int scale) {
+    GtkIconInfo* info = gtk_icon_theme_lookup_icon_for_scale(
+        theme, icon_name, size, scale, GTK_ICON_LOOKUP_FORCE_SIZE);
+    if (!info) return NULL;
+    const char* path = gtk_icon_info_get_filename(info);
+    char* result = NULL;
+    if (path) {
+        result = realpath(path, NULL);
+        if (!result) result = strdup(path);
+    }
+    g_object_unref(info);
+    return result;
+}
+
+// Move count resolved paths (freed here, with the array) into one
+// icon_path_list allocation.
+static icon_path_list* pack_paths(char** resolved, int32_t count) {
+    size_t bytes = 0;
+    for (int32_t i = 0; i < count; i++) {
+        if (resolved[i]) bytes += strlen(resolved[i]) + 1;
+    }
+    icon_path_list* list = malloc(sizeof(icon_path_list) + count * sizeof(char*) + bytes);
+    if (list) {
+        list->count = count;
+        list->paths = (const char**)(list + 1);
+        char* strings = (char*)(list->paths + count);
+        for (int32_t i = 0; i < count; i++) {
+            if (!resolved[i]) {
+                list->paths[i] = NULL;
+                continue;
+            }
+            size_t len = strlen(resolved[i]) + 1;
+            memcpy(strings, resolved[i], len);
+            list->paths[i] = strings;
+            strings += len;
+        }
+    }
+    for (int32_t i = 0; i < count; i++) free(resolved[i]);
+    free(resolved);
+    return list;
+}
+
+icon_path_list* get_icon_paths(const char* const* icon_names, const int32_t* sizes, int32_t count,
+                               int32_t scale) {
+    if (count < 0) count = 0;
+    if (scale < 1) scale = 1;
+
+    // Resolve everything first so the result can be sized exactly. GTK is
+    // not asked: this runs on the caller's thread, not the GTK main thread.
+    char** resolved = calloc(count ? count : 1, sizeof(char*));
+    if (!resolved) return NULL;
+    for (int32_t i = 0; i < count; i++) {
+        if (!icon_names[i] || !icon_names[i][0]) continue;
+        resolved[i] = icon_theme_lookup(icon_names[i], sizes[i], scale);
+    }
+    icon_theme_save_cache();
+    return pack_paths(resolved, count);
+}
+
+// A request_icon_paths() call, owned by whichever thread works on it.
+typedef struct {
+    int64_t id;
+    icon_paths_callback callback;
+    int32_t count;
+    int32_t scale;
+    int32_t* sizes;
+    char** names;
+    char** resolved;
+} path_request;
+
+static void free_path_request(path_request* r) {
+    for (int32_t i = 0; r->names && i < r->count; i++) free(r->names[i]);
+    free(r->names);
+    free(r->sizes);
+    free(r);
+}
+
+static void finish_path_request(path_request* r) {
+    icon_path_list* list = pack_paths(r->resolved, r->count);
+    r->callback(r->id, list);
+    free_path_request(r);
+}
+
+static gboolean finish_path_request_on_main(gpointer data) {
+    path_request* r = data;
+    GtkIconTheme* theme = gtk_icon_theme_get_default();
+    for (int32_t i = 0; theme && i < r->count; i++) {
+        if (r->resolved[i] || !r->names[i] || !r->names[i][0]) continue;
+        r->resolved[i] = gtk_lookup(theme, r->names[i], r->sizes[i], r->scale);
+    }
+    finish_path_request(r);
+    return G_SOURCE_REMOVE;
+}
+
+static void run_path_request(void* data) {
+    path_request* r = data;
+    int missed = 0;
+    for (int32_t i = 0; i < r->count; i++) {
+        if (!r->names[i] || !r->names[i][0]) continue;
+        r->resolved[i] = icon_theme_lookup(r->names[i], r->sizes[i], r->scale);
+        if (!r->resolved[i]) missed = 1;
+    }
+    icon_theme_save_cache();
+    // GtkIconTheme is only usable on the GTK main thread.
+    if (missed) g_main_context_invoke(NULL, finish_path_request_on_main, r);
+    else finish_path_request(r);
+}
+
+int32_t request_icon_paths(const char* const* icon_names, const int32_t* sizes, int32_t count,
+                           int32_t scale, int64_t request, icon_paths_callback callback) {
+    if (!callback) return -1;
+    if (count < 0) count = 0;
+    path_request* r = calloc(1, sizeof(path_request));
+    if (!r) return -1;
+    r->id = request;
+    r->callback = callback;
+    r->count = count;
+    r->scale = scale < 1 ? 1 : scale;
+    r->sizes = malloc((count ? count : 1) * sizeof(int32_t));
+    r->names = calloc(count ? count : 1, sizeof(char*));
+    r->resolved = calloc(count ? count : 1, sizeof(char*));
+    int failed = !r->sizes || !r->names || !r->resolved;
+    for (int32_t i = 0; !failed && i < count; i++) {
+        r->sizes[i] = sizes[i];
+        if (icon_names[i] && !(r->names[i] = strdup(icon_names[i]))) failed = 1;
+    }
+    if (failed || icon_worker_submit(run_path_request, r) != 0) {
+        free(r->resolved);
+        free_path_request(r);
+        return -1;
+    }
+    return 0;
+}
+
+void free_icon_paths(icon_path_list* list) {
+    free(list);
+}
@@ -1,8 +1,71 @@
 #ifndef ICON_LOADER_H
 #define ICON_LOADER_H
 
+#include <stdint.h>
+
+// Results of get_icon_paths(). paths[i] is the resolved file for the i-th
+// requested name, or NULL if the theme has no such icon.
+typedef struct {
+    int32_t count;
+    const char** paths;
+} icon_path_list;
+
 void init_gtk();
 char* get_icon_path(const char* icon_name, int size);
 void free_icon_path(char* path);
 
-#endif
\ No newline at end of file
+// Look up an icon in the native theme index (no GTK involved): the theme,
+// its Inherits chain, hicolor and pixmaps. size is in logical pixels and
+// scale is the device pixel ratio rounded up; the smallest icon at least
+// size * scale pixels large, or a scalable one, is preferred. Free the
+// result with free_icon_path().
+char* find_icon_path(const char* icon_name, int size, int scale);
+// Override the theme find_icon_path() uses; NULL or "" to go back to the
+// settings.ini default until watch_icon_theme() reports the GTK setting.
+void set_icon_theme(const char* theme);
+// The icon theme in effect. Free with free_icon_path().
+char* get_icon_theme();
+
+// Called with the new theme name, which the callee frees with
+// free_icon_path(), after the theme changed and the theme-dependent caches
+// were dropped.
+typedef void (*icon_theme_callback)(char* theme);
+// Resolve the theme from GtkSettings gtk-icon-theme-name (GSettings
+// org.gnome.desktop.interface icon-theme without a display) on the GTK main
+// thread, apply it, and keep following it. callback runs on the main thread
+// whenever the theme in effect changes.
+void watch_icon_theme(icon_theme_callback callback);
+void unwatch_icon_theme();
+
+// Called after icons were installed or removed, with the affected icon
+// names separated by newlines, or NULL when any icon may have changed.
+// The callee frees names with free_icon_path().
+typedef void (*icon_change_callback)(char* names);
+// Follow the icon directories lookups were answered from: the native index
+// and the icon path cache take changes into account by themselves, then
+// callback runs on a background thread so callers can re-resolve.
+void watch_icon_changes(icon_change_callback callback);
+void unwatch_icon_changes();
+
+// Look up count icon names at their logical sizes and a common scale in one
+// call, through the native index only: names it misses come back NULL, as
+// GTK may only be used on its main thread (request_icon_paths() asks it
+// there). Safe to call from any thread. Paths have symlinks resolved. The list and all its strings are one allocation,
+// released with free_icon_paths(). Returns NULL on allocation failure.
+icon_path_list* get_icon_paths(const char* const* icon_names, const int32_t* sizes, int32_t count,
+                               int32_t scale);
+void free_icon_paths(icon_path_list* list);
+
+// Called once per request_icon_paths() call with its request id and the
+// result (NULL on allocation failure), which the callee releases with
+// free_icon_paths(). Runs on an icon worker thread, or on the GTK main
+// thread when names had to go to GTK.
+typedef void (*icon_paths_callback)(int64_t request, icon_path_list* paths);
+// get_icon_paths() without blocking: the arguments are copied, the native
+// index is searched on a worker thread, and GTK answers the misses on its
+// main thread. Safe to call from any thread. Returns 0 if the request was
+// queued, -1 if not (callback is then never called).
+int32_t request_icon_paths(const char* const* icon_names, const int32_t* sizes, int32_t count,
+                           int32_t scale, int64_t request, icon_paths_callback callback);
+
+#endif
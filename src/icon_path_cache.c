@@ -0,0 +1,452 @@
+#define _GNU_SOURCE
+#include "icon_path_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File layout, host byte order (the file never leaves this machine), every
+// section 8-byte aligned and addressed by offsets from the start:
+//   cache_header
+//   cache_stamp[n_stamps]
+//   uint32_t buckets[n_buckets]   first entry in each bucket, NO_ENTRY if none
+//   cache_entry[n_entries]
+//   strings                       NUL-terminated, referenced by offset
+#define CACHE_MAGIC "VXICONP"
+#define CACHE_VERSION 2
+#define NO_ENTRY 0xffffffffu
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t file_size;
+    uint32_t theme;  // String offset
+    uint32_t n_stamps;
+    uint32_t stamps;
+    uint32_t n_buckets;
+    uint32_t buckets;
+    uint32_t n_entries;
+    uint32_t entries;
+    uint32_t strings;
+} cache_header;
+
+typedef struct {
+    uint32_t path;  // String offset
+    uint32_t exists;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} cache_stamp;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t next;  // Next entry in the bucket, NO_ENTRY at the end
+    uint32_t name;  // String offset
+    int32_t size;
+    uint32_t path;  // String offset, NO_ENTRY if the name has no icon
+    int32_t scale;
+} cache_entry;
+
+typedef struct {
+    char* path;
+    int exists;
+    struct timespec mtime;
+} stamp;
+
+typedef struct {
+    char* name;
+    int size;
+    int scale;
+    char* path;
+} added_entry;
+
+static struct {
+    const uint8_t* data;
+    size_t size;
+    char* theme;
+    stamp* stamps;
+    int n_stamps, stamps_cap;
+    added_entry* added;
+    int n_added, added_cap;
+    // Icon names whose mapped entries no longer count, see forget().
+    char** forgotten;
+    int n_forgotten, forgotten_cap;
+    int dirty;  // Save even without added entries
+} cache;
+
+static uint32_t hash_key(const char* name, int size, int scale) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    h ^= (uint32_t)size;
+    h *= 16777619u;
+    h ^= (uint32_t)scale;
+    h *= 16777619u;
+    return h;
+}
+
+// Whether name is icon, possibly with a file extension.
+static int same_icon(const char* name, const char* icon) {
+    size_t len = strlen(icon);
+    if (strncmp(name, icon, len) != 0) return 0;
+    return name[len] == '\0' || (name[len] == '.' && !strchr(name + len + 1, '.'));
+}
+
+static int is_forgotten(const char* name) {
+    for (int i = 0; i < cache.n_forgotten; i++) {
+        if (same_icon(name, cache.forgotten[i])) return 1;
+    }
+    return 0;
+}
+
+static void clear_forgotten() {
+    for (int i = 0; i < cache.n_forgotten; i++) free(cache.forgotten[i]);
+    cache.n_forgotten = 0;
+    cache.dirty = 0;
+}
+
+static int cache_path(char* out, size_t size, int create_dir) {
+    const char* base = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    char dir[PATH_MAX];
+    if (base && *base) snprintf(dir, sizeof(dir), "%s/vaxp", base);
+    else if (home) snprintf(dir, sizeof(dir), "%s/.cache/vaxp", home);
+    else return -1;
+    if (create_dir) {
+        char parent[PATH_MAX];
+        snprintf(parent, sizeof(parent), "%.*s", (int)(strrchr(dir, '/') - dir), dir);
+        mkdir(parent, 0700);
+        if (mkdir(dir, 0700) != 0 && errno != EEXIST) return -1;
+    }
+    snprintf(out, size, "%s/icon-paths.cache", dir);
+    return 0;
+}
+
+static const char* string_at(uint32_t offset) {
+    const cache_header* h = (const cache_header*)cache.data;
+    if (offset < h->strings || offset >= cache.size) return NULL;
+    if (!memchr(cache.data + offset, '\0', cache.size - offset)) return NULL;
+    return (const char*)cache.data + offset;
+}
+
+static int section_fits(uint32_t offset, uint32_t count, size_t item) {
+    return offset % 8 == 0 && offset <= cache.size && count <= (cache.size - offset) / item;
+}
+
+static void unmap() {
+    if (cache.data) munmap((void*)cache.data, cache.size);
+    cache.data = NULL;
+    cache.size = 0;
+}
+
+static void map_file(const char* path) {
+    unmap();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            cache.data = data;
+            cache.size = st.st_size;
+        }
+    }
+    close(fd);
+}
+
+// Check the header, section bounds, theme and every stamp.
+static int validate(const char* theme) {
+    const cache_header* h = (const cache_header*)cache.data;
+    if (cache.size < sizeof(cache_header) || memcmp(h->magic, CACHE_MAGIC, 8) != 0 ||
+        h->version != CACHE_VERSION || h->file_size != cache.size ||
+        !section_fits(h->stamps, h->n_stamps, sizeof(cache_stamp)) ||
+        !section_fits(h->buckets, h->n_buckets, sizeof(uint32_t)) || !h->n_buckets ||
+        !section_fits(h->entries, h->n_entries, sizeof(cache_entry)) || h->strings > cache.size) {
+        return 0;
+    }
+    const char* cached_theme = string_at(h->theme);
+    if (!cached_theme || strcmp(cached_theme, theme) != 0) return 0;
+
+    const cache_stamp* stamps = (const cache_stamp*)(cache.data + h->stamps);
+    for (uint32_t i = 0; i < h->n_stamps; i++) {
+        const char* path = string_at(stamps[i].path);
+        if (!path) return 0;
+        struct stat st;
+        int exists = stat(path, &st) == 0;
+        if (exists != (int)stamps[i].exists) return 0;
+        if (exists && (st.st_mtim.tv_sec != stamps[i].mtime_sec ||
+                       st.st_mtim.tv_nsec != stamps[i].mtime_nsec)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int icon_path_cache_open(const char* theme) {
+    icon_path_cache_close();
+    cache.theme = strdup(theme);
+
+    char path[PATH_MAX];
+    if (cache_path(path, sizeof(path), 0) != 0) return 0;
+    map_file(path);
+    if (cache.data && !validate(theme)) unmap();
+    return cache.data != NULL;
+}
+
+void icon_path_cache_close() {
+    unmap();
+    free(cache.theme);
+    cache.theme = NULL;
+    icon_path_cache_clear_stamps();
+    for (int i = 0; i < cache.n_added; i++) {
+        free(cache.added[i].name);
+        free(cache.added[i].path);
+    }
+    cache.n_added = 0;
+    clear_forgotten();
+}
+
+void icon_path_cache_each_stamp(void (*visit)(const char* path)) {
+    if (!cache.data) return;
+    const cache_header* h = (const cache_header*)cache.data;
+    const cache_stamp* stamps = (const cache_stamp*)(cache.data + h->stamps);
+    for (uint32_t i = 0; i < h->n_stamps; i++) {
+        const char* path = string_at(stamps[i].path);
+        if (path) visit(path);
+    }
+}
+
+int icon_path_cache_find(const char* name, int size, int scale, const char** path) {
+    if (!cache.data || (cache.n_forgotten && is_forgotten(name))) return 0;
+    const cache_header* h = (const cache_header*)cache.data;
+    const uint32_t* buckets = (const uint32_t*)(cache.data + h->buckets);
+    const cache_entry* entries = (const cache_entry*)(cache.data + h->entries);
+    uint32_t hash = hash_key(name, size, scale);
+    // The step limit guards against cycles in a corrupt file.
+    uint32_t id = buckets[hash % h->n_buckets];
+    for (uint32_t steps = 0; id < h->n_entries && steps < h->n_entries; steps++) {
+        const cache_entry* e = &entries[id];
+        const char* other =
+            e->hash == hash && e->size == size && e->scale == scale ? string_at(e->name) : NULL;
+        if (other && strcmp(other, name) == 0) {
+            *path = e->path == NO_ENTRY ? NULL : string_at(e->path);
+            return e->path == NO_ENTRY || *path != NULL;
+        }
+        id = e->next;
+    }
+    return 0;
+}
+
+void icon_path_cache_clear_stamps() {
+    for (int i = 0; i < cache.n_stamps; i++) free(cache.stamps[i].path);
+    cache.n_stamps = 0;
+}
+
+void icon_path_cache_stamp(const char* path) {
+    struct stat st;
+    for (int i = 0; i < cache.n_stamps; i++) {
+        stamp* s = &cache.stamps[i];
+        if (strcmp(s->path, path) != 0) continue;
+        int exists = stat(path, &st) == 0;
+        struct timespec mtime = exists ? st.st_mtim : (struct timespec){ 0, 0 };
+        if (exists != s->exists || mtime.tv_sec != s->mtime.tv_sec ||
+            mtime.tv_nsec != s->mtime.tv_nsec) {
+            s->exists = exists;
+            s->mtime = mtime;
+            cache.dirty = 1;
+        }
+        return;
+    }
+    if (cache.n_stamps == cache.stamps_cap) {
+        int cap = cache.stamps_cap ? cache.stamps_cap * 2 : 64;
+        stamp* grown = realloc(cache.stamps, cap * sizeof(stamp));
+        if (!grown) return;
+        cache.stamps = grown;
+        cache.stamps_cap = cap;
+    }
+    stamp* s = &cache.stamps[cache.n_stamps];
+    s->exists = stat(path, &st) == 0;
+    s->mtime = s->exists ? st.st_mtim : (struct timespec){ 0, 0 };
+    if ((s->path = strdup(path))) cache.n_stamps++;
+}
+
+void icon_path_cache_forget(const char* icon) {
+    int kept = 0;
+    for (int i = 0; i < cache.n_added; i++) {
+        if (same_icon(cache.added[i].name, icon)) {
+            free(cache.added[i].name);
+            free(cache.added[i].path);
+        } else {
+            cache.added[kept++] = cache.added[i];
+        }
+    }
+    cache.n_added = kept;
+    cache.dirty = 1;
+    if (!cache.data || is_forgotten(icon)) return;
+    if (cache.n_forgotten == cache.forgotten_cap) {
+        int cap = cache.forgotten_cap ? cache.forgotten_cap * 2 : 16;
+        char** grown = realloc(cache.forgotten, cap * sizeof(char*));
+        if (!grown) {
+            // Without the list the mapping cannot be trusted at all.
+            unmap();
+            return;
+        }
+        cache.forgotten = grown;
+        cache.forgotten_cap = cap;
+    }
+    if ((cache.forgotten[cache.n_forgotten] = strdup(icon))) cache.n_forgotten++;
+    else unmap();
+}
+
+void icon_path_cache_add(const char* name, int size, int scale, const char* path) {
+    if (cache.n_added == cache.added_cap) {
+        int cap = cache.added_cap ? cache.added_cap * 2 : 64;
+        added_entry* grown = realloc(cache.added, cap * sizeof(added_entry));
+        if (!grown) return;
+        cache.added = grown;
+        cache.added_cap = cap;
+    }
+    added_entry* e = &cache.added[cache.n_added];
+    e->name = strdup(name);
+    e->size = size;
+    e->scale = scale;
+    e->path = path ? strdup(path) : NULL;
+    if (e->name && (!path || e->path)) {
+        cache.n_added++;
+    } else {
+        free(e->name);
+        free(e->path);
+    }
+}
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+// Appends s to the string section, returning its offset.
+static uint32_t put_string(uint8_t* file, size_t* end, const char* s) {
+    size_t len = strlen(s) + 1;
+    memcpy(file + *end, s, len);
+    uint32_t offset = *end;
+    *end += len;
+    return offset;
+}
+
+int icon_path_cache_save() {
+    if ((!cache.n_added && !cache.dirty) || !cache.theme || !cache.n_stamps) return 0;
+
+    // Entries still valid in the mapping are carried over.
+    const cache_header* old = cache.data ? (const cache_header*)cache.data : NULL;
+    const cache_entry* old_entries = old ? (const cache_entry*)(cache.data + old->entries) : NULL;
+    uint32_t n_old = old ? old->n_entries : 0;
+    uint32_t n_entries = n_old + cache.n_added;
+    uint32_t n_buckets = n_entries * 2 + 1;
+
+    size_t strings_len = strlen(cache.theme) + 1;
+    for (int i = 0; i < cache.n_stamps; i++) strings_len += strlen(cache.stamps[i].path) + 1;
+    for (uint32_t i = 0; i < n_old; i++) {
+        const char* name = string_at(old_entries[i].name);
+        const char* path = old_entries[i].path == NO_ENTRY ? NULL : string_at(old_entries[i].path);
+        strings_len += (name ? strlen(name) + 1 : 0) + (path ? strlen(path) + 1 : 0);
+    }
+    for (int i = 0; i < cache.n_added; i++) {
+        strings_len += strlen(cache.added[i].name) + 1;
+        if (cache.added[i].path) strings_len += strlen(cache.added[i].path) + 1;
+    }
+
+    size_t stamps = align8(sizeof(cache_header));
+    size_t buckets = align8(stamps + cache.n_stamps * sizeof(cache_stamp));
+    size_t entries = align8(buckets + n_buckets * sizeof(uint32_t));
+    size_t strings = align8(entries + n_entries * sizeof(cache_entry));
+    size_t size = strings + strings_len;
+    if (size > UINT32_MAX) return -1;
+    uint8_t* file = calloc(1, size);
+    if (!file) return -1;
+
+    cache_header* h = (cache_header*)file;
+    memcpy(h->magic, CACHE_MAGIC, 8);
+    h->version = CACHE_VERSION;
+    h->file_size = size;
+    h->n_stamps = cache.n_stamps;
+    h->stamps = stamps;
+    h->n_buckets = n_buckets;
+    h->buckets = buckets;
+    h->entries = entries;
+    h->strings = strings;
+    size_t end = strings;
+    h->theme = put_string(file, &end, cache.theme);
+
+    cache_stamp* out_stamps = (cache_stamp*)(file + stamps);
+    for (int i = 0; i < cache.n_stamps; i++) {
+        out_stamps[i] = (cache_stamp){ put_string(file, &end, cache.stamps[i].path),
+                                       cache.stamps[i].exists, cache.stamps[i].mtime.tv_sec,
+                                       cache.stamps[i].mtime.tv_nsec };
+    }
+
+    uint32_t* out_buckets = (uint32_t*)(file + buckets);
+    memset(out_buckets, 0xff, n_buckets * sizeof(uint32_t));
+    cache_entry* out_entries = (cache_entry*)(file + entries);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < n_old + cache.n_added; i++) {
+        const char* name;
+        const char* path;
+        int icon_size, icon_scale;
+        if (i < n_old) {
+            name = string_at(old_entries[i].name);
+            path = old_entries[i].path == NO_ENTRY ? NULL : string_at(old_entries[i].path);
+            icon_size = old_entries[i].size;
+            icon_scale = old_entries[i].scale;
+            if (!name || (old_entries[i].path != NO_ENTRY && !path)) continue;
+            if (cache.n_forgotten && is_forgotten(name)) continue;
+        } else {
+            name = cache.added[i - n_old].name;
+            path = cache.added[i - n_old].path;
+            icon_size = cache.added[i - n_old].size;
+            icon_scale = cache.added[i - n_old].scale;
+        }
+        uint32_t hash = hash_key(name, icon_size, icon_scale);
+        out_entries[n] = (cache_entry){ hash, out_buckets[hash % n_buckets],
+                                        put_string(file, &end, name), icon_size,
+                                        path ? put_string(file, &end, path) : NO_ENTRY,
+                                        icon_scale };
+        out_buckets[hash % n_buckets] = n++;
+    }
+    h->n_entries = n;
+
+    // Write a new file and rename it over the old one, so a concurrent
+    // reader's mapping stays intact.
+    char path[PATH_MAX] = "", tmp[PATH_MAX + 16];
+    int result = -1;
+    if (cache_path(path, sizeof(path), 1) == 0) {
+        snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+        FILE* f = fopen(tmp, "wb");
+        if (f) {
+            int written = fwrite(file, 1, size, f) == size;
+            if (fclose(f) == 0 && written && rename(tmp, path) == 0) result = 0;
+            else unlink(tmp);
+        }
+    }
+    free(file);
+    if (result != 0) {
+        fprintf(stderr, "icon path cache: cannot write %s\n", path);
+        return -1;
+    }
+
+    for (int i = 0; i < cache.n_added; i++) {
+        free(cache.added[i].name);
+        free(cache.added[i].path);
+    }
+    cache.n_added = 0;
+    clear_forgotten();
+    // Continue from what was just written, so later saves carry it over.
+    map_file(path);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef ICON_PATH_CACHE_H
+#define ICON_PATH_CACHE_H
+
+// Internal to libicon_loader: resolved icon paths persisted across runs in
+// $XDG_CACHE_HOME/vaxp/icon-paths.cache, so a warm start can answer lookups
+// without building the theme index. The file records the mtimes of the
+// directories and index.theme files the answers came from and is dropped
+// as soon as any of them changed. Not thread-safe; icon_theme.c calls it
+// under its lock.
+
+// Map the cache file for theme. Returns 1 if it exists, matches and all of
+// its stamps are current, else 0 (the old contents are discarded).
+int icon_path_cache_open(const char* theme);
+void icon_path_cache_close();
+
+// Look up (name, size, scale). Returns 1 on a hit and sets *path, which is
+// NULL for names known to have no icon and points into the mapping
+// otherwise.
+int icon_path_cache_find(const char* name, int size, int scale, const char** path);
+
+// While building the index: forget previous stamps, then record each path
+// whose mtime the results depend on (missing paths count too). Stamping a
+// path again updates its mtime, after a change was taken into account.
+void icon_path_cache_clear_stamps();
+void icon_path_cache_stamp(const char* path);
+
+// Call visit with each path stamped in the mapped file.
+void icon_path_cache_each_stamp(void (*visit)(const char* path));
+
+// Drop every result for icon (with or without a file extension), mapped or
+// added, because files providing it appeared or went away.
+void icon_path_cache_forget(const char* icon);
+
+// Remember a fresh result (path may be NULL) for the next save.
+void icon_path_cache_add(const char* name, int size, int scale, const char* path);
+
+// Write the mapped entries, the added ones and the stamps to a new file,
+// if anything was added, forgotten or restamped. Returns 0 on success or when there was nothing to
+// write.
+int icon_path_cache_save();
+
+#endif
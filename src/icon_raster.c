@@ -0,0 +1,406 @@
+#define _GNU_SOURCE
+#include "icon_raster.h"
+#include "icon_theme.h"
+#include "icon_worker.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Largest edge rendered, in device pixels.
+#define MAX_ICON_PIXELS 1024
+// Pixels kept around for images that may be asked for again.
+#define LRU_BYTES (8 << 20)
+
+// Rasterized SVGs on disk, one file per (source path, edge), host byte
+// order: raster_header, the source path (no NUL), then the pixels.
+#define RASTER_MAGIC "VXRGBA1"
+// Disk space the rasterizations may take; the least recently used files go
+// first once a write goes past it.
+#define RASTER_DIR_BYTES (64 << 20)
+
+typedef struct {
+    char magic[8];
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int32_t side;
+    uint32_t path_len;
+} raster_header;
+
+typedef struct raster_entry {
+    icon_image image;  // First, so an icon_image* is also its entry
+    char* path;
+    struct timespec mtime;
+    int refs;  // Callers holding the image, plus one while in the LRU list
+    struct raster_entry* prev;
+    struct raster_entry* next;
+} raster_entry;
+
+static struct {
+    pthread_mutex_t lock;
+    raster_entry* head;  // Most recently used
+    raster_entry* tail;
+    size_t bytes;
+} lru = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static size_t image_bytes(int side) {
+    return (size_t)side * side * 4;
+}
+
+// Call with lru.lock held.
+static void unref_entry(raster_entry* e) {
+    if (--e->refs > 0) return;
+    free(e->path);
+    free(e);
+}
+
+// Call with lru.lock held.
+static void unlink_entry(raster_entry* e) {
+    if (e->prev) e->prev->next = e->next;
+    else lru.head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else lru.tail = e->prev;
+    e->prev = e->next = NULL;
+    lru.bytes -= image_bytes(e->image.width);
+}
+
+// Call with lru.lock held.
+static void push_entry(raster_entry* e) {
+    e->prev = NULL;
+    e->next = lru.head;
+    if (lru.head) lru.head->prev = e;
+    else lru.tail = e;
+    lru.head = e;
+    lru.bytes += image_bytes(e->image.width);
+}
+
+// Find the image of path at side pixels, dropping it if the file changed
+// since. Call with lru.lock held. The returned entry carries a reference.
+static raster_entry* find_entry(const char* path, int side, const struct timespec* mtime) {
+    for (raster_entry* e = lru.head; e; e = e->next) {
+        if (e->image.width != side || strcmp(e->path, path) != 0) continue;
+        unlink_entry(e);
+        if (e->mtime.tv_sec != mtime->tv_sec || e->mtime.tv_nsec != mtime->tv_nsec) {
+            unref_entry(e);
+            return NULL;
+        }
+        push_entry(e);
+        e->refs++;
+        return e;
+    }
+    return NULL;
+}
+
+// Call with lru.lock held. Takes the list's reference on e.
+static void insert_entry(raster_entry* e) {
+    e->refs++;
+    push_entry(e);
+    while (lru.bytes > LRU_BYTES && lru.tail != e) {
+        raster_entry* old = lru.tail;
+        unlink_entry(old);
+        unref_entry(old);
+    }
+}
+
+static int is_svg(const char* path) {
+    const char* ext = strrchr(path, '.');
+    return ext && (strcasecmp(ext, ".svg") == 0 || strcasecmp(ext, ".svgz") == 0);
+}
+
+static int raster_dir(char* out, size_t size, int create) {
+    const char* base = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    char vaxp[PATH_MAX];
+    if (base && *base) snprintf(vaxp, sizeof(vaxp), "%s/vaxp", base);
+    else if (home) snprintf(vaxp, sizeof(vaxp), "%s/.cache/vaxp", home);
+    else return -1;
+    snprintf(out, size, "%s/icons", vaxp);
+    if (create) {
+        char parent[PATH_MAX];
+        snprintf(parent, sizeof(parent), "%.*s", (int)(strrchr(vaxp, '/') - vaxp), vaxp);
+        mkdir(parent, 0700);
+        mkdir(vaxp, 0700);
+        if (mkdir(out, 0700) != 0 && errno != EEXIST) return -1;
+    }
+    return 0;
+}
+
+// Where the rasterization of path at side pixels lives. The mtime is checked
+// against the header rather than hashed in, so a re-render after the source
+// changes replaces the outdated file instead of adding one next to it.
+static int raster_file(char* out, size_t size, const char* path, int side, int create) {
+    char dir[PATH_MAX];
+    if (raster_dir(dir, sizeof(dir), create) != 0) return -1;
+    uint64_t h = 14695981039346656037ull;
+    for (const unsigned char* p = (const unsigned char*)path; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ull;
+    }
+    h ^= (uint64_t)side;
+    h *= 1099511628211ull;
+    snprintf(out, size, "%s/%016llx.rgba", dir, (unsigned long long)h);
+    return 0;
+}
+
+// Fill e's pixels from the disk cache. Returns 0 on a hit.
+static int read_raster(raster_entry* e) {
+    char file[PATH_MAX];
+    int side = e->image.width;
+    if (raster_file(file, sizeof(file), e->path, side, 0) != 0) return -1;
+    FILE* f = fopen(file, "rb");
+    if (!f) return -1;
+
+    raster_header h;
+    size_t path_len = strlen(e->path);
+    int ok = fread(&h, sizeof(h), 1, f) == 1 && memcmp(h.magic, RASTER_MAGIC, 8) == 0 &&
+             h.mtime_sec == e->mtime.tv_sec && h.mtime_nsec == e->mtime.tv_nsec &&
+             h.side == side && h.path_len == path_len;
+    if (ok) {
+        char* stored = malloc(path_len);
+        ok = stored && fread(stored, 1, path_len, f) == path_len &&
+             memcmp(stored, e->path, path_len) == 0;
+        free(stored);
+    }
+    ok = ok && fread((uint8_t*)e->image.pixels, 1, image_bytes(side), f) == image_bytes(side);
+    // Mark the file used, so trim_raster_dir() keeps it over idle ones.
+    if (ok) futimens(fileno(f), NULL);
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+typedef struct {
+    char name[32];
+    off_t size;
+    struct timespec mtime;
+} raster_stat;
+
+static int older_first(const void* a, const void* b) {
+    const struct timespec* x = &((const raster_stat*)a)->mtime;
+    const struct timespec* y = &((const raster_stat*)b)->mtime;
+    if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+    if (x->tv_nsec != y->tv_nsec) return x->tv_nsec < y->tv_nsec ? -1 : 1;
+    return 0;
+}
+
+// Remove the least recently used rasterizations until the directory fits in
+// RASTER_DIR_BYTES. Another process trimming at the same time is harmless:
+// files it removed first just fail to unlink here.
+static void trim_raster_dir(const char* path) {
+    DIR* dir = opendir(path);
+    if (!dir) return;
+    raster_stat* files = NULL;
+    size_t count = 0, capacity = 0;
+    off_t total = 0;
+    struct dirent* d;
+    while ((d = readdir(dir))) {
+        // Only finished files: NAME.rgba, not a writer's NAME.rgba.PID.
+        size_t len = strlen(d->d_name);
+        if (len < 5 || len >= sizeof(files->name) || strcmp(d->d_name + len - 5, ".rgba") != 0)
+            continue;
+        struct stat st;
+        if (fstatat(dirfd(dir), d->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) continue;
+        if (count == capacity) {
+            size_t grown = capacity ? capacity * 2 : 64;
+            raster_stat* more = realloc(files, grown * sizeof(*files));
+            if (!more) break;
+            files = more;
+            capacity = grown;
+        }
+        memcpy(files[count].name, d->d_name, len + 1);
+        files[count].size = st.st_size;
+        files[count].mtime = st.st_mtim;
+        count++;
+        total += st.st_size;
+    }
+    if (total > RASTER_DIR_BYTES) {
+        qsort(files, count, sizeof(*files), older_first);
+        for (size_t i = 0; i < count && total > RASTER_DIR_BYTES; i++) {
+            if (unlinkat(dirfd(dir), files[i].name, 0) == 0) total -= files[i].size;
+        }
+    }
+    free(files);
+    closedir(dir);
+}
+
+static void write_raster(const raster_entry* e) {
+    char dir[PATH_MAX], file[PATH_MAX], tmp[PATH_MAX + 16];
+    int side = e->image.width;
+    if (raster_dir(dir, sizeof(dir), 1) != 0 ||
+        raster_file(file, sizeof(file), e->path, side, 1) != 0)
+        return;
+    raster_header h = { RASTER_MAGIC, e->mtime.tv_sec, e->mtime.tv_nsec, side,
+                        (uint32_t)strlen(e->path) };
+
+    // Write a new file and rename it into place, so readers never see a
+    // partial one.
+    snprintf(tmp, sizeof(tmp), "%s.%d", file, getpid());
+    FILE* f = fopen(tmp, "wb");
+    if (!f) return;
+    int written = fwrite(&h, sizeof(h), 1, f) == 1 &&
+                  fwrite(e->path, 1, h.path_len, f) == h.path_len &&
+                  fwrite(e->image.pixels, 1, image_bytes(side), f) == image_bytes(side);
+    if (fclose(f) != 0 || !written || rename(tmp, file) != 0) {
+        unlink(tmp);
+        fprintf(stderr, "icon raster cache: cannot write %s\n", file);
+        return;
+    }
+    trim_raster_dir(dir);
+}
+
+// Copy pixbuf centered into side x side premultiplied RGBA.
+static void premultiply(GdkPixbuf* pixbuf, int side, uint8_t* out) {
+    int width = gdk_pixbuf_get_width(pixbuf);
+    int height = gdk_pixbuf_get_height(pixbuf);
+    if (width > side) width = side;
+    if (height > side) height = side;
+    int channels = gdk_pixbuf_get_n_channels(pixbuf);
+    int has_alpha = gdk_pixbuf_get_has_alpha(pixbuf);
+    int stride = gdk_pixbuf_get_rowstride(pixbuf);
+    const guint8* src = gdk_pixbuf_read_pixels(pixbuf);
+
+    memset(out, 0, image_bytes(side));
+    int left = (side - width) / 2;
+    int top = (side - height) / 2;
+    for (int y = 0; y < height; y++) {
+        const guint8* row = src + (size_t)y * stride;
+        uint8_t* dst = out + ((size_t)(top + y) * side + left) * 4;
+        for (int x = 0; x < width; x++) {
+            const guint8* p = row + x * channels;
+            uint32_t a = has_alpha ? p[3] : 255;
+            dst[x * 4 + 0] = (p[0] * a + 127) / 255;
+            dst[x * 4 + 1] = (p[1] * a + 127) / 255;
+            dst[x * 4 + 2] = (p[2] * a + 127) / 255;
+            dst[x * 4 + 3] = a;
+        }
+    }
+}
+
+// Render e->path into e's pixels. Returns 0 on success.
+static int render(raster_entry* e) {
+    // Vector loaders render straight at this size; bitmaps are decoded and
+    // scaled. The aspect ratio is kept, so one edge may come out shorter.
+    int side = e->image.width;
+    GError* error = NULL;
+    GdkPixbuf* pixbuf = gdk_pixbuf_new_from_file_at_scale(e->path, side, side, TRUE, &error);
+    if (!pixbuf) {
+        // Callers fall back to another icon; nothing worth reporting.
+        g_clear_error(&error);
+        return -1;
+    }
+    int result = -1;
+    if (gdk_pixbuf_get_colorspace(pixbuf) == GDK_COLORSPACE_RGB &&
+        gdk_pixbuf_get_bits_per_sample(pixbuf) == 8 && gdk_pixbuf_get_n_channels(pixbuf) >= 3) {
+        premultiply(pixbuf, side, (uint8_t*)e->image.pixels);
+        result = 0;
+    }
+    g_object_unref(pixbuf);
+    return result;
+}
+
+icon_image* load_icon_rgba(const char* icon, int32_t size, int32_t scale) {
+    if (!icon || !*icon || size <= 0) return NULL;
+    if (scale < 1) scale = 1;
+    int side = (int64_t)size * scale > MAX_ICON_PIXELS ? MAX_ICON_PIXELS : size * scale;
+
+    char* path;
+    if (icon[0] == '/') {
+        path = strdup(icon);
+    } else {
+        path = icon_theme_lookup(icon, size, scale);
+        icon_theme_save_cache_later();
+    }
+    struct stat st;
+    if (!path || stat(path, &st) != 0) {
+        free(path);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&lru.lock);
+    raster_entry* e = find_entry(path, side, &st.st_mtim);
+    pthread_mutex_unlock(&lru.lock);
+    if (e) {
+        free(path);
+        return &e->image;
+    }
+
+    e = calloc(1, sizeof(raster_entry) + image_bytes(side));
+    if (!e) {
+        free(path);
+        return NULL;
+    }
+    e->image.width = side;
+    e->image.height = side;
+    e->image.pixels = (uint8_t*)(e + 1);
+    e->path = path;
+    e->mtime = st.st_mtim;
+    e->refs = 1;
+
+    // SVGs are the expensive ones to parse; their rasterizations persist.
+    int svg = is_svg(path);
+    if (!svg || read_raster(e) != 0) {
+        if (render(e) != 0) {
+            free(path);
+            free(e);
+            return NULL;
+        }
+        if (svg) write_raster(e);
+    }
+
+    pthread_mutex_lock(&lru.lock);
+    // Another thread may have loaded the same image meanwhile.
+    raster_entry* other = find_entry(path, side, &st.st_mtim);
+    if (other) {
+        unref_entry(e);
+        e = other;
+    } else {
+        insert_entry(e);
+    }
+    pthread_mutex_unlock(&lru.lock);
+    return &e->image;
+}
+
+void release_icon_image(icon_image* image) {
+    if (!image) return;
+    pthread_mutex_lock(&lru.lock);
+    unref_entry((raster_entry*)image);
+    pthread_mutex_unlock(&lru.lock);
+}
+
+typedef struct {
+    int64_t id;
+    icon_image_callback callback;
+    int32_t size;
+    int32_t scale;
+    char icon[];
+} raster_request;
+
+static void run_raster_request(void* data) {
+    raster_request* r = data;
+    r->callback(r->id, load_icon_rgba(r->icon, r->size, r->scale));
+    free(r);
+}
+
+int32_t request_icon_rgba(const char* icon, int32_t size, int32_t scale, int64_t request,
+                          icon_image_callback callback) {
+    if (!icon || !callback) return -1;
+    size_t len = strlen(icon) + 1;
+    raster_request* r = malloc(sizeof(raster_request) + len);
+    if (!r) return -1;
+    r->id = request;
+    r->callback = callback;
+    r->size = size;
+    r->scale = scale;
+    memcpy(r->icon, icon, len);
+    if (icon_worker_submit(run_raster_request, r) != 0) {
+        free(r);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef ICON_RASTER_H
+#define ICON_RASTER_H
+
+#include <stdint.h>
+
+// An icon rendered as premultiplied RGBA, width * height * 4 bytes.
+typedef struct {
+    int32_t width;
+    int32_t height;
+    const uint8_t* pixels;
+} icon_image;
+
+// Render an icon at exactly size * scale device pixels square: icon is an
+// absolute file path or a theme icon name, looked up like find_icon_path().
+// SVGs are rendered at that size by librsvg (through gdk-pixbuf), bitmaps
+// are scaled to it; either way the image keeps its aspect ratio and is
+// centered. Safe to call from any thread. Returns NULL if the icon is
+// missing or cannot be decoded. Release with release_icon_image().
+//
+// Images are shared: recently used ones stay in memory (up to a few MB)
+// and are handed out again while their file's mtime is unchanged. SVG
+// renderings also persist in $XDG_CACHE_HOME/vaxp/icons, one file per path
+// and edge length, so an SVG is parsed once per size, not per start. A
+// changed source is re-rendered over its old file, and the least recently
+// used files are removed once the directory passes 64 MB. The directory
+// can be removed at any time.
+icon_image* load_icon_rgba(const char* icon, int32_t size, int32_t scale);
+void release_icon_image(icon_image* image);
+
+// Called once per request_icon_rgba() call, on an icon worker thread, with
+// its request id and the image (NULL as for load_icon_rgba()), which the
+// callee releases with release_icon_image().
+typedef void (*icon_image_callback)(int64_t request, icon_image* image);
+// load_icon_rgba() on a worker thread. icon is copied. Returns 0 if the
+// request was queued, -1 if not (callback is then never called).
+int32_t request_icon_rgba(const char* icon, int32_t size, int32_t scale, int64_t request,
+                          icon_image_callback callback);
+
+#endif
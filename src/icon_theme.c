@@ -0,0 +1,1144 @@
+#define _GNU_SOURCE
+#include "icon_theme.h"
+#include "icon_path_cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// File extensions we index, in order of preference when a directory has
+// the same icon in several formats.
+static const char* const extensions[] = {
+    ".png", ".svg", ".xpm", ".ico", ".bmp", ".jpg", ".jpeg", ".gif", ".webp",
+};
+#define N_EXTENSIONS (int)(sizeof(extensions) / sizeof(extensions[0]))
+
+// Searched after the theme's own Inherits chain and hicolor, matching the
+// themes IconProvider used to probe.
+static const char* const fallback_themes[] = {
+    "Adwaita", "gnome", "oxygen", "Humanity", "elementary", "breeze", "Papirus", "Numix", "default",
+};
+
+// Room for hicolor is always left at the end of the Inherits chain.
+#define MAX_THEMES 32
+#define MAX_BASES 16
+
+// Filesystem events are applied in batches gathered for this long, so a
+// package install costs one update rather than one per file.
+#define BATCH_MS 150
+#define MAX_BATCH_BYTES (1 << 20)
+// Results of single lookups are persisted together this long after the
+// first one, rather than rewriting the icon path cache for each.
+#define SAVE_DELAY_MS 1000
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | \
+                    IN_DELETE_SELF | IN_MOVE_SELF | IN_EXCL_UNLINK | IN_ONLYDIR)
+
+enum { DIR_FIXED, DIR_SCALABLE, DIR_THRESHOLD };
+
+typedef struct {
+    char* path;
+    int theme;  // Position in the theme chain; pixmaps come last
+    int type;
+    int size;
+    int min_size;
+    int max_size;
+    int threshold;
+    int scale;
+} icon_dir;
+
+typedef struct {
+    uint32_t hash;
+    int32_t name;  // Offset into names
+    int32_t dir;
+    int32_t next;  // Next file with the same name, -1 at the end
+    uint8_t extension;
+    uint8_t maybe_link;
+    uint8_t removed;  // Deleted since the directory was listed
+} icon_file;
+
+// A theme directory's icon-theme.cache (written by gtk-update-icon-cache),
+// mapped read-only and read in place. All fields are big-endian:
+//   header:     u16 major, u16 minor, u32 hash offset, u32 directory list offset
+//   dir list:   u32 count, count × u32 offset of a directory name
+//   hash:       u32 buckets, buckets × u32 offset of the first icon
+//   icon:       u32 next icon in the bucket, u32 name offset, u32 image list offset
+//   image list: u32 count, count × (u16 directory, u16 flags, u32 data offset)
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    int theme;
+    uint32_t n_dirs;
+    int32_t* dirs;  // Cache directory -> icon_dir, -1 if index.theme omits it
+} icon_cache;
+
+#define CACHE_NONE 0xffffffffu
+#define CACHE_HAS_XPM 1
+#define CACHE_HAS_SVG 2
+#define CACHE_HAS_PNG 4
+
+// What a watched directory is to the index, which decides how its events
+// are applied (see apply_event()).
+enum {
+    WATCH_BASE,   // Icon base directory: themes appear and disappear here
+    WATCH_THEME,  // Theme directory: index.theme, icon-theme.cache, subdirs
+    WATCH_ICONS,  // Listed icon directory: files are indexed one by one
+    WATCH_STAMP,  // Stamped by the icon path cache, before any index exists
+};
+
+typedef struct {
+    int wd;
+    int kind;
+    int dir;  // icon_dir of a WATCH_ICONS directory, else -1
+    char* path;
+} dir_watch;
+
+static struct {
+    // Lookups hold it for reading, so the icon workers match names side by
+    // side; building, dropping or patching the index takes it for writing.
+    pthread_rwlock_t lock;
+    // Readers share the icon path cache and save_deadline: under a read
+    // lock they are touched only with this held too.
+    pthread_mutex_t cache_lock;
+    int built;
+    // Whether icon_path_cache has been opened for the current theme.
+    int cache_opened;
+    char* theme;  // Requested theme, NULL for the settings.ini default
+
+    icon_dir* dirs;
+    int n_dirs, dirs_cap;
+    icon_file* files;
+    int n_files, files_cap;
+    char* names;
+    size_t names_len, names_cap;
+    icon_cache* caches;
+    int n_caches, caches_cap;
+    // Open addressing table of the first file for each name, -1 if empty.
+    int32_t* slots;
+    uint32_t n_slots;
+    uint32_t n_used;
+
+    // Themes indexed, in order
+    char chain[MAX_THEMES][NAME_MAX + 1];
+    int n_chain;
+    // Directories the answers came from, watched by watch_main()
+    int inotify_fd;
+    dir_watch* watches;
+    int n_watches, watches_cap;
+    void (*on_change)(const char* names);
+    // Wakes watch_main() to schedule a deferred save; 0 when none is due.
+    int wake_fd;
+    int64_t save_deadline;
+} index_state = { .lock = PTHREAD_RWLOCK_INITIALIZER, .cache_lock = PTHREAD_MUTEX_INITIALIZER,
+                  .inotify_fd = -1, .wake_fd = -1 };
+
+static uint32_t hash_name(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int grow(void** array, int* cap, int needed, size_t item) {
+    if (needed <= *cap) return 0;
+    int new_cap = *cap ? *cap * 2 : 256;
+    while (new_cap < needed) new_cap *= 2;
+    void* grown = realloc(*array, new_cap * item);
+    if (!grown) return -1;
+    *array = grown;
+    *cap = new_cap;
+    return 0;
+}
+
+static int32_t find_slot(const char* name, size_t len, uint32_t hash) {
+    uint32_t mask = index_state.n_slots - 1;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        int32_t head = index_state.slots[i];
+        if (head < 0) return i;
+        const icon_file* f = &index_state.files[head];
+        const char* other = index_state.names + f->name;
+        if (f->hash == hash && strncmp(other, name, len) == 0 && other[len] == '\0') return i;
+    }
+}
+
+static int rehash() {
+    uint32_t n_slots = index_state.n_slots ? index_state.n_slots * 2 : 4096;
+    int32_t* old = index_state.slots;
+    uint32_t old_n = index_state.n_slots;
+    index_state.slots = malloc(n_slots * sizeof(int32_t));
+    if (!index_state.slots) {
+        index_state.slots = old;
+        return -1;
+    }
+    memset(index_state.slots, 0xff, n_slots * sizeof(int32_t));
+    index_state.n_slots = n_slots;
+    for (uint32_t i = 0; i < old_n; i++) {
+        if (old[i] < 0) continue;
+        const icon_file* f = &index_state.files[old[i]];
+        const char* name = index_state.names + f->name;
+        index_state.slots[find_slot(name, strlen(name), f->hash)] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+// Files with the same name are chained in directory order, which is theme
+// order and then the order of the theme's Directories key. Directories are
+// listed in that order, so building the index only ever appends.
+static void add_file(const char* name, size_t len, int dir, int extension, int maybe_link) {
+    if ((index_state.n_used + 1) * 2 > index_state.n_slots && rehash() != 0) return;
+    if (grow((void**)&index_state.files, &index_state.files_cap, index_state.n_files + 1,
+             sizeof(icon_file)) != 0) return;
+
+    uint32_t hash = hash_name(name, len);
+    int32_t slot = find_slot(name, len, hash);
+    int32_t head = index_state.slots[slot];
+    // A file that was deleted and comes back keeps its place.
+    for (int32_t id = head; id >= 0; id = index_state.files[id].next) {
+        icon_file* f = &index_state.files[id];
+        if (f->dir == dir && f->extension == extension) {
+            f->removed = 0;
+            return;
+        }
+    }
+    int32_t name_offset;
+    if (head >= 0) {
+        name_offset = index_state.files[head].name;
+    } else {
+        if (index_state.names_len + len + 1 > index_state.names_cap) {
+            size_t cap = index_state.names_cap ? index_state.names_cap * 2 : 1 << 16;
+            while (cap < index_state.names_len + len + 1) cap *= 2;
+            char* grown = realloc(index_state.names, cap);
+            if (!grown) return;
+            index_state.names = grown;
+            index_state.names_cap = cap;
+        }
+        name_offset = index_state.names_len;
+        memcpy(index_state.names + name_offset, name, len);
+        index_state.names[name_offset + len] = '\0';
+        index_state.names_len += len + 1;
+    }
+
+    int32_t id = index_state.n_files++;
+    icon_file* f = &index_state.files[id];
+    f->hash = hash;
+    f->name = name_offset;
+    f->dir = dir;
+    f->next = -1;
+    f->extension = extension;
+    f->maybe_link = maybe_link;
+    f->removed = 0;
+    if (head < 0) {
+        index_state.slots[slot] = id;
+        index_state.n_used++;
+    } else if (index_state.files[head].dir > dir) {
+        f->next = head;
+        index_state.slots[slot] = id;
+    } else {
+        int32_t next;
+        while ((next = index_state.files[head].next) >= 0 && index_state.files[next].dir <= dir) {
+            head = next;
+        }
+        f->next = next;
+        index_state.files[head].next = id;
+    }
+}
+
+static void remove_file(const char* name, size_t len, int dir, int extension) {
+    if (!index_state.n_slots) return;
+    int32_t id = index_state.slots[find_slot(name, len, hash_name(name, len))];
+    for (; id >= 0; id = index_state.files[id].next) {
+        icon_file* f = &index_state.files[id];
+        if (f->dir == dir && f->extension == extension) f->removed = 1;
+    }
+}
+
+static int extension_of(const char* name, size_t* stem) {
+    const char* dot = strrchr(name, '.');
+    if (!dot || dot == name) return -1;
+    for (int i = 0; i < N_EXTENSIONS; i++) {
+        if (strcasecmp(dot, extensions[i]) == 0) {
+            *stem = dot - name;
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int add_dir(const char* path, int theme, int type, int size, int min_size, int max_size,
+                   int threshold, int scale) {
+    if (grow((void**)&index_state.dirs, &index_state.dirs_cap, index_state.n_dirs + 1,
+             sizeof(icon_dir)) != 0) return -1;
+    int dir = index_state.n_dirs++;
+    index_state.dirs[dir] = (icon_dir){ strdup(path), theme, type, size, min_size, max_size,
+                                        threshold, scale };
+    return dir;
+}
+
+static void* watch_main(void* data);
+
+// Watch path for changes. Call with index_state.lock held for writing.
+// Failing to watch (no inotify, out of watches) only means changes go
+// unnoticed.
+static void add_watch(const char* path, int kind, int dir) {
+    if (index_state.inotify_fd < 0) {
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) return;
+        // Without it saves are not deferred but made right away.
+        index_state.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        pthread_t thread;
+        int failed = pthread_create(&thread, &attr, watch_main, (void*)(intptr_t)fd);
+        pthread_attr_destroy(&attr);
+        if (failed) {
+            close(fd);
+            if (index_state.wake_fd >= 0) close(index_state.wake_fd);
+            index_state.wake_fd = -1;
+            return;
+        }
+        index_state.inotify_fd = fd;
+    }
+    if (grow((void**)&index_state.watches, &index_state.watches_cap, index_state.n_watches + 1,
+             sizeof(dir_watch)) != 0) return;
+    int wd = inotify_add_watch(index_state.inotify_fd, path, WATCH_MASK);
+    if (wd < 0) return;
+    // The same directory reached twice (symlinked bases) keeps its first role.
+    for (int i = 0; i < index_state.n_watches; i++) {
+        if (index_state.watches[i].wd == wd) return;
+    }
+    char* copy = strdup(path);
+    if (!copy) return;
+    index_state.watches[index_state.n_watches++] = (dir_watch){ wd, kind, dir, copy };
+}
+
+static void watch_stamp(const char* path) {
+    add_watch(path, WATCH_STAMP, -1);
+}
+
+static void remove_watches() {
+    for (int i = 0; i < index_state.n_watches; i++) {
+        inotify_rm_watch(index_state.inotify_fd, index_state.watches[i].wd);
+        free(index_state.watches[i].path);
+    }
+    index_state.n_watches = 0;
+}
+
+static dir_watch* find_watch(int wd) {
+    for (int i = 0; i < index_state.n_watches; i++) {
+        if (index_state.watches[i].wd == wd) return &index_state.watches[i];
+    }
+    return NULL;
+}
+
+// List one directory into the index. Directories that do not exist cost a
+// single failed opendir().
+static void scan_dir(const char* path, int theme, int type, int size, int min_size, int max_size,
+                     int threshold, int scale) {
+    DIR* d = opendir(path);
+    if (!d) return;
+    icon_path_cache_stamp(path);
+    int dir = add_dir(path, theme, type, size, min_size, max_size, threshold, scale);
+    if (dir < 0) {
+        closedir(d);
+        return;
+    }
+    add_watch(path, WATCH_ICONS, dir);
+
+    struct dirent* e;
+    while ((e = readdir(d))) {
+        if (e->d_type != DT_REG && e->d_type != DT_LNK && e->d_type != DT_UNKNOWN) continue;
+        size_t stem;
+        int extension = extension_of(e->d_name, &stem);
+        if (extension < 0) continue;
+        add_file(e->d_name, stem, dir, extension, e->d_type != DT_REG);
+    }
+    closedir(d);
+}
+
+static int cache_u16(const icon_cache* c, uint32_t offset, uint32_t* out) {
+    if ((size_t)offset + 2 > c->size) return 0;
+    *out = (uint32_t)c->data[offset] << 8 | c->data[offset + 1];
+    return 1;
+}
+
+static int cache_u32(const icon_cache* c, uint32_t offset, uint32_t* out) {
+    if ((size_t)offset + 4 > c->size) return 0;
+    const uint8_t* p = c->data + offset;
+    *out = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    return 1;
+}
+
+// The NUL-terminated string at offset, or NULL if it runs off the end.
+static const char* cache_string(const icon_cache* c, uint32_t offset) {
+    if (offset >= c->size || !memchr(c->data + offset, '\0', c->size - offset)) return NULL;
+    return (const char*)c->data + offset;
+}
+
+// GTK's icon_name_hash(), over signed chars.
+static uint32_t cache_hash(const char* name, size_t len) {
+    const signed char* p = (const signed char*)name;
+    uint32_t h = len ? (uint32_t)p[0] : 0;
+    for (size_t i = 1; i < len; i++) h = (h << 5) - h + p[i];
+    return h;
+}
+
+// Map theme_dir/icon-theme.cache if it is at least as new as the directory
+// (as GTK requires; anything added since would be missing from it). Returns
+// the cache's position in index_state.caches, or -1.
+static int map_cache(const char* theme_dir, int theme) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/icon-theme.cache", theme_dir);
+    struct stat cache_st, dir_st;
+    if (stat(path, &cache_st) != 0 || stat(theme_dir, &dir_st) != 0) return -1;
+    if (cache_st.st_mtime < dir_st.st_mtime || cache_st.st_size < 12) return -1;
+    if (grow((void**)&index_state.caches, &index_state.caches_cap, index_state.n_caches + 1,
+             sizeof(icon_cache)) != 0) return -1;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    void* data = mmap(NULL, cache_st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+
+    icon_cache c = { data, cache_st.st_size, theme, 0, NULL };
+    uint32_t major, dir_list;
+    if (!cache_u16(&c, 0, &major) || major != 1 || !cache_u32(&c, 8, &dir_list) ||
+        !cache_u32(&c, dir_list, &c.n_dirs) || c.n_dirs > c.size / 4 ||
+        !(c.dirs = malloc((c.n_dirs ? c.n_dirs : 1) * sizeof(int32_t)))) {
+        munmap(data, cache_st.st_size);
+        return -1;
+    }
+    for (uint32_t i = 0; i < c.n_dirs; i++) c.dirs[i] = -1;
+    index_state.caches[index_state.n_caches] = c;
+    return index_state.n_caches++;
+}
+
+// Position of directory sub in the cache's directory list, or -1.
+static int cache_dir_index(const icon_cache* c, const char* sub) {
+    uint32_t dir_list, offset;
+    cache_u32(c, 8, &dir_list);
+    for (uint32_t i = 0; i < c->n_dirs; i++) {
+        if (!cache_u32(c, dir_list + 4 + 4 * i, &offset)) return -1;
+        const char* name = cache_string(c, offset);
+        if (name && strcmp(name, sub) == 0) return i;
+    }
+    return -1;
+}
+
+// Icon theme base directories, in spec order.
+static int base_dirs(char dirs[][PATH_MAX], int max) {
+    int n = 0;
+    const char* home = getenv("HOME");
+    const char* data_home = getenv("XDG_DATA_HOME");
+    const char* data_dirs = getenv("XDG_DATA_DIRS");
+    if (!data_dirs || !*data_dirs) data_dirs = "/usr/local/share:/usr/share";
+
+    if (home) snprintf(dirs[n++], PATH_MAX, "%s/.icons", home);
+    if (data_home && *data_home) snprintf(dirs[n++], PATH_MAX, "%s/icons", data_home);
+    else if (home) snprintf(dirs[n++], PATH_MAX, "%s/.local/share/icons", home);
+    const char* p = data_dirs;
+    while (*p && n < max - 3) {
+        size_t len = strcspn(p, ":");
+        if (len) snprintf(dirs[n++], PATH_MAX, "%.*s/icons", (int)len, p);
+        p += len + (p[len] == ':');
+    }
+    if (home) snprintf(dirs[n++], PATH_MAX, "%s/.local/share/flatpak/exports/share/icons", home);
+    snprintf(dirs[n++], PATH_MAX, "/var/lib/flatpak/exports/share/icons");
+    snprintf(dirs[n++], PATH_MAX, "/var/lib/snapd/desktop/icons");
+
+    // Drop duplicates (XDG_DATA_DIRS often repeats entries)
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+        int duplicate = 0;
+        for (int j = 0; j < kept && !duplicate; j++) duplicate = strcmp(dirs[i], dirs[j]) == 0;
+        if (!duplicate) {
+            if (kept != i) memcpy(dirs[kept], dirs[i], PATH_MAX);
+            kept++;
+        }
+    }
+    return kept;
+}
+
+static char* read_file(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* data = len >= 0 ? malloc(len + 1) : NULL;
+    if (data) data[fread(data, 1, len, f)] = '\0';
+    fclose(f);
+    return data;
+}
+
+// Value of key in [section] of an ini-style file, copied into out.
+static int ini_value(const char* data, const char* section, const char* key, char* out,
+                     size_t size) {
+    size_t section_len = strlen(section);
+    size_t key_len = strlen(key);
+    int in_section = 0;
+    for (const char* line = data; *line; line += strcspn(line, "\n") + (line[strcspn(line, "\n")] == '\n')) {
+        size_t len = strcspn(line, "\n");
+        if (line[0] == '[') {
+            in_section = len >= section_len + 2 && strncmp(line + 1, section, section_len) == 0 &&
+                         line[section_len + 1] == ']';
+            continue;
+        }
+        if (!in_section || len <= key_len || strncmp(line, key, key_len) != 0) continue;
+        const char* v = line + key_len;
+        while (*v == ' ' || *v == '\t') v++;
+        if (*v != '=') continue;
+        v++;
+        while (*v == ' ' || *v == '\t') v++;
+        size_t value_len = len - (v - line);
+        while (value_len && (v[value_len - 1] == ' ' || v[value_len - 1] == '\r')) value_len--;
+        if (value_len >= size) value_len = size - 1;
+        memcpy(out, v, value_len);
+        out[value_len] = '\0';
+        return 1;
+    }
+    return 0;
+}
+
+// Strip leading and trailing blanks in place, e.g. from a list item.
+static char* trim_blanks(char* s) {
+    while (*s == ' ' || *s == '\t') s++;
+    size_t len = strlen(s);
+    while (len && (s[len - 1] == ' ' || s[len - 1] == '\t')) s[--len] = '\0';
+    return s;
+}
+
+static int ini_int(const char* data, const char* section, const char* key, int fallback) {
+    char value[32];
+    return ini_value(data, section, key, value, sizeof(value)) ? atoi(value) : fallback;
+}
+
+static void default_theme(char* out, size_t size) {
+    char path[PATH_MAX];
+    const char* config = getenv("XDG_CONFIG_HOME");
+    const char* home = getenv("HOME");
+    if (config && *config) snprintf(path, sizeof(path), "%s/gtk-3.0/settings.ini", config);
+    else snprintf(path, sizeof(path), "%s/.config/gtk-3.0/settings.ini", home ? home : "");
+    char* data = read_file(path);
+    if (!data || !ini_value(data, "Settings", "gtk-icon-theme-name", out, size)) {
+        snprintf(out, size, "hicolor");
+    }
+    free(data);
+    // Values are sometimes quoted
+    size_t len = strlen(out);
+    if (len >= 2 && (out[0] == '"' || out[0] == '\'') && out[len - 1] == out[0]) {
+        memmove(out, out + 1, len - 2);
+        out[len - 2] = '\0';
+    }
+}
+
+static int chain_contains(char chain[][NAME_MAX + 1], int n, const char* name) {
+    for (int i = 0; i < n; i++) {
+        if (strcmp(chain[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+// Index one theme: parse the first index.theme found, then scan its
+// directories under every base directory. Appends inherited themes to chain.
+static void index_theme(char bases[][PATH_MAX], int n_bases, char chain[][NAME_MAX + 1],
+                        int* n_chain, int theme) {
+    char path[PATH_MAX];
+    char* data = NULL;
+    for (int i = 0; i < n_bases; i++) {
+        snprintf(path, sizeof(path), "%s/%s", bases[i], chain[theme]);
+        icon_path_cache_stamp(path);
+        add_watch(path, WATCH_THEME, -1);
+    }
+    for (int i = 0; i < n_bases && !data; i++) {
+        snprintf(path, sizeof(path), "%s/%s/index.theme", bases[i], chain[theme]);
+        data = read_file(path);
+    }
+    if (!data) return;
+    icon_path_cache_stamp(path);
+
+    char inherits[1024];
+    if (ini_value(data, "Icon Theme", "Inherits", inherits, sizeof(inherits))) {
+        for (char *save, *name = strtok_r(inherits, ",", &save); name;
+             name = strtok_r(NULL, ",", &save)) {
+            // "Inherits=Adwaita, gnome" is common
+            name = trim_blanks(name);
+            if (*name && *n_chain < MAX_THEMES - 1 && strlen(name) <= NAME_MAX &&
+                !chain_contains(chain, *n_chain, name)) {
+                strcpy(chain[(*n_chain)++], name);
+            }
+        }
+    }
+
+    static char directories[1 << 16];
+    int has_dirs = ini_value(data, "Icon Theme", "Directories", directories, sizeof(directories));
+    size_t used = has_dirs ? strlen(directories) : 0;
+    // Scaled directories follow, separated the same way
+    if (used + 1 < sizeof(directories)) {
+        directories[used] = ',';
+        if (ini_value(data, "Icon Theme", "ScaledDirectories", directories + used + 1,
+                      sizeof(directories) - used - 1)) {
+            has_dirs = 1;
+        } else {
+            directories[used] = '\0';
+        }
+    }
+
+    // Bases with a fresh cache are answered from it; the rest are scanned.
+    int caches[MAX_BASES];
+    for (int i = 0; i < n_bases; i++) {
+        snprintf(path, sizeof(path), "%s/%s", bases[i], chain[theme]);
+        caches[i] = has_dirs ? map_cache(path, theme) : -1;
+    }
+
+    for (char *save, *sub = strtok_r(directories, ",", &save); has_dirs && sub;
+         sub = strtok_r(NULL, ",", &save)) {
+        char type_name[32] = "Threshold";
+        ini_value(data, sub, "Type", type_name, sizeof(type_name));
+        int size = ini_int(data, sub, "Size", 0);
+        if (size <= 0) continue;
+        int type = strcmp(type_name, "Fixed") == 0      ? DIR_FIXED
+                   : strcmp(type_name, "Scalable") == 0 ? DIR_SCALABLE
+                                                        : DIR_THRESHOLD;
+        int min_size = ini_int(data, sub, "MinSize", size);
+        int max_size = ini_int(data, sub, "MaxSize", size);
+        int threshold = ini_int(data, sub, "Threshold", 2);
+        int scale = ini_int(data, sub, "Scale", 1);
+        // atoi() of a malformed value is 0, and sizes are divided by it
+        if (scale < 1) scale = 1;
+        for (int i = 0; i < n_bases; i++) {
+            snprintf(path, sizeof(path), "%s/%s/%s", bases[i], chain[theme], sub);
+            if (caches[i] < 0) {
+                scan_dir(path, theme, type, size, min_size, max_size, threshold, scale);
+                continue;
+            }
+            icon_cache* c = &index_state.caches[caches[i]];
+            int cached = cache_dir_index(c, sub);
+            if (cached >= 0) {
+                c->dirs[cached] = add_dir(path, theme, type, size, min_size, max_size, threshold, scale);
+            }
+        }
+    }
+    free(data);
+}
+
+static void current_theme(char* out, size_t size) {
+    if (index_state.theme) snprintf(out, size, "%s", index_state.theme);
+    else default_theme(out, size);
+}
+
+// Builds the index and records, for icon_path_cache, every path whose mtime
+// the results depend on: base and theme directories, index.theme files and
+// the directories that were listed.
+static void build_index() {
+    char bases[MAX_BASES][PATH_MAX];
+    int n_bases = base_dirs(bases, MAX_BASES);
+    icon_path_cache_clear_stamps();
+    remove_watches();
+    for (int i = 0; i < n_bases; i++) {
+        icon_path_cache_stamp(bases[i]);
+        add_watch(bases[i], WATCH_BASE, -1);
+    }
+
+    char chain[MAX_THEMES][NAME_MAX + 1];
+    int n_chain = 1;
+    current_theme(chain[0], sizeof(chain[0]));
+
+    // Inherited themes are appended while walking, so each stage is
+    // breadth-first over the Inherits graph: the theme, then hicolor, then
+    // the fallbacks.
+    int theme = 0;
+    for (int stage = 0; stage < 3; stage++) {
+        if (stage == 1 && !chain_contains(chain, n_chain, "hicolor")) {
+            strcpy(chain[n_chain++], "hicolor");
+        }
+        if (stage == 2) {
+            for (size_t i = 0; i < sizeof(fallback_themes) / sizeof(fallback_themes[0]); i++) {
+                if (n_chain < MAX_THEMES && !chain_contains(chain, n_chain, fallback_themes[i])) {
+                    strcpy(chain[n_chain++], fallback_themes[i]);
+                }
+            }
+        }
+        for (; theme < n_chain; theme++) index_theme(bases, n_bases, chain, &n_chain, theme);
+    }
+
+    // Unthemed icons
+    scan_dir("/usr/share/pixmaps", n_chain, DIR_SCALABLE, 0, 0, INT_MAX, 0, 1);
+    scan_dir("/usr/local/share/pixmaps", n_chain, DIR_SCALABLE, 0, 0, INT_MAX, 0, 1);
+    memcpy(index_state.chain, chain, sizeof(chain));
+    index_state.n_chain = n_chain;
+    index_state.built = 1;
+}
+
+static void clear_index() {
+    remove_watches();
+    for (int i = 0; i < index_state.n_dirs; i++) free(index_state.dirs[i].path);
+    free(index_state.dirs);
+    free(index_state.files);
+    free(index_state.names);
+    free(index_state.slots);
+    for (int i = 0; i < index_state.n_caches; i++) {
+        munmap((void*)index_state.caches[i].data, index_state.caches[i].size);
+        free(index_state.caches[i].dirs);
+    }
+    free(index_state.caches);
+    index_state.caches = NULL;
+    index_state.n_caches = index_state.caches_cap = 0;
+    index_state.dirs = NULL;
+    index_state.files = NULL;
+    index_state.names = NULL;
+    index_state.slots = NULL;
+    index_state.n_dirs = index_state.dirs_cap = 0;
+    index_state.n_files = index_state.files_cap = 0;
+    index_state.names_len = index_state.names_cap = 0;
+    index_state.n_slots = index_state.n_used = 0;
+    index_state.built = 0;
+}
+
+// The spec's DirectoryMatchesSize and DirectorySizeDistance.
+static int dir_matches(const icon_dir* d, int size, int scale) {
+    if (d->scale != scale) return 0;
+    switch (d->type) {
+    case DIR_FIXED: return d->size == size;
+    case DIR_SCALABLE: return d->min_size <= size && size <= d->max_size;
+    default: return d->size - d->threshold <= size && size <= d->size + d->threshold;
+    }
+}
+
+static int dir_distance(const icon_dir* d, int size, int scale) {
+    int wanted = size * scale;
+    int low, high;
+    switch (d->type) {
+    case DIR_FIXED: low = high = d->size; break;
+    case DIR_SCALABLE: low = d->min_size; high = d->max_size; break;
+    default: low = d->size - d->threshold; high = d->size + d->threshold; break;
+    }
+    low *= d->scale;
+    high = high == INT_MAX ? INT_MAX : high * d->scale;
+    if (wanted < low) return low - wanted;
+    if (wanted > high) return wanted - high;
+    return 0;
+}
+
+// The largest pixel size a directory renders without upscaling.
+static int dir_max_pixels(const icon_dir* d) {
+    int high = d->type == DIR_FIXED      ? d->size
+               : d->type == DIR_SCALABLE ? d->max_size
+                                         : d->size + d->threshold;
+    return high > INT_MAX / d->scale ? INT_MAX : high * d->scale;
+}
+
+typedef struct {
+    int dir;  // -1 while nothing matched
+    int extension;
+    int maybe_link;
+    int theme;
+    int exact;
+    int covers;
+    int distance;
+} icon_match;
+
+// Keep the better of best and dir/extension: the earliest theme wins, then
+// an exact size match, then a directory that reaches the wanted pixel size
+// (the smallest such, scalable ones included) over one that would have to
+// be scaled up, then the closest size, then the preferred format. Picking
+// the closest size regardless of direction, as the spec does, would blur;
+// picking the biggest wastes decode time and memory.
+static void consider(icon_match* best, int dir, int extension, int maybe_link, int size,
+                     int scale) {
+    const icon_dir* d = &index_state.dirs[dir];
+    int exact = dir_matches(d, size, scale);
+    int covers = exact || dir_max_pixels(d) >= size * scale;
+    int distance = exact ? 0 : dir_distance(d, size, scale);
+    if (best->dir >= 0 &&
+        (d->theme != best->theme ? d->theme > best->theme
+         : exact != best->exact  ? exact < best->exact
+         : covers != best->covers ? covers < best->covers
+         : distance != best->distance ? distance > best->distance
+                                      : extension >= best->extension)) {
+        return;
+    }
+    *best = (icon_match){ dir, extension, maybe_link, d->theme, exact, covers, distance };
+}
+
+static void match_files(icon_match* best, const char* name, size_t len, int only_extension,
+                        int size, int scale) {
+    if (!index_state.n_slots) return;
+    int32_t id = index_state.slots[find_slot(name, len, hash_name(name, len))];
+    for (; id >= 0; id = index_state.files[id].next) {
+        const icon_file* f = &index_state.files[id];
+        if (f->removed || (only_extension >= 0 && f->extension != only_extension)) continue;
+        // Files are in theme order, so nothing later can beat a match.
+        if (best->dir >= 0 && index_state.dirs[f->dir].theme > best->theme) break;
+        consider(best, f->dir, f->extension, f->maybe_link, size, scale);
+    }
+}
+
+static void match_cache(icon_match* best, const icon_cache* c, const char* name, size_t len,
+                        int only_extension, int size, int scale) {
+    // Cache flags in the order of our extensions table
+    static const uint32_t flags_of[] = { CACHE_HAS_PNG, CACHE_HAS_SVG, CACHE_HAS_XPM };
+    uint32_t hash_offset, n_buckets, icon;
+    if (!cache_u32(c, 4, &hash_offset) || !cache_u32(c, hash_offset, &n_buckets) || !n_buckets ||
+        !cache_u32(c, hash_offset + 4 + 4 * (cache_hash(name, len) % n_buckets), &icon)) {
+        return;
+    }
+    // The step limit guards against cycles in a corrupt file.
+    for (int steps = 0; icon != CACHE_NONE && steps < 4096; steps++) {
+        uint32_t next, name_offset, images, n_images;
+        if (!cache_u32(c, icon, &next) || !cache_u32(c, icon + 4, &name_offset) ||
+            !cache_u32(c, icon + 8, &images)) {
+            return;
+        }
+        const char* other = cache_string(c, name_offset);
+        if (other && strncmp(other, name, len) == 0 && other[len] == '\0') {
+            if (!cache_u32(c, images, &n_images)) return;
+            for (uint32_t i = 0; i < n_images; i++) {
+                uint32_t dir, flags;
+                if (!cache_u16(c, images + 4 + 8 * i, &dir) ||
+                    !cache_u16(c, images + 6 + 8 * i, &flags)) {
+                    return;
+                }
+                if (dir >= c->n_dirs || c->dirs[dir] < 0) continue;
+                for (int e = 0; e < 3; e++) {
+                    if ((flags & flags_of[e]) && (only_extension < 0 || only_extension == e)) {
+                        consider(best, c->dirs[dir], e, 1, size, scale);
+                    }
+                }
+            }
+            return;
+        }
+        icon = next;
+    }
+}
+
+static icon_match best_match(const char* name, size_t len, int only_extension, int size,
+                             int scale) {
+    icon_match best = { .dir = -1 };
+    match_files(&best, name, len, only_extension, size, scale);
+    for (int i = 0; i < index_state.n_caches; i++) {
+        const icon_cache* c = &index_state.caches[i];
+        if (best.dir >= 0 && c->theme > best.theme) break;
+        match_cache(&best, c, name, len, only_extension, size, scale);
+    }
+    return best;
+}
+
+// Open the icon path cache, or build the index once that was done. Call
+// with index_state.lock held for writing.
+static void prepare_lookup() {
+    if (!index_state.cache_opened) {
+        char theme[NAME_MAX + 1];
+        current_theme(theme, sizeof(theme));
+        // Until the index is built, changes are noticed through the
+        // directories the cached answers depend on.
+        if (icon_path_cache_open(theme) && !index_state.built) {
+            icon_path_cache_each_stamp(watch_stamp);
+        }
+        index_state.cache_opened = 1;
+    } else if (!index_state.built) {
+        build_index();
+    }
+}
+
+// Answer from the persistent icon path cache, so a warm start does not
+// build the index at all. Returns 1 on a hit and sets *result (NULL for
+// names known to have no icon). Call with index_state.lock held.
+static int find_cached(const char* icon_name, int size, int scale, char** result) {
+    const char* cached;
+    pthread_mutex_lock(&index_state.cache_lock);
+    int hit = icon_path_cache_find(icon_name, size, scale, &cached);
+    if (hit) *result = cached ? strdup(cached) : NULL;
+    pthread_mutex_unlock(&index_state.cache_lock);
+    return hit;
+}
+
+char* icon_theme_lookup(const char* icon_name, int size, int scale) {
+    if (!icon_name || !*icon_name || strchr(icon_name, '/')) return NULL;
+    if (scale < 1) scale = 1;
+
+    // Opening the cache and building the index need the write lock; the
+    // lookup itself runs under the read lock, which is retaken afterwards
+    // and everything checked again, since a theme change or filesystem
+    // event may have dropped the index in between.
+    char* result;
+    for (;;) {
+        pthread_rwlock_rdlock(&index_state.lock);
+        if (index_state.cache_opened) {
+            if (find_cached(icon_name, size, scale, &result)) {
+                pthread_rwlock_unlock(&index_state.lock);
+                return result;
+            }
+            if (index_state.built) break;
+        }
+        pthread_rwlock_unlock(&index_state.lock);
+        pthread_rwlock_wrlock(&index_state.lock);
+        prepare_lookup();
+        pthread_rwlock_unlock(&index_state.lock);
+    }
+
+    size_t len = strlen(icon_name);
+    icon_match match = best_match(icon_name, len, -1, size, scale);
+    if (match.dir < 0) {
+        // "firefox.png" style names: look up the stem with that extension
+        size_t stem;
+        int extension = extension_of(icon_name, &stem);
+        if (extension >= 0) {
+            match = best_match(icon_name, stem, extension, size, scale);
+            len = stem;
+        }
+    }
+
+    result = NULL;
+    if (match.dir >= 0) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%.*s%s", index_state.dirs[match.dir].path, (int)len,
+                 icon_name, extensions[match.extension]);
+        result = match.maybe_link ? realpath(path, NULL) : NULL;
+        if (!result) result = strdup(path);
+    }
+    pthread_mutex_lock(&index_state.cache_lock);
+    icon_path_cache_add(icon_name, size, scale, result);
+    pthread_mutex_unlock(&index_state.cache_lock);
+    pthread_rwlock_unlock(&index_state.lock);
+    return result;
+}
+
+static int64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void icon_theme_save_cache() {
+    pthread_rwlock_rdlock(&index_state.lock);
+    pthread_mutex_lock(&index_state.cache_lock);
+    icon_path_cache_save();
+    pthread_mutex_unlock(&index_state.cache_lock);
+    pthread_rwlock_unlock(&index_state.lock);
+}
+
+void icon_theme_save_cache_later() {
+    pthread_rwlock_rdlock(&index_state.lock);
+    pthread_mutex_lock(&index_state.cache_lock);
+    if (index_state.wake_fd < 0) {
+        icon_path_cache_save();
+    } else if (!index_state.save_deadline) {
+        index_state.save_deadline = now_ms() + SAVE_DELAY_MS;
+        uint64_t one = 1;
+        if (write(index_state.wake_fd, &one, sizeof(one)) < 0) {
+            index_state.save_deadline = 0;
+            icon_path_cache_save();
+        }
+    }
+    pthread_mutex_unlock(&index_state.cache_lock);
+    pthread_rwlock_unlock(&index_state.lock);
+}
+
+int icon_theme_set_name(const char* theme) {
+    if (theme && !*theme) theme = NULL;
+    pthread_rwlock_wrlock(&index_state.lock);
+    char before[NAME_MAX + 1], after[NAME_MAX + 1];
+    current_theme(before, sizeof(before));
+    free(index_state.theme);
+    index_state.theme = theme ? strdup(theme) : NULL;
+    current_theme(after, sizeof(after));
+    // Only what depends on the theme is dropped, and only if it changed.
+    int changed = strcmp(before, after) != 0;
+    if (changed) {
+        clear_index();
+        icon_path_cache_close();
+        index_state.cache_opened = 0;
+    }
+    pthread_rwlock_unlock(&index_state.lock);
+    return changed;
+}
+
+char* icon_theme_name() {
+    char name[NAME_MAX + 1];
+    pthread_rwlock_rdlock(&index_state.lock);
+    current_theme(name, sizeof(name));
+    pthread_rwlock_unlock(&index_state.lock);
+    return strdup(name);
+}
+
+void icon_theme_watch_changes(void (*callback)(const char* names)) {
+    pthread_rwlock_wrlock(&index_state.lock);
+    index_state.on_change = callback;
+    pthread_rwlock_unlock(&index_state.lock);
+}
+
+// Whether an event invalidates more than the file it names: themes or
+// icon directories appearing, index.theme or icon-theme.cache changing.
+static int is_structural(const dir_watch* w, uint32_t mask, const char* name) {
+    if (mask & IN_ISDIR) {
+        switch (w->kind) {
+        case WATCH_BASE:
+            for (int i = 0; i < index_state.n_chain; i++) {
+                if (strcmp(index_state.chain[i], name) == 0) return 1;
+            }
+            return 0;
+        case WATCH_ICONS: return 0;
+        default: return 1;
+        }
+    }
+    return (w->kind == WATCH_THEME || w->kind == WATCH_STAMP) &&
+           (strcmp(name, "index.theme") == 0 || strcmp(name, "icon-theme.cache") == 0);
+}
+
+// Append icon to the newline-separated list in *names unless it is there.
+static void add_changed(char** names, size_t* len, const char* icon) {
+    size_t icon_len = strlen(icon);
+    for (const char* p = *names; p && *p; p += strcspn(p, "\n") + 1) {
+        if (strcspn(p, "\n") == icon_len && strncmp(p, icon, icon_len) == 0) return;
+    }
+    char* grown = realloc(*names, *len + icon_len + 2);
+    if (!grown) return;
+    memcpy(grown + *len, icon, icon_len);
+    grown[*len + icon_len] = '\n';
+    grown[*len + icon_len + 1] = '\0';
+    *names = grown;
+    *len += icon_len + 1;
+}
+
+// Apply one event. Call with index_state.lock held for writing. Returns 1
+// if the whole index has to go.
+static int apply_event(const struct inotify_event* e, char** names, size_t* names_len) {
+    if (e->mask & IN_Q_OVERFLOW) return 1;
+    dir_watch* w = find_watch(e->wd);
+    if (!w || (e->mask & IN_IGNORED)) return 0;
+    if (e->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) return 1;
+    const char* name = e->len ? e->name : "";
+    if (is_structural(w, e->mask, name)) return 1;
+
+    size_t stem;
+    int extension = extension_of(name, &stem);
+    if (extension < 0 || (e->mask & IN_ISDIR) || w->kind == WATCH_BASE || w->kind == WATCH_THEME) {
+        return 0;
+    }
+    if (w->kind == WATCH_ICONS && index_state.built) {
+        if (e->mask & (IN_CREATE | IN_MOVED_TO)) add_file(name, stem, w->dir, extension, 1);
+        else if (e->mask & (IN_DELETE | IN_MOVED_FROM)) remove_file(name, stem, w->dir, extension);
+        // The stamps are complete only once the index was built.
+        icon_path_cache_stamp(w->path);
+    }
+    char icon[NAME_MAX + 1];
+    snprintf(icon, sizeof(icon), "%.*s", (int)stem, name);
+    icon_path_cache_forget(icon);
+    add_changed(names, names_len, icon);
+    return 0;
+}
+
+static void apply_events(const char* events, size_t len) {
+    char* names = NULL;
+    size_t names_len = 0;
+    int everything = 0;
+
+    pthread_rwlock_wrlock(&index_state.lock);
+    for (size_t offset = 0; offset < len && !everything;) {
+        const struct inotify_event* e = (const struct inotify_event*)(events + offset);
+        everything = apply_event(e, &names, &names_len);
+        offset += sizeof(struct inotify_event) + e->len;
+    }
+    if (everything) {
+        // Rebuilt lazily, like after a theme change.
+        clear_index();
+        icon_path_cache_close();
+        index_state.cache_opened = 0;
+    } else if (names) {
+        icon_path_cache_save();
+    }
+    void (*callback)(const char*) = index_state.on_change;
+    pthread_rwlock_unlock(&index_state.lock);
+
+    if (callback && (everything || names)) callback(everything ? NULL : names);
+    free(names);
+}
+
+// Save the icon path cache if icon_theme_save_cache_later() asked for it and
+// the delay ran out. Returns the milliseconds left otherwise, -1 if no save
+// is due.
+static int64_t save_if_due() {
+    pthread_rwlock_rdlock(&index_state.lock);
+    pthread_mutex_lock(&index_state.cache_lock);
+    int64_t left = -1;
+    if (index_state.save_deadline) {
+        left = index_state.save_deadline - now_ms();
+        if (left <= 0) {
+            icon_path_cache_save();
+            index_state.save_deadline = 0;
+            left = -1;
+        }
+    }
+    pthread_mutex_unlock(&index_state.cache_lock);
+    pthread_rwlock_unlock(&index_state.lock);
+    return left;
+}
+
+// Reads events from the inotify descriptor for the life of the process and
+// applies them in batches: from the first event on, for BATCH_MS, or sooner
+// when MAX_BATCH_BYTES piled up. Also makes the saves deferred by
+// icon_theme_save_cache_later().
+static void* watch_main(void* data) {
+    int fd = (int)(intptr_t)data;
+    char* batch = NULL;
+    size_t len = 0, cap = 0;
+    int64_t deadline = 0;
+    struct pollfd p[2] = { { fd, POLLIN, 0 }, { index_state.wake_fd, POLLIN, 0 } };
+    for (;;) {
+        int64_t timeout = save_if_due();
+        if (len) {
+            int64_t left = deadline - now_ms();
+            if (left < 0) left = 0;
+            if (timeout < 0 || left < timeout) timeout = left;
+        }
+        int ready = poll(p, p[1].fd >= 0 ? 2 : 1, (int)timeout);
+        if (ready < 0 && errno != EINTR) break;
+        if (ready > 0 && (p[1].revents & POLLIN)) {
+            // Only wakes the loop for save_if_due()
+            uint64_t count;
+            ssize_t n = read(p[1].fd, &count, sizeof(count));
+            (void)n;
+        }
+        if (ready > 0 && (p[0].revents & POLLIN)) {
+            char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n > 0 && len + n > cap) {
+                size_t new_cap = cap ? cap * 2 : 16384;
+                while (new_cap < len + n) new_cap *= 2;
+                char* grown = realloc(batch, new_cap);
+                if (grown) {
+                    batch = grown;
+                    cap = new_cap;
+                }
+            }
+            if (n > 0 && len + n <= cap) {
+                if (!len) deadline = now_ms() + BATCH_MS;
+                memcpy(batch + len, buf, n);
+                len += n;
+            }
+        }
+        if (len && (now_ms() >= deadline || len >= MAX_BATCH_BYTES)) {
+            apply_events(batch, len);
+            len = 0;
+        }
+    }
+    free(batch);
+    return NULL;
+}
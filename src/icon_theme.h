@@ -0,0 +1,46 @@
+#ifndef ICON_THEME_H
+#define ICON_THEME_H
+
+// Internal to libicon_loader: an in-memory index of the icon theme in use,
+// its Inherits chain, hicolor and the pixmaps directories. Each theme's
+// index.theme is parsed once. Where a theme directory has an up-to-date
+// icon-theme.cache it is mapped and queried in place; otherwise each icon
+// directory is listed once into a hash table. Lookups touch the filesystem
+// only to resolve symlinked files. The directories are watched with
+// inotify: icon files appearing or going away update the index in place,
+// while new themes or icon directories and rewritten index.theme or
+// icon-theme.cache files drop it to be rebuilt on the next lookup.
+
+// Find the file for icon_name at size logical pixels and an integer scale
+// (the device pixel ratio, rounded up). Follows the icon theme spec's size
+// matching, except that among inexact matches the smallest one at least
+// size * scale pixels large (or a scalable one) beats smaller ones. Returns
+// a malloc'd absolute path with symlinks resolved, or NULL. icon_name may
+// carry a file extension. Answers from the persistent icon path cache when
+// it is current, else builds the index on first use. Thread-safe, and
+// lookups from several threads run side by side.
+char* icon_theme_lookup(const char* icon_name, int size, int scale);
+
+// Persist results looked up since the last save to the icon path cache
+// (see icon_path_cache.h). Cheap when nothing new was looked up.
+void icon_theme_save_cache();
+// The same for callers looking up one name at a time: the save is made
+// on the watcher thread shortly after, covering every lookup up to then.
+void icon_theme_save_cache_later();
+
+// Use the named theme from now on; NULL or "" picks the GTK 3 settings.ini
+// theme, else hicolor. Returns 1 if that changed the theme in effect, in
+// which case the index and the icon path cache are dropped and rebuilt
+// lazily.
+int icon_theme_set_name(const char* theme);
+
+// The theme in effect, malloc'd.
+char* icon_theme_name();
+
+// Call callback from the watcher thread after filesystem changes were
+// applied, with the affected icon names separated by newlines, or NULL if
+// any icon may have changed. Results for those names were dropped from the
+// icon path cache. NULL stops the calls.
+void icon_theme_watch_changes(void (*callback)(const char* names));
+
+#endif
@@ -0,0 +1,82 @@
+#include "icon_worker.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Lookups are mostly waiting on the disk; a few threads overlap that
+// without competing with the UI for cores.
+#define MAX_WORKERS 4
+
+typedef struct worker_task {
+    void (*run)(void* arg);
+    void* arg;
+    struct worker_task* next;
+} worker_task;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    worker_task* head;
+    worker_task* tail;
+    int threads;
+} pool = { .lock = PTHREAD_MUTEX_INITIALIZER, .ready = PTHREAD_COND_INITIALIZER };
+
+static void* worker_main(void* data) {
+    (void)data;
+    for (;;) {
+        pthread_mutex_lock(&pool.lock);
+        while (!pool.head) pthread_cond_wait(&pool.ready, &pool.lock);
+        worker_task* task = pool.head;
+        pool.head = task->next;
+        if (!pool.head) pool.tail = NULL;
+        pthread_mutex_unlock(&pool.lock);
+
+        task->run(task->arg);
+        free(task);
+    }
+    return NULL;
+}
+
+// Call with pool.lock held.
+static void start_workers() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int wanted = cpus > 1 ? (int)(cpus - 1) : 1;
+    if (wanted > MAX_WORKERS) wanted = MAX_WORKERS;
+    while (pool.threads < wanted) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        pthread_t thread;
+        int failed = pthread_create(&thread, &attr, worker_main, NULL);
+        pthread_attr_destroy(&attr);
+        if (failed) {
+            fprintf(stderr, "icon worker: cannot start thread\n");
+            break;
+        }
+        pool.threads++;
+    }
+}
+
+int icon_worker_submit(void (*task)(void* arg), void* arg) {
+    worker_task* t = malloc(sizeof(worker_task));
+    if (!t) return -1;
+    t->run = task;
+    t->arg = arg;
+    t->next = NULL;
+
+    pthread_mutex_lock(&pool.lock);
+    if (pool.threads == 0) start_workers();
+    if (pool.threads == 0) {
+        pthread_mutex_unlock(&pool.lock);
+        free(t);
+        return -1;
+    }
+    if (pool.tail) pool.tail->next = t;
+    else pool.head = t;
+    pool.tail = t;
+    pthread_cond_signal(&pool.ready);
+    pthread_mutex_unlock(&pool.lock);
+    return 0;
+}
@@ -0,0 +1,12 @@
+#ifndef ICON_WORKER_H
+#define ICON_WORKER_H
+
+// Internal to libicon_loader: a small pool of detached threads, started on
+// first use, that runs icon lookups and renderings off the caller's
+// thread. Tasks run in submission order, several at a time.
+
+// Run task(arg) on a worker thread. Returns 0 if queued, -1 if no worker
+// could be started or memory ran out (task is then not called).
+int icon_worker_submit(void (*task)(void* arg), void* arg);
+
+#endif
@@ -0,0 +1,580 @@
+#include "wayland_tracker.h"
+
+#include "ext-foreign-toplevel-list-v1-client-protocol.h"
+#include "wlr-foreign-toplevel-management-unstable-v1-client-protocol.h"
+#include <wayland-client.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// One toplevel. Protocol events fill the pending fields and done applies
+// them, so a burst of changes is reported as a single event.
+typedef struct {
+    uint32_t id;
+    struct zwlr_foreign_toplevel_handle_v1* wlr;
+    struct ext_foreign_toplevel_handle_v1* ext;
+    char* title;
+    char* app_id;
+    uint32_t state;
+    int activated;
+    int reported;
+    char* pending_title;
+    char* pending_app_id;
+    uint32_t pending_state;
+    int pending_activated;
+} toplevel;
+
+static struct {
+    struct wl_display* display;
+    struct wl_registry* registry;
+    struct wl_seat* seat;
+    struct zwlr_foreign_toplevel_manager_v1* wlr_manager;
+    struct ext_foreign_toplevel_list_v1* ext_list;
+    uint32_t wlr_name;
+    uint32_t wlr_version;
+    uint32_t ext_name;
+    uint32_t seat_name;
+    window_event_callback callback;
+    pthread_t thread;
+    int wake_pipe[2];
+    // Read by callers on other threads to pick the backend.
+    atomic_int running;
+    atomic_int lost;  // The thread ended on its own; awaits stop
+    // Sorted by id; ids only grow, so appending keeps the order.
+    toplevel** toplevels;
+    int count;
+    int capacity;
+    uint32_t next_id;
+    uint32_t active;
+} wl = { .wake_pipe = { -1, -1 }, .next_id = 1 };
+
+// Guards the toplevel list: the tracker thread edits it while dispatching,
+// callers read it for lists and actions.
+static pthread_mutex_t wl_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int strings_equal(const char* a, const char* b) {
+    if (!a || !b) return a == b;
+    return strcmp(a, b) == 0;
+}
+
+static window_record record_of(const toplevel* t) {
+    // app_id plays the role of WM_CLASS; it usually is the desktop file ID.
+    return (window_record){
+        .window = t->id,
+        .pid = 0,
+        .desktop = -1,
+        .state = t->state,
+        .title = t->title,
+        .wm_class = t->app_id,
+        .wm_instance = NULL,
+    };
+}
+
+static void emit_event(int type, const toplevel* t) {
+    window_record record = record_of(t);
+    window_event* event = new_window_event(type, &record);
+    if (event) wl.callback(event);
+}
+
+static void emit_focus(uint32_t id) {
+    window_event* event = calloc(1, sizeof(window_event));
+    if (!event) return;
+    event->type = WINDOW_EVENT_FOCUS;
+    event->window.window = id;
+    event->window.desktop = -1;
+    wl.callback(event);
+}
+
+// Call with wl_lock held.
+static int find_toplevel(uint32_t id) {
+    int lo = 0, hi = wl.count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (wl.toplevels[mid]->id < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < wl.count && wl.toplevels[lo]->id == id ? lo : -1;
+}
+
+static toplevel* add_toplevel() {
+    if (wl.count == wl.capacity) {
+        int capacity = wl.capacity ? wl.capacity * 2 : 32;
+        toplevel** toplevels = realloc(wl.toplevels, capacity * sizeof(toplevel*));
+        if (!toplevels) return NULL;
+        wl.toplevels = toplevels;
+        wl.capacity = capacity;
+    }
+    toplevel* t = calloc(1, sizeof(toplevel));
+    if (!t) return NULL;
+    t->id = wl.next_id++;
+    wl.toplevels[wl.count++] = t;
+    return t;
+}
+
+static void free_toplevel(toplevel* t) {
+    if (t->wlr) zwlr_foreign_toplevel_handle_v1_destroy(t->wlr);
+    if (t->ext) ext_foreign_toplevel_handle_v1_destroy(t->ext);
+    free(t->title);
+    free(t->app_id);
+    free(t->pending_title);
+    free(t->pending_app_id);
+    free(t);
+}
+
+static void remove_toplevel(toplevel* t) {
+    int slot = find_toplevel(t->id);
+    if (slot >= 0) {
+        memmove(&wl.toplevels[slot], &wl.toplevels[slot + 1],
+                (wl.count - slot - 1) * sizeof(toplevel*));
+        wl.count--;
+    }
+    if (t->reported) emit_event(WINDOW_EVENT_REMOVED, t);
+    if (wl.active == t->id) {
+        wl.active = 0;
+        emit_focus(0);
+    }
+    free_toplevel(t);
+}
+
+static void set_pending(char** slot, const char* value) {
+    free(*slot);
+    *slot = strdup(value ? value : "");
+}
+
+static void apply_pending(toplevel* t) {
+    int changed = 0;
+    if (t->pending_title) {
+        changed |= !strings_equal(t->title, t->pending_title);
+        free(t->title);
+        t->title = t->pending_title;
+        t->pending_title = NULL;
+    }
+    if (t->pending_app_id) {
+        changed |= !strings_equal(t->app_id, t->pending_app_id);
+        free(t->app_id);
+        t->app_id = t->pending_app_id;
+        t->pending_app_id = NULL;
+    }
+    if (t->pending_state != t->state) {
+        changed = 1;
+        t->state = t->pending_state;
+    }
+
+    if (!t->reported) {
+        t->reported = 1;
+        emit_event(WINDOW_EVENT_ADDED, t);
+    } else if (changed) {
+        emit_event(WINDOW_EVENT_CHANGED, t);
+    }
+
+    if (t->pending_activated != t->activated) {
+        t->activated = t->pending_activated;
+        if (t->activated && wl.active != t->id) {
+            wl.active = t->id;
+            emit_focus(t->id);
+        } else if (!t->activated && wl.active == t->id) {
+            wl.active = 0;
+            emit_focus(0);
+        }
+    }
+}
+
+// zwlr_foreign_toplevel_handle_v1
+
+static void wlr_title(void* data, struct zwlr_foreign_toplevel_handle_v1* handle,
+                      const char* title) {
+    (void)handle;
+    set_pending(&((toplevel*)data)->pending_title, title);
+}
+
+static void wlr_app_id(void* data, struct zwlr_foreign_toplevel_handle_v1* handle,
+                       const char* app_id) {
+    (void)handle;
+    set_pending(&((toplevel*)data)->pending_app_id, app_id);
+}
+
+static void wlr_output_enter(void* data, struct zwlr_foreign_toplevel_handle_v1* handle,
+                             struct wl_output* output) {
+    (void)data;
+    (void)handle;
+    (void)output;
+}
+
+static void wlr_output_leave(void* data, struct zwlr_foreign_toplevel_handle_v1* handle,
+                             struct wl_output* output) {
+    (void)data;
+    (void)handle;
+    (void)output;
+}
+
+static void wlr_state(void* data, struct zwlr_foreign_toplevel_handle_v1* handle,
+                      struct wl_array* states) {
+    (void)handle;
+    toplevel* t = data;
+    uint32_t state = 0;
+    int activated = 0;
+    uint32_t* s;
+    wl_array_for_each(s, states) {
+        switch (*s) {
+        case ZWLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MINIMIZED:
+            state |= WINDOW_STATE_HIDDEN;
+            break;
+        case ZWLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_FULLSCREEN:
+            state |= WINDOW_STATE_FULLSCREEN;
+            break;
+        case ZWLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED:
+            activated = 1;
+            break;
+        }
+    }
+    t->pending_state = state;
+    t->pending_activated = activated;
+}
+
+static void wlr_done(void* data, struct zwlr_foreign_toplevel_handle_v1* handle) {
+    (void)handle;
+    apply_pending(data);
+}
+
+static void wlr_closed(void* data, struct zwlr_foreign_toplevel_handle_v1* handle) {
+    (void)handle;
+    remove_toplevel(data);
+}
+
+static void wlr_parent(void* data, struct zwlr_foreign_toplevel_handle_v1* handle,
+                       struct zwlr_foreign_toplevel_handle_v1* parent) {
+    (void)data;
+    (void)handle;
+    (void)parent;
+}
+
+static const struct zwlr_foreign_toplevel_handle_v1_listener wlr_handle_listener = {
+    .title = wlr_title,
+    .app_id = wlr_app_id,
+    .output_enter = wlr_output_enter,
+    .output_leave = wlr_output_leave,
+    .state = wlr_state,
+    .done = wlr_done,
+    .closed = wlr_closed,
+    .parent = wlr_parent,
+};
+
+static void wlr_toplevel(void* data, struct zwlr_foreign_toplevel_manager_v1* manager,
+                         struct zwlr_foreign_toplevel_handle_v1* handle) {
+    (void)data;
+    (void)manager;
+    toplevel* t = add_toplevel();
+    if (!t) {
+        zwlr_foreign_toplevel_handle_v1_destroy(handle);
+        return;
+    }
+    t->wlr = handle;
+    zwlr_foreign_toplevel_handle_v1_add_listener(handle, &wlr_handle_listener, t);
+}
+
+static void wlr_finished(void* data, struct zwlr_foreign_toplevel_manager_v1* manager) {
+    (void)data;
+    zwlr_foreign_toplevel_manager_v1_destroy(manager);
+    wl.wlr_manager = NULL;
+}
+
+static const struct zwlr_foreign_toplevel_manager_v1_listener wlr_manager_listener = {
+    .toplevel = wlr_toplevel,
+    .finished = wlr_finished,
+};
+
+// ext_foreign_toplevel_handle_v1
+
+static void ext_closed(void* data, struct ext_foreign_toplevel_handle_v1* handle) {
+    (void)handle;
+    remove_toplevel(data);
+}
+
+static void ext_done(void* data, struct ext_foreign_toplevel_handle_v1* handle) {
+    (void)handle;
+    apply_pending(data);
+}
+
+static void ext_title(void* data, struct ext_foreign_toplevel_handle_v1* handle,
+                      const char* title) {
+    (void)handle;
+    set_pending(&((toplevel*)data)->pending_title, title);
+}
+
+static void ext_app_id(void* data, struct ext_foreign_toplevel_handle_v1* handle,
+                       const char* app_id) {
+    (void)handle;
+    set_pending(&((toplevel*)data)->pending_app_id, app_id);
+}
+
+static void ext_identifier(void* data, struct ext_foreign_toplevel_handle_v1* handle,
+                           const char* identifier) {
+    (void)data;
+    (void)handle;
+    (void)identifier;
+}
+
+static const struct ext_foreign_toplevel_handle_v1_listener ext_handle_listener = {
+    .closed = ext_closed,
+    .done = ext_done,
+    .title = ext_title,
+    .app_id = ext_app_id,
+    .identifier = ext_identifier,
+};
+
+static void ext_toplevel(void* data, struct ext_foreign_toplevel_list_v1* list,
+                         struct ext_foreign_toplevel_handle_v1* handle) {
+    (void)data;
+    (void)list;
+    toplevel* t = add_toplevel();
+    if (!t) {
+        ext_foreign_toplevel_handle_v1_destroy(handle);
+        return;
+    }
+    t->ext = handle;
+    ext_foreign_toplevel_handle_v1_add_listener(handle, &ext_handle_listener, t);
+}
+
+static void ext_finished(void* data, struct ext_foreign_toplevel_list_v1* list) {
+    (void)data;
+    ext_foreign_toplevel_list_v1_destroy(list);
+    wl.ext_list = NULL;
+}
+
+static const struct ext_foreign_toplevel_list_v1_listener ext_list_listener = {
+    .toplevel = ext_toplevel,
+    .finished = ext_finished,
+};
+
+// wl_registry: only note the globals here. They are bound after the initial
+// roundtrip, so no toplevel event is dispatched on the caller's thread.
+
+static void registry_global(void* data, struct wl_registry* registry, uint32_t name,
+                            const char* interface, uint32_t version) {
+    (void)data;
+    (void)registry;
+    if (strcmp(interface, zwlr_foreign_toplevel_manager_v1_interface.name) == 0) {
+        wl.wlr_name = name;
+        wl.wlr_version = version;
+    } else if (strcmp(interface, ext_foreign_toplevel_list_v1_interface.name) == 0) {
+        wl.ext_name = name;
+    } else if (strcmp(interface, wl_seat_interface.name) == 0 && !wl.seat_name) {
+        wl.seat_name = name;
+    }
+}
+
+static void registry_global_remove(void* data, struct wl_registry* registry, uint32_t name) {
+    (void)data;
+    (void)registry;
+    (void)name;
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_global,
+    .global_remove = registry_global_remove,
+};
+
+static void* wayland_thread(void* arg) {
+    (void)arg;
+    struct pollfd fds[2] = {
+        { .fd = wl_display_get_fd(wl.display), .events = POLLIN },
+        { .fd = wl.wake_pipe[0], .events = POLLIN },
+    };
+
+    int lost = 1;
+    while (1) {
+        pthread_mutex_lock(&wl_lock);
+        while (wl_display_prepare_read(wl.display) != 0) {
+            wl_display_dispatch_pending(wl.display);
+        }
+        pthread_mutex_unlock(&wl_lock);
+
+        if (wl_display_flush(wl.display) < 0 && errno != EAGAIN) {
+            wl_display_cancel_read(wl.display);
+            break;
+        }
+        if (poll(fds, 2, -1) < 0) {
+            wl_display_cancel_read(wl.display);
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) {
+            wl_display_cancel_read(wl.display);
+            lost = 0;
+            break;
+        }
+        if (wl_display_read_events(wl.display) < 0) {
+            fprintf(stderr, "wayland tracker: compositor connection lost\n");
+            break;
+        }
+
+        pthread_mutex_lock(&wl_lock);
+        int result = wl_display_dispatch_pending(wl.display);
+        pthread_mutex_unlock(&wl_lock);
+        if (result < 0) {
+            fprintf(stderr, "wayland tracker: compositor connection lost\n");
+            break;
+        }
+    }
+    if (lost) {
+        atomic_store(&wl.lost, 1);
+        emit_tracker_stopped(wl.callback);
+    }
+    return NULL;
+}
+
+static void disconnect() {
+    for (int i = 0; i < wl.count; i++) free_toplevel(wl.toplevels[i]);
+    free(wl.toplevels);
+    wl.toplevels = NULL;
+    wl.count = wl.capacity = 0;
+    wl.active = 0;
+
+    if (wl.wlr_manager) zwlr_foreign_toplevel_manager_v1_destroy(wl.wlr_manager);
+    if (wl.ext_list) ext_foreign_toplevel_list_v1_destroy(wl.ext_list);
+    if (wl.seat) wl_seat_destroy(wl.seat);
+    if (wl.registry) wl_registry_destroy(wl.registry);
+    if (wl.display) wl_display_disconnect(wl.display);
+    wl.wlr_manager = NULL;
+    wl.ext_list = NULL;
+    wl.seat = NULL;
+    wl.registry = NULL;
+    wl.display = NULL;
+    wl.wlr_name = wl.wlr_version = wl.ext_name = wl.seat_name = 0;
+}
+
+int wayland_tracker_start(window_event_callback callback) {
+    if (atomic_load(&wl.running) || !callback) return -1;
+    wl.display = wl_display_connect(NULL);
+    if (!wl.display) return -1;
+
+    wl.registry = wl_display_get_registry(wl.display);
+    wl_registry_add_listener(wl.registry, &registry_listener, NULL);
+    if (wl_display_roundtrip(wl.display) < 0 || (!wl.wlr_name && !wl.ext_name)) {
+        disconnect();
+        return -1;
+    }
+
+    // Prefer the wlr manager: it also reports state and accepts actions.
+    if (wl.wlr_name) {
+        wl.wlr_manager = wl_registry_bind(wl.registry, wl.wlr_name,
+            &zwlr_foreign_toplevel_manager_v1_interface, wl.wlr_version < 3 ? wl.wlr_version : 3);
+        zwlr_foreign_toplevel_manager_v1_add_listener(wl.wlr_manager, &wlr_manager_listener, NULL);
+        if (wl.seat_name) {
+            wl.seat = wl_registry_bind(wl.registry, wl.seat_name, &wl_seat_interface, 1);
+        }
+    } else {
+        wl.ext_list = wl_registry_bind(wl.registry, wl.ext_name,
+            &ext_foreign_toplevel_list_v1_interface, 1);
+        ext_foreign_toplevel_list_v1_add_listener(wl.ext_list, &ext_list_listener, NULL);
+    }
+
+    wl.callback = callback;
+    if (pipe(wl.wake_pipe) != 0) {
+        disconnect();
+        return -1;
+    }
+    if (pthread_create(&wl.thread, NULL, wayland_thread, NULL) != 0) {
+        close(wl.wake_pipe[0]);
+        close(wl.wake_pipe[1]);
+        wl.wake_pipe[0] = wl.wake_pipe[1] = -1;
+        disconnect();
+        return -1;
+    }
+    atomic_store(&wl.running, 1);
+    return 0;
+}
+
+// Stop the tracker thread and release all state. No callbacks are made after
+// this returns.
+void wayland_tracker_stop() {
+    if (!atomic_load(&wl.running)) return;
+
+    char byte = 0;
+    if (write(wl.wake_pipe[1], &byte, 1) < 0) {
+        fprintf(stderr, "wayland tracker: failed to wake thread\n");
+    }
+    pthread_join(wl.thread, NULL);
+
+    close(wl.wake_pipe[0]);
+    close(wl.wake_pipe[1]);
+    wl.wake_pipe[0] = wl.wake_pipe[1] = -1;
+
+    pthread_mutex_lock(&wl_lock);
+    atomic_store(&wl.running, 0);
+    atomic_store(&wl.lost, 0);
+    disconnect();
+    wl.callback = NULL;
+    pthread_mutex_unlock(&wl_lock);
+}
+
+int wayland_tracker_running() {
+    return atomic_load(&wl.running);
+}
+
+int wayland_tracker_lost() {
+    return atomic_load(&wl.lost);
+}
+
+window_list* wayland_get_window_list() {
+    pthread_mutex_lock(&wl_lock);
+    window_list* list = NULL;
+    window_record* records = malloc((wl.count ? wl.count : 1) * sizeof(window_record));
+    if (atomic_load(&wl.running) && records) {
+        int count = 0;
+        for (int i = 0; i < wl.count; i++) {
+            if (wl.toplevels[i]->reported) records[count++] = record_of(wl.toplevels[i]);
+        }
+        list = new_window_list(records, count);
+    }
+    free(records);
+    pthread_mutex_unlock(&wl_lock);
+    return list;
+}
+
+enum { ACTION_ACTIVATE, ACTION_CLOSE, ACTION_MINIMIZE };
+
+static int handle_request(uint32_t window, int action) {
+    pthread_mutex_lock(&wl_lock);
+    int slot = atomic_load(&wl.running) ? find_toplevel(window) : -1;
+    struct zwlr_foreign_toplevel_handle_v1* handle = slot >= 0 ? wl.toplevels[slot]->wlr : NULL;
+    int result = -1;
+    if (handle) {
+        switch (action) {
+        case ACTION_ACTIVATE:
+            if (wl.seat) {
+                zwlr_foreign_toplevel_handle_v1_activate(handle, wl.seat);
+                result = 0;
+            }
+            break;
+        case ACTION_CLOSE:
+            zwlr_foreign_toplevel_handle_v1_close(handle);
+            result = 0;
+            break;
+        case ACTION_MINIMIZE:
+            zwlr_foreign_toplevel_handle_v1_set_minimized(handle);
+            result = 0;
+            break;
+        }
+    }
+    if (result == 0 && wl_display_flush(wl.display) < 0 && errno != EAGAIN) result = -1;
+    pthread_mutex_unlock(&wl_lock);
+    return result;
+}
+
+int wayland_activate_window(uint32_t window) {
+    return handle_request(window, ACTION_ACTIVATE);
+}
+
+int wayland_close_window(uint32_t window) {
+    return handle_request(window, ACTION_CLOSE);
+}
+
+int wayland_minimize_window(uint32_t window) {
+    return handle_request(window, ACTION_MINIMIZE);
+}
@@ -0,0 +1,32 @@
+#ifndef WAYLAND_TRACKER_H
+#define WAYLAND_TRACKER_H
+
+// Internal to libicon_loader: the Wayland backend behind window_tracker.h,
+// built when wayland-client is available (HAVE_WAYLAND_TRACKER).
+
+#include "window_tracker.h"
+
+// Defined in window_tracker.c and shared by both backends. Records are
+// copied together with their strings into a single allocation.
+window_event* new_window_event(int type, const window_record* record);
+window_list* new_window_list(const window_record* records, int count);
+// Report WINDOW_EVENT_STOPPED, from a tracker thread that lost its server.
+void emit_tracker_stopped(window_event_callback callback);
+
+// Track toplevels through zwlr_foreign_toplevel_manager_v1, or
+// ext_foreign_toplevel_list_v1 when only that is offered. Returns -1 without
+// a compositor supporting either. Window IDs are assigned by the tracker and
+// are only meaningful while it runs.
+int wayland_tracker_start(window_event_callback callback);
+void wayland_tracker_stop();
+int wayland_tracker_running();
+// Whether the running tracker lost the compositor and awaits a stop.
+int wayland_tracker_lost();
+window_list* wayland_get_window_list();
+
+// Actions need zwlr_foreign_toplevel_manager_v1; -1 with the ext list.
+int wayland_activate_window(uint32_t window);
+int wayland_close_window(uint32_t window);
+int wayland_minimize_window(uint32_t window);
+
+#endif
@@ -0,0 +1,1088 @@
+#define _GNU_SOURCE
+#include "window_tracker.h"
+#include "wayland_tracker.h"
+
+#include <xcb/xcb.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+    ATOM_NET_CLIENT_LIST,
+    ATOM_NET_ACTIVE_WINDOW,
+    ATOM_NET_CURRENT_DESKTOP,
+    ATOM_NET_CLOSE_WINDOW,
+    ATOM_WM_CHANGE_STATE,
+    ATOM_NET_WM_NAME,
+    ATOM_NET_WM_PID,
+    ATOM_NET_WM_DESKTOP,
+    ATOM_NET_WM_STATE,
+    ATOM_NET_WM_STATE_HIDDEN,
+    ATOM_NET_WM_STATE_SKIP_TASKBAR,
+    ATOM_NET_WM_STATE_DEMANDS_ATTENTION,
+    ATOM_NET_WM_STATE_FULLSCREEN,
+    ATOM_NET_WM_ICON,
+    ATOM_NET_WM_WINDOW_TYPE,
+    ATOM_NET_WM_WINDOW_TYPE_NORMAL,
+    ATOM_NET_WM_WINDOW_TYPE_DIALOG,
+    ATOM_UTF8_STRING,
+    ATOM_COUNT
+};
+
+static const char* atom_names[ATOM_COUNT] = {
+    "_NET_CLIENT_LIST",
+    "_NET_ACTIVE_WINDOW",
+    "_NET_CURRENT_DESKTOP",
+    "_NET_CLOSE_WINDOW",
+    "WM_CHANGE_STATE",
+    "_NET_WM_NAME",
+    "_NET_WM_PID",
+    "_NET_WM_DESKTOP",
+    "_NET_WM_STATE",
+    "_NET_WM_STATE_HIDDEN",
+    "_NET_WM_STATE_SKIP_TASKBAR",
+    "_NET_WM_STATE_DEMANDS_ATTENTION",
+    "_NET_WM_STATE_FULLSCREEN",
+    "_NET_WM_ICON",
+    "_NET_WM_WINDOW_TYPE",
+    "_NET_WM_WINDOW_TYPE_NORMAL",
+    "_NET_WM_WINDOW_TYPE_DIALOG",
+    "UTF8_STRING",
+};
+
+// Properties requested per window by fetch_windows(), in cookie order.
+enum {
+    PROP_NET_WM_NAME,
+    PROP_WM_NAME,
+    PROP_WM_CLASS,
+    PROP_NET_WM_PID,
+    PROP_NET_WM_DESKTOP,
+    PROP_NET_WM_STATE,
+    PROP_NET_WM_WINDOW_TYPE,
+    PROP_WM_HINTS,
+    PROP_COUNT
+};
+
+// An X connection with its root window and interned atoms.
+typedef struct {
+    xcb_connection_t* conn;
+    xcb_window_t root;
+    xcb_atom_t atoms[ATOM_COUNT];
+} x_context;
+
+// Tracker-side copy of a client window. Strings are owned by the entry.
+// shown is set while the window passes the filter and has been reported.
+typedef struct {
+    uint32_t window;
+    int32_t pid;
+    int32_t desktop;
+    uint32_t state;
+    char* title;
+    char* wm_class;
+    char* wm_instance;
+    int shown;
+} tracked_window;
+
+static struct {
+    x_context x;
+    window_event_callback callback;
+    pthread_t thread;
+    int wake_pipe[2];
+    // Read from other threads (the icon cache, set_window_filter()).
+    atomic_int running;
+    atomic_int lost;  // The thread ended on its own; awaits stop
+    // Sorted by window id so lookups are a binary search.
+    tracked_window* windows;
+    int count;
+    uint32_t active_window;
+    int32_t current_desktop;
+} tracker = { .wake_pipe = { -1, -1 }, .current_desktop = -1 };
+
+// WINDOW_FILTER_* bits, shared by the tracker and get_window_list(); set
+// from the caller's thread, read on the tracker thread.
+static _Atomic uint32_t window_filter;
+
+// Wake-pipe commands for the tracker thread.
+#define WAKE_STOP 0
+#define WAKE_FILTER 1
+
+// Connection used for synchronous queries from the caller's thread.
+static x_context query;
+static pthread_mutex_t query_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void invalidate_window_icon(uint32_t window);
+static void clear_window_icons();
+
+static int x_context_open(x_context* x) {
+    int screen_num;
+    xcb_connection_t* conn = xcb_connect(NULL, &screen_num);
+    if (xcb_connection_has_error(conn)) {
+        xcb_disconnect(conn);
+        return -1;
+    }
+
+    xcb_screen_iterator_t it = xcb_setup_roots_iterator(xcb_get_setup(conn));
+    for (int i = 0; i < screen_num && it.rem; i++) xcb_screen_next(&it);
+    if (!it.rem) {
+        xcb_disconnect(conn);
+        return -1;
+    }
+
+    x->conn = conn;
+    x->root = it.data->root;
+
+    xcb_intern_atom_cookie_t cookies[ATOM_COUNT];
+    for (int i = 0; i < ATOM_COUNT; i++) {
+        cookies[i] = xcb_intern_atom(conn, 0, strlen(atom_names[i]), atom_names[i]);
+    }
+    for (int i = 0; i < ATOM_COUNT; i++) {
+        xcb_intern_atom_reply_t* reply = xcb_intern_atom_reply(conn, cookies[i], NULL);
+        x->atoms[i] = reply ? reply->atom : XCB_ATOM_NONE;
+        free(reply);
+    }
+    return 0;
+}
+
+static void x_context_close(x_context* x) {
+    if (x->conn) xcb_disconnect(x->conn);
+    x->conn = NULL;
+}
+
+static int strings_equal(const char* a, const char* b) {
+    if (!a || !b) return a == b;
+    return strcmp(a, b) == 0;
+}
+
+static void free_tracked_window(tracked_window* w) {
+    free(w->title);
+    free(w->wm_class);
+    free(w->wm_instance);
+}
+
+// Find the slot of a window, or the slot it should be inserted at.
+static int find_window(uint32_t window, int* found) {
+    int lo = 0, hi = tracker.count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (tracker.windows[mid].window < window) lo = mid + 1;
+        else hi = mid;
+    }
+    *found = lo < tracker.count && tracker.windows[lo].window == window;
+    return lo;
+}
+
+static size_t record_strings_size(const window_record* r) {
+    return (r->title ? strlen(r->title) + 1 : 0) +
+           (r->wm_class ? strlen(r->wm_class) + 1 : 0) +
+           (r->wm_instance ? strlen(r->wm_instance) + 1 : 0);
+}
+
+static const char* pack_string(char** strings, const char* s) {
+    if (!s) return NULL;
+    size_t len = strlen(s) + 1;
+    char* out = memcpy(*strings, s, len);
+    *strings += len;
+    return out;
+}
+
+// Copy a record into out, moving its strings to *strings.
+static void pack_record(window_record* out, const window_record* r, char** strings) {
+    *out = *r;
+    out->title = pack_string(strings, r->title);
+    out->wm_class = pack_string(strings, r->wm_class);
+    out->wm_instance = pack_string(strings, r->wm_instance);
+}
+
+window_event* new_window_event(int type, const window_record* record) {
+    window_event* event = malloc(sizeof(window_event) + record_strings_size(record));
+    if (!event) return NULL;
+
+    char* strings = (char*)(event + 1);
+    event->type = type;
+    pack_record(&event->window, record, &strings);
+    return event;
+}
+
+void emit_tracker_stopped(window_event_callback callback) {
+    window_event* event = calloc(1, sizeof(window_event));
+    if (!event) return;
+    event->type = WINDOW_EVENT_STOPPED;
+    event->window.desktop = -1;
+    callback(event);
+}
+
+window_list* new_window_list(const window_record* records, int count) {
+    size_t strings_size = 0;
+    for (int i = 0; i < count; i++) strings_size += record_strings_size(&records[i]);
+
+    // Header, records and strings share one block.
+    window_list* list = malloc(sizeof(window_list) + count * sizeof(window_record) + strings_size);
+    if (!list) return NULL;
+    list->count = count;
+    list->windows = (window_record*)(list + 1);
+    char* strings = (char*)(list->windows + count);
+    for (int i = 0; i < count; i++) pack_record(&list->windows[i], &records[i], &strings);
+    return list;
+}
+
+// A record borrowing the strings of a tracked window.
+static window_record record_of(const tracked_window* w) {
+    return (window_record){
+        .window = w->window,
+        .pid = w->pid,
+        .desktop = w->desktop,
+        .state = w->state,
+        .title = w->title,
+        .wm_class = w->wm_class,
+        .wm_instance = w->wm_instance,
+    };
+}
+
+static void emit_event(int type, const tracked_window* w) {
+    window_record record = record_of(w);
+    window_event* event = new_window_event(type, &record);
+    if (event) tracker.callback(event);
+}
+
+static char* property_string(xcb_get_property_reply_t* reply) {
+    if (!reply || reply->format != 8) return NULL;
+    int len = xcb_get_property_value_length(reply);
+    if (len <= 0) return NULL;
+    char* s = malloc(len + 1);
+    if (!s) return NULL;
+    memcpy(s, xcb_get_property_value(reply), len);
+    s[len] = '\0';
+    return s;
+}
+
+static int property_cardinal(xcb_get_property_reply_t* reply, uint32_t* value) {
+    if (!reply || reply->format != 32 || xcb_get_property_value_length(reply) < 4) return 0;
+    *value = *(uint32_t*)xcb_get_property_value(reply);
+    return 1;
+}
+
+static uint32_t decode_state(const x_context* x, xcb_get_property_reply_t* reply) {
+    if (!reply || reply->format != 32) return 0;
+    const xcb_atom_t* atoms = xcb_get_property_value(reply);
+    int n = xcb_get_property_value_length(reply) / 4;
+    uint32_t state = 0;
+    for (int i = 0; i < n; i++) {
+        if (atoms[i] == x->atoms[ATOM_NET_WM_STATE_HIDDEN]) state |= WINDOW_STATE_HIDDEN;
+        else if (atoms[i] == x->atoms[ATOM_NET_WM_STATE_SKIP_TASKBAR]) state |= WINDOW_STATE_SKIP_TASKBAR;
+        else if (atoms[i] == x->atoms[ATOM_NET_WM_STATE_DEMANDS_ATTENTION]) state |= WINDOW_STATE_DEMANDS_ATTENTION;
+        else if (atoms[i] == x->atoms[ATOM_NET_WM_STATE_FULLSCREEN]) state |= WINDOW_STATE_FULLSCREEN;
+    }
+    return state;
+}
+
+// Anything but a normal window or dialog (docks, menus, tooltips, splash
+// screens, ...) is not shown on a taskbar. Untyped windows count as normal.
+static uint32_t decode_window_type(const x_context* x, xcb_get_property_reply_t* reply) {
+    if (!reply || reply->format != 32 || xcb_get_property_value_length(reply) < 4) return 0;
+    // Only the first, most preferred, type is considered.
+    xcb_atom_t type = *(const xcb_atom_t*)xcb_get_property_value(reply);
+    return type == x->atoms[ATOM_NET_WM_WINDOW_TYPE_NORMAL] ||
+           type == x->atoms[ATOM_NET_WM_WINDOW_TYPE_DIALOG]
+        ? 0 : WINDOW_STATE_SPECIAL_TYPE;
+}
+
+// The UrgencyHint flag of WM_HINTS.
+#define URGENCY_HINT (1 << 8)
+
+static void decode_window(const x_context* x, uint32_t window,
+                          xcb_get_property_reply_t** replies, tracked_window* out) {
+    out->window = window;
+    out->title = property_string(replies[PROP_NET_WM_NAME]);
+    if (!out->title) out->title = property_string(replies[PROP_WM_NAME]);
+    out->wm_class = NULL;
+    out->wm_instance = NULL;
+
+    // WM_CLASS holds "instance\0class\0".
+    char* class_value = property_string(replies[PROP_WM_CLASS]);
+    if (class_value) {
+        int len = xcb_get_property_value_length(replies[PROP_WM_CLASS]);
+        size_t instance_len = strlen(class_value);
+        out->wm_instance = strdup(class_value);
+        if ((int)instance_len + 1 < len) out->wm_class = strdup(class_value + instance_len + 1);
+        free(class_value);
+    }
+
+    uint32_t value;
+    out->pid = property_cardinal(replies[PROP_NET_WM_PID], &value) ? (int32_t)value : 0;
+    out->desktop = property_cardinal(replies[PROP_NET_WM_DESKTOP], &value) && value != 0xFFFFFFFF
+        ? (int32_t)value : -1;
+    out->state = decode_state(x, replies[PROP_NET_WM_STATE]) |
+                 decode_window_type(x, replies[PROP_NET_WM_WINDOW_TYPE]);
+    uint32_t hints;
+    if (property_cardinal(replies[PROP_WM_HINTS], &hints) && (hints & URGENCY_HINT)) {
+        out->state |= WINDOW_STATE_DEMANDS_ATTENTION;
+    }
+    out->shown = 0;
+}
+
+// Whether a window passes the filter. Windows on all desktops, or when the
+// current desktop is unknown, are always shown.
+static int passes_filter(const tracked_window* w, uint32_t filter, int32_t current_desktop) {
+    if ((filter & WINDOW_FILTER_TASKBAR) &&
+        (w->state & (WINDOW_STATE_SKIP_TASKBAR | WINDOW_STATE_SPECIAL_TYPE))) {
+        return 0;
+    }
+    if ((filter & WINDOW_FILTER_CURRENT_DESKTOP) && w->desktop >= 0 &&
+        current_desktop >= 0 && w->desktop != current_desktop) {
+        return 0;
+    }
+    return 1;
+}
+
+// Read the properties of n windows. Every GetProperty request is sent before
+// the first reply is awaited, so the whole batch costs about one round-trip.
+// alive[i] is cleared for windows that have gone away.
+static void fetch_windows(const x_context* x, const uint32_t* windows, int n,
+                          tracked_window* out, int* alive) {
+    if (n <= 0) return;
+    xcb_get_property_cookie_t* cookies = malloc((size_t)n * PROP_COUNT * sizeof(*cookies));
+    if (!cookies) {
+        for (int i = 0; i < n; i++) alive[i] = 0;
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        xcb_get_property_cookie_t* c = &cookies[i * PROP_COUNT];
+        c[PROP_NET_WM_NAME] = xcb_get_property(x->conn, 0, windows[i],
+            x->atoms[ATOM_NET_WM_NAME], x->atoms[ATOM_UTF8_STRING], 0, 1024);
+        c[PROP_WM_NAME] = xcb_get_property(x->conn, 0, windows[i],
+            XCB_ATOM_WM_NAME, XCB_GET_PROPERTY_TYPE_ANY, 0, 1024);
+        c[PROP_WM_CLASS] = xcb_get_property(x->conn, 0, windows[i],
+            XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 0, 1024);
+        c[PROP_NET_WM_PID] = xcb_get_property(x->conn, 0, windows[i],
+            x->atoms[ATOM_NET_WM_PID], XCB_ATOM_CARDINAL, 0, 1);
+        c[PROP_NET_WM_DESKTOP] = xcb_get_property(x->conn, 0, windows[i],
+            x->atoms[ATOM_NET_WM_DESKTOP], XCB_ATOM_CARDINAL, 0, 1);
+        c[PROP_NET_WM_STATE] = xcb_get_property(x->conn, 0, windows[i],
+            x->atoms[ATOM_NET_WM_STATE], XCB_ATOM_ATOM, 0, 64);
+        c[PROP_NET_WM_WINDOW_TYPE] = xcb_get_property(x->conn, 0, windows[i],
+            x->atoms[ATOM_NET_WM_WINDOW_TYPE], XCB_ATOM_ATOM, 0, 1);
+        c[PROP_WM_HINTS] = xcb_get_property(x->conn, 0, windows[i],
+            XCB_ATOM_WM_HINTS, XCB_ATOM_WM_HINTS, 0, 1);
+    }
+    xcb_flush(x->conn);
+
+    for (int i = 0; i < n; i++) {
+        xcb_get_property_reply_t* replies[PROP_COUNT];
+        int any = 0;
+        for (int p = 0; p < PROP_COUNT; p++) {
+            replies[p] = xcb_get_property_reply(x->conn, cookies[i * PROP_COUNT + p], NULL);
+            if (replies[p]) any = 1;
+        }
+        alive[i] = any;
+        if (any) decode_window(x, windows[i], replies, &out[i]);
+        for (int p = 0; p < PROP_COUNT; p++) free(replies[p]);
+    }
+    free(cookies);
+}
+
+// Read _NET_CLIENT_LIST. Returns the number of windows; *out must be freed.
+static int read_client_list(const x_context* x, uint32_t** out) {
+    xcb_get_property_cookie_t cookie = xcb_get_property(x->conn, 0, x->root,
+        x->atoms[ATOM_NET_CLIENT_LIST], XCB_ATOM_WINDOW, 0, UINT32_MAX / 4);
+    xcb_get_property_reply_t* reply = xcb_get_property_reply(x->conn, cookie, NULL);
+
+    int n = 0;
+    *out = NULL;
+    if (reply && reply->format == 32) {
+        n = xcb_get_property_value_length(reply) / 4;
+        *out = malloc((n ? n : 1) * sizeof(uint32_t));
+        if (!*out) n = 0;
+        else memcpy(*out, xcb_get_property_value(reply), n * sizeof(uint32_t));
+    }
+    free(reply);
+    return n;
+}
+
+static void watch_window(uint32_t window) {
+    uint32_t mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+    xcb_change_window_attributes(tracker.x.conn, window, XCB_CW_EVENT_MASK, &mask);
+}
+
+static int compare_window_ids(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static int compare_tracked_windows(const void* a, const void* b) {
+    return compare_window_ids(&((const tracked_window*)a)->window,
+                              &((const tracked_window*)b)->window);
+}
+
+// Diff _NET_CLIENT_LIST against the tracked set and emit added/removed events.
+// New windows are fetched in a single pipelined batch.
+static void sync_client_list() {
+    uint32_t* clients;
+    int n = read_client_list(&tracker.x, &clients);
+    if (n > 1) qsort(clients, n, sizeof(uint32_t), compare_window_ids);
+
+    tracked_window* next = malloc((n ? n : 1) * sizeof(tracked_window));
+    uint32_t* added = malloc((n ? n : 1) * sizeof(uint32_t));
+    int* alive = malloc((n ? n : 1) * sizeof(int));
+    if (!next || !added || !alive) {
+        free(next);
+        free(added);
+        free(alive);
+        free(clients);
+        return;
+    }
+
+    // Both lists are sorted: walk them together.
+    int kept = 0, n_added = 0;
+    int i = 0, j = 0;
+    while (i < tracker.count || j < n) {
+        if (j < n && j > 0 && clients[j] == clients[j - 1]) {
+            j++;
+        } else if (j >= n || (i < tracker.count && tracker.windows[i].window < clients[j])) {
+            if (tracker.windows[i].shown) emit_event(WINDOW_EVENT_REMOVED, &tracker.windows[i]);
+            invalidate_window_icon(tracker.windows[i].window);
+            free_tracked_window(&tracker.windows[i]);
+            i++;
+        } else if (i >= tracker.count || clients[j] < tracker.windows[i].window) {
+            watch_window(clients[j]);
+            added[n_added++] = clients[j];
+            j++;
+        } else {
+            next[kept++] = tracker.windows[i];
+            i++;
+            j++;
+        }
+    }
+    free(clients);
+
+    fetch_windows(&tracker.x, added, n_added, &next[kept], alive);
+    int total = kept;
+    for (int k = 0; k < n_added; k++) {
+        if (alive[k]) next[total++] = next[kept + k];
+    }
+    for (int k = kept; k < total; k++) {
+        next[k].shown = passes_filter(&next[k], atomic_load(&window_filter), tracker.current_desktop);
+        if (next[k].shown) emit_event(WINDOW_EVENT_ADDED, &next[k]);
+    }
+    free(added);
+    free(alive);
+
+    if (total > 1) qsort(next, total, sizeof(tracked_window), compare_tracked_windows);
+    free(tracker.windows);
+    tracker.windows = next;
+    tracker.count = total;
+}
+
+// Read _NET_ACTIVE_WINDOW and report it if focus moved.
+static void sync_active_window() {
+    xcb_get_property_cookie_t cookie = xcb_get_property(tracker.x.conn, 0, tracker.x.root,
+        tracker.x.atoms[ATOM_NET_ACTIVE_WINDOW], XCB_ATOM_WINDOW, 0, 1);
+    xcb_get_property_reply_t* reply = xcb_get_property_reply(tracker.x.conn, cookie, NULL);
+    uint32_t active = 0;
+    property_cardinal(reply, &active);
+    free(reply);
+
+    if (active == tracker.active_window) return;
+    tracker.active_window = active;
+
+    window_event* event = calloc(1, sizeof(window_event));
+    if (!event) return;
+    event->type = WINDOW_EVENT_FOCUS;
+    event->window.window = active;
+    event->window.desktop = -1;
+    tracker.callback(event);
+}
+
+static void refresh_window(uint32_t window) {
+    int found;
+    int slot = find_window(window, &found);
+    if (!found) return;
+
+    tracked_window fresh;
+    int alive;
+    fetch_windows(&tracker.x, &window, 1, &fresh, &alive);
+    if (!alive) return;
+
+    tracked_window* w = &tracker.windows[slot];
+    fresh.shown = passes_filter(&fresh, atomic_load(&window_filter), tracker.current_desktop);
+    int changed = w->pid != fresh.pid ||
+                  w->desktop != fresh.desktop ||
+                  w->state != fresh.state ||
+                  !strings_equal(w->title, fresh.title) ||
+                  !strings_equal(w->wm_class, fresh.wm_class) ||
+                  !strings_equal(w->wm_instance, fresh.wm_instance);
+    int was_shown = w->shown;
+    free_tracked_window(w);
+    *w = fresh;
+    if (was_shown && !w->shown) emit_event(WINDOW_EVENT_REMOVED, w);
+    else if (!was_shown && w->shown) emit_event(WINDOW_EVENT_ADDED, w);
+    else if (changed && w->shown) emit_event(WINDOW_EVENT_CHANGED, w);
+}
+
+// Re-evaluate the filter for every window after the filter or the current
+// desktop changed, reporting windows that appear or disappear.
+static void apply_filter() {
+    uint32_t filter = atomic_load(&window_filter);
+    for (int i = 0; i < tracker.count; i++) {
+        tracked_window* w = &tracker.windows[i];
+        int shown = passes_filter(w, filter, tracker.current_desktop);
+        if (shown == w->shown) continue;
+        w->shown = shown;
+        emit_event(shown ? WINDOW_EVENT_ADDED : WINDOW_EVENT_REMOVED, w);
+    }
+}
+
+// Read _NET_CURRENT_DESKTOP; report it and re-filter if it changed.
+static void sync_current_desktop() {
+    xcb_get_property_cookie_t cookie = xcb_get_property(tracker.x.conn, 0, tracker.x.root,
+        tracker.x.atoms[ATOM_NET_CURRENT_DESKTOP], XCB_ATOM_CARDINAL, 0, 1);
+    xcb_get_property_reply_t* reply = xcb_get_property_reply(tracker.x.conn, cookie, NULL);
+    uint32_t value;
+    int32_t desktop = property_cardinal(reply, &value) ? (int32_t)value : -1;
+    free(reply);
+
+    if (desktop == tracker.current_desktop) return;
+    tracker.current_desktop = desktop;
+    apply_filter();
+
+    window_event* event = calloc(1, sizeof(window_event));
+    if (!event) return;
+    event->type = WINDOW_EVENT_DESKTOP;
+    event->window.desktop = desktop;
+    tracker.callback(event);
+}
+
+static void handle_property_notify(xcb_property_notify_event_t* ev) {
+    const xcb_atom_t* atoms = tracker.x.atoms;
+    if (ev->window == tracker.x.root) {
+        if (ev->atom == atoms[ATOM_NET_CLIENT_LIST]) sync_client_list();
+        else if (ev->atom == atoms[ATOM_NET_ACTIVE_WINDOW]) sync_active_window();
+        else if (ev->atom == atoms[ATOM_NET_CURRENT_DESKTOP]) sync_current_desktop();
+        return;
+    }
+    if (ev->atom == atoms[ATOM_NET_WM_NAME] ||
+        ev->atom == XCB_ATOM_WM_NAME ||
+        ev->atom == XCB_ATOM_WM_CLASS ||
+        ev->atom == atoms[ATOM_NET_WM_PID] ||
+        ev->atom == atoms[ATOM_NET_WM_DESKTOP] ||
+        ev->atom == atoms[ATOM_NET_WM_STATE] ||
+        ev->atom == atoms[ATOM_NET_WM_WINDOW_TYPE] ||
+        ev->atom == XCB_ATOM_WM_HINTS) {
+        refresh_window(ev->window);
+    } else if (ev->atom == atoms[ATOM_NET_WM_ICON]) {
+        int found;
+        int slot = find_window(ev->window, &found);
+        if (!found) return;
+        invalidate_window_icon(ev->window);
+        if (!tracker.windows[slot].shown) return;
+        window_event* event = calloc(1, sizeof(window_event));
+        if (!event) return;
+        event->type = WINDOW_EVENT_ICON;
+        event->window.window = ev->window;
+        event->window.desktop = -1;
+        tracker.callback(event);
+    }
+}
+
+static void* tracker_thread(void* arg) {
+    (void)arg;
+    xcb_connection_t* conn = tracker.x.conn;
+    // The current desktop first, so the initial windows are filtered by it.
+    sync_current_desktop();
+    sync_client_list();
+    sync_active_window();
+    xcb_flush(conn);
+
+    struct pollfd fds[2] = {
+        { .fd = xcb_get_file_descriptor(conn), .events = POLLIN },
+        { .fd = tracker.wake_pipe[0], .events = POLLIN },
+    };
+
+    int lost = 1;
+    while (1) {
+        // Drain everything already queued before sleeping; replies awaited
+        // while handling one event may have queued more.
+        xcb_generic_event_t* ev;
+        while ((ev = xcb_poll_for_event(conn))) {
+            if ((ev->response_type & ~0x80) == XCB_PROPERTY_NOTIFY) {
+                handle_property_notify((xcb_property_notify_event_t*)ev);
+            }
+            free(ev);
+        }
+        if (xcb_connection_has_error(conn)) {
+            fprintf(stderr, "window tracker: X connection lost\n");
+            break;
+        }
+        xcb_flush(conn);
+
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) break;
+        if (fds[1].revents) {
+            char command = WAKE_STOP;
+            if (read(tracker.wake_pipe[0], &command, 1) != 1) break;
+            if (command == WAKE_STOP) {
+                lost = 0;
+                break;
+            }
+            apply_filter();
+        }
+    }
+    if (lost) {
+        atomic_store(&tracker.lost, 1);
+        emit_tracker_stopped(tracker.callback);
+    }
+    return NULL;
+}
+
+#ifdef HAVE_WAYLAND_TRACKER
+// Prefer the Wayland backend in Wayland sessions; VAXP_WINDOW_BACKEND=x11 or
+// =wayland forces one. Compositors without foreign-toplevel support fall
+// back to X11, which then sees XWayland clients only.
+static int prefer_wayland() {
+    const char* backend = getenv("VAXP_WINDOW_BACKEND");
+    if (backend && strcmp(backend, "x11") == 0) return 0;
+    if (backend && strcmp(backend, "wayland") == 0) return 1;
+    return getenv("WAYLAND_DISPLAY") != NULL;
+}
+#endif
+
+int start_window_tracker(window_event_callback callback) {
+    // A tracker that lost its connection is released first.
+    if (atomic_load(&tracker.lost)) stop_window_tracker();
+#ifdef HAVE_WAYLAND_TRACKER
+    if (wayland_tracker_lost()) wayland_tracker_stop();
+#endif
+    if (atomic_load(&tracker.running) || !callback) return -1;
+#ifdef HAVE_WAYLAND_TRACKER
+    if (wayland_tracker_running()) return -1;
+    if (prefer_wayland() && wayland_tracker_start(callback) == 0) return 0;
+#endif
+    if (x_context_open(&tracker.x) != 0) return -1;
+    tracker.callback = callback;
+
+    uint32_t mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+    xcb_change_window_attributes(tracker.x.conn, tracker.x.root, XCB_CW_EVENT_MASK, &mask);
+
+    if (pipe(tracker.wake_pipe) != 0) {
+        x_context_close(&tracker.x);
+        return -1;
+    }
+    if (pthread_create(&tracker.thread, NULL, tracker_thread, NULL) != 0) {
+        close(tracker.wake_pipe[0]);
+        close(tracker.wake_pipe[1]);
+        tracker.wake_pipe[0] = tracker.wake_pipe[1] = -1;
+        x_context_close(&tracker.x);
+        return -1;
+    }
+    atomic_store(&tracker.running, 1);
+    return 0;
+}
+
+// Stop the tracker thread and release all state. No callbacks are made after
+// this returns.
+void stop_window_tracker() {
+#ifdef HAVE_WAYLAND_TRACKER
+    if (wayland_tracker_running()) {
+        wayland_tracker_stop();
+        return;
+    }
+#endif
+    if (!atomic_load(&tracker.running)) return;
+
+    char command = WAKE_STOP;
+    if (write(tracker.wake_pipe[1], &command, 1) < 0) {
+        fprintf(stderr, "window tracker: failed to wake thread\n");
+    }
+    pthread_join(tracker.thread, NULL);
+
+    close(tracker.wake_pipe[0]);
+    close(tracker.wake_pipe[1]);
+    tracker.wake_pipe[0] = tracker.wake_pipe[1] = -1;
+    x_context_close(&tracker.x);
+
+    for (int i = 0; i < tracker.count; i++) free_tracked_window(&tracker.windows[i]);
+    free(tracker.windows);
+    tracker.windows = NULL;
+    tracker.count = 0;
+    tracker.active_window = 0;
+    tracker.current_desktop = -1;
+    tracker.callback = NULL;
+    atomic_store(&tracker.running, 0);
+    atomic_store(&tracker.lost, 0);
+    clear_window_icons();
+}
+
+void free_window_event(window_event* event) {
+    free(event);
+}
+
+// Open the query connection on first use; reopen it if the server dropped it.
+static x_context* query_context() {
+    if (query.conn && xcb_connection_has_error(query.conn)) x_context_close(&query);
+    if (!query.conn && x_context_open(&query) != 0) return NULL;
+    return &query;
+}
+
+window_list* get_window_list() {
+#ifdef HAVE_WAYLAND_TRACKER
+    if (wayland_tracker_running()) return wayland_get_window_list();
+#endif
+    pthread_mutex_lock(&query_lock);
+    x_context* x = query_context();
+    if (!x) {
+        pthread_mutex_unlock(&query_lock);
+        return NULL;
+    }
+
+    uint32_t filter = atomic_load(&window_filter);
+    xcb_get_property_cookie_t desktop_cookie = xcb_get_property(x->conn, 0, x->root,
+        x->atoms[ATOM_NET_CURRENT_DESKTOP], XCB_ATOM_CARDINAL, 0, 1);
+    uint32_t* clients;
+    int n = read_client_list(x, &clients);
+    xcb_get_property_reply_t* desktop_reply = xcb_get_property_reply(x->conn, desktop_cookie, NULL);
+    uint32_t value;
+    int32_t current_desktop = property_cardinal(desktop_reply, &value) ? (int32_t)value : -1;
+    free(desktop_reply);
+
+    tracked_window* fetched = malloc((n ? n : 1) * sizeof(tracked_window));
+    int* alive = malloc((n ? n : 1) * sizeof(int));
+    if (!fetched || !alive) {
+        free(fetched);
+        free(alive);
+        free(clients);
+        pthread_mutex_unlock(&query_lock);
+        return NULL;
+    }
+    fetch_windows(x, clients, n, fetched, alive);
+    pthread_mutex_unlock(&query_lock);
+    for (int i = 0; i < n; i++) {
+        fetched[i].shown = alive[i] && passes_filter(&fetched[i], filter, current_desktop);
+    }
+
+    window_record* records = malloc((n ? n : 1) * sizeof(window_record));
+    window_list* list = NULL;
+    if (records) {
+        int count = 0;
+        for (int i = 0; i < n; i++) {
+            if (fetched[i].shown) records[count++] = record_of(&fetched[i]);
+        }
+        list = new_window_list(records, count);
+        free(records);
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (alive[i]) free_tracked_window(&fetched[i]);
+    }
+    free(fetched);
+    free(alive);
+    free(clients);
+    return list;
+}
+
+void free_window_list(window_list* list) {
+    free(list);
+}
+
+int get_active_window(uint32_t* window) {
+#ifdef HAVE_WAYLAND_TRACKER
+    // Tracker-assigned IDs are reported through focus events only.
+    if (wayland_tracker_running()) return -1;
+#endif
+    pthread_mutex_lock(&query_lock);
+    x_context* x = query_context();
+    if (!x) {
+        pthread_mutex_unlock(&query_lock);
+        return -1;
+    }
+    xcb_get_property_cookie_t cookie = xcb_get_property(x->conn, 0, x->root,
+        x->atoms[ATOM_NET_ACTIVE_WINDOW], XCB_ATOM_WINDOW, 0, 1);
+    xcb_get_property_reply_t* reply = xcb_get_property_reply(x->conn, cookie, NULL);
+    pthread_mutex_unlock(&query_lock);
+    *window = 0;
+    property_cardinal(reply, window);
+    free(reply);
+    return 0;
+}
+
+void set_window_filter(uint32_t filter) {
+    if (atomic_exchange(&window_filter, filter) == filter) return;
+    if (!atomic_load(&tracker.running)) return;
+    char command = WAKE_FILTER;
+    if (write(tracker.wake_pipe[1], &command, 1) < 0) {
+        fprintf(stderr, "window tracker: failed to wake thread\n");
+    }
+}
+
+// Source indication for EWMH requests: 2 means a pager or taskbar.
+#define SOURCE_PAGER 2
+#define ICONIC_STATE 3
+
+static int send_client_message(x_context* x, uint32_t window, xcb_atom_t type,
+                               uint32_t d0, uint32_t d1, uint32_t d2) {
+    xcb_client_message_event_t ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.response_type = XCB_CLIENT_MESSAGE;
+    ev.format = 32;
+    ev.window = window;
+    ev.type = type;
+    ev.data.data32[0] = d0;
+    ev.data.data32[1] = d1;
+    ev.data.data32[2] = d2;
+    xcb_send_event(x->conn, 0, x->root,
+                   XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY,
+                   (const char*)&ev);
+    return xcb_flush(x->conn) > 0 ? 0 : -1;
+}
+
+// Send one message on the query connection. atom indexes x_context.atoms.
+static int send_request(uint32_t window, int atom, uint32_t d0, uint32_t d1, uint32_t d2) {
+    pthread_mutex_lock(&query_lock);
+    x_context* x = query_context();
+    int result = x ? send_client_message(x, window, x->atoms[atom], d0, d1, d2) : -1;
+    pthread_mutex_unlock(&query_lock);
+    return result;
+}
+
+int activate_window(uint32_t window) {
+#ifdef HAVE_WAYLAND_TRACKER
+    if (wayland_tracker_running()) return wayland_activate_window(window);
+#endif
+    return send_request(window, ATOM_NET_ACTIVE_WINDOW, SOURCE_PAGER, XCB_CURRENT_TIME, 0);
+}
+
+int close_window(uint32_t window) {
+#ifdef HAVE_WAYLAND_TRACKER
+    if (wayland_tracker_running()) return wayland_close_window(window);
+#endif
+    return send_request(window, ATOM_NET_CLOSE_WINDOW, XCB_CURRENT_TIME, SOURCE_PAGER, 0);
+}
+
+int minimize_window(uint32_t window) {
+#ifdef HAVE_WAYLAND_TRACKER
+    if (wayland_tracker_running()) return wayland_minimize_window(window);
+#endif
+    return send_request(window, ATOM_WM_CHANGE_STATE, ICONIC_STATE, 0, 0);
+}
+
+int move_window_to_desktop(uint32_t window, int32_t desktop) {
+#ifdef HAVE_WAYLAND_TRACKER
+    // The foreign-toplevel protocols have no notion of workspaces.
+    if (wayland_tracker_running()) return -1;
+#endif
+    return send_request(window, ATOM_NET_WM_DESKTOP,
+                        desktop < 0 ? 0xFFFFFFFF : (uint32_t)desktop, SOURCE_PAGER, 0);
+}
+
+int activate_window_matching(const char* needle) {
+    if (!needle || !*needle) return -1;
+    window_list* list = get_window_list();
+    if (!list) return -1;
+
+    uint32_t match = 0;
+    for (int i = 0; i < list->count && !match; i++) {
+        const window_record* w = &list->windows[i];
+        if ((w->title && strcasestr(w->title, needle)) ||
+            (w->wm_class && strcasestr(w->wm_class, needle))) {
+            match = w->window;
+        }
+    }
+    free_window_list(list);
+    return match ? activate_window(match) : -1;
+}
+
+// Decoded _NET_WM_ICON images are shared between every window and size that
+// resolves to identical pixels (e.g. all windows of one application).
+typedef struct icon_entry {
+    window_icon icon; // first, so a window_icon* is also its entry
+    int refs;
+    struct icon_entry* next;
+} icon_entry;
+
+typedef struct {
+    uint32_t window;
+    int32_t size;
+    icon_entry* entry;
+} icon_slot;
+
+static struct {
+    icon_entry* entries;
+    icon_slot* slots;
+    int count;
+    int capacity;
+} icons;
+static pthread_mutex_t icon_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Call with icon_lock held.
+static void unref_icon_entry(icon_entry* entry) {
+    if (--entry->refs > 0) return;
+    for (icon_entry** p = &icons.entries; *p; p = &(*p)->next) {
+        if (*p == entry) {
+            *p = entry->next;
+            break;
+        }
+    }
+    free(entry);
+}
+
+static void invalidate_window_icon(uint32_t window) {
+    pthread_mutex_lock(&icon_lock);
+    int kept = 0;
+    for (int i = 0; i < icons.count; i++) {
+        if (icons.slots[i].window == window) unref_icon_entry(icons.slots[i].entry);
+        else icons.slots[kept++] = icons.slots[i];
+    }
+    icons.count = kept;
+    pthread_mutex_unlock(&icon_lock);
+}
+
+static void clear_window_icons() {
+    pthread_mutex_lock(&icon_lock);
+    for (int i = 0; i < icons.count; i++) unref_icon_entry(icons.slots[i].entry);
+    icons.count = 0;
+    pthread_mutex_unlock(&icon_lock);
+}
+
+// Pick the image to scale down from: the smallest with a side of at least
+// size, or the largest if all are smaller. Returns the offset of its header
+// in data, or -1.
+static long select_icon_image(const uint32_t* data, long n, int32_t size) {
+    long best = -1;
+    uint32_t best_side = 0;
+    long i = 0;
+    while (i + 2 <= n) {
+        uint32_t w = data[i], h = data[i + 1];
+        if (w == 0 || h == 0 || w > 4096 || h > 4096 || (long)w * h > n - i - 2) break;
+        uint32_t side = w > h ? w : h;
+        int better = best < 0 ||
+            (side >= (uint32_t)size
+                ? best_side < (uint32_t)size || side < best_side
+                : best_side < (uint32_t)size && side > best_side);
+        if (better) {
+            best = i;
+            best_side = side;
+        }
+        i += 2 + (long)w * h;
+    }
+    return best;
+}
+
+static uint32_t hash_pixels(const uint32_t* data, long n) {
+    uint32_t hash = 2166136261u;
+    for (long i = 0; i < n; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Find an entry with the same pixels or create one from ARGB data.
+// Call with icon_lock held. The returned entry carries a reference.
+static icon_entry* intern_icon(const uint32_t* argb, uint32_t width, uint32_t height) {
+    long n = (long)width * height;
+    uint32_t hash = hash_pixels(argb, n) ^ (width << 16 | height);
+    // Converted first, so a hash collision can be told apart by the pixels.
+    icon_entry* e = malloc(sizeof(icon_entry) + n * 4);
+    if (!e) return NULL;
+    uint8_t* out = (uint8_t*)(e + 1);
+    for (long i = 0; i < n; i++) {
+        uint32_t p = argb[i];
+        uint32_t a = p >> 24;
+        out[i * 4 + 0] = (((p >> 16) & 0xFF) * a + 127) / 255;
+        out[i * 4 + 1] = (((p >> 8) & 0xFF) * a + 127) / 255;
+        out[i * 4 + 2] = ((p & 0xFF) * a + 127) / 255;
+        out[i * 4 + 3] = a;
+    }
+    for (icon_entry* shared = icons.entries; shared; shared = shared->next) {
+        if (shared->icon.hash == hash && shared->icon.width == (int32_t)width &&
+            shared->icon.height == (int32_t)height && memcmp(shared->icon.pixels, out, n * 4) == 0) {
+            free(e);
+            shared->refs++;
+            return shared;
+        }
+    }
+
+    e->icon.width = width;
+    e->icon.height = height;
+    e->icon.hash = hash;
+    e->icon.pixels = out;
+    e->refs = 1;
+    e->next = icons.entries;
+    icons.entries = e;
+    return e;
+}
+
+// Call with icon_lock held.
+static icon_entry* cached_icon(uint32_t window, int32_t size) {
+    for (int i = 0; i < icons.count; i++) {
+        if (icons.slots[i].window == window && icons.slots[i].size == size) {
+            return icons.slots[i].entry;
+        }
+    }
+    return NULL;
+}
+
+window_icon* get_window_icon(uint32_t window, int32_t size) {
+    if (size <= 0) return NULL;
+#ifdef HAVE_WAYLAND_TRACKER
+    // Toplevel handles carry no icon; IDs are not X windows either.
+    if (wayland_tracker_running()) return NULL;
+#endif
+    pthread_mutex_lock(&icon_lock);
+    icon_entry* entry = cached_icon(window, size);
+    if (entry) entry->refs++;
+    pthread_mutex_unlock(&icon_lock);
+    if (entry) return &entry->icon;
+
+    pthread_mutex_lock(&query_lock);
+    x_context* x = query_context();
+    xcb_get_property_reply_t* reply = NULL;
+    if (x) {
+        xcb_get_property_cookie_t cookie = xcb_get_property(x->conn, 0, window,
+            x->atoms[ATOM_NET_WM_ICON], XCB_ATOM_CARDINAL, 0, UINT32_MAX / 4);
+        reply = xcb_get_property_reply(x->conn, cookie, NULL);
+    }
+    pthread_mutex_unlock(&query_lock);
+    if (!reply || reply->format != 32) {
+        free(reply);
+        return NULL;
+    }
+
+    const uint32_t* data = xcb_get_property_value(reply);
+    long n = xcb_get_property_value_length(reply) / 4;
+    long best = select_icon_image(data, n, size);
+
+    pthread_mutex_lock(&icon_lock);
+    // Another thread may have filled the slot meanwhile.
+    entry = cached_icon(window, size);
+    if (entry) {
+        entry->refs++;
+    } else if (best >= 0) {
+        entry = intern_icon(data + best + 2, data[best], data[best + 1]);
+        // Only the tracker sees icon changes, so cache only while it runs.
+        if (entry && atomic_load(&tracker.running) && icons.count == icons.capacity) {
+            int capacity = icons.capacity ? icons.capacity * 2 : 16;
+            icon_slot* slots = realloc(icons.slots, capacity * sizeof(icon_slot));
+            if (slots) {
+                icons.slots = slots;
+                icons.capacity = capacity;
+            }
+        }
+        if (entry && atomic_load(&tracker.running) && icons.count < icons.capacity) {
+            icons.slots[icons.count++] = (icon_slot){ window, size, entry };
+            entry->refs++;
+        }
+    }
+    pthread_mutex_unlock(&icon_lock);
+    free(reply);
+    return entry ? &entry->icon : NULL;
+}
+
+void release_window_icon(window_icon* icon) {
+    if (!icon) return;
+    pthread_mutex_lock(&icon_lock);
+    unref_icon_entry((icon_entry*)icon);
+    pthread_mutex_unlock(&icon_lock);
+}
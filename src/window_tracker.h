@@ -0,0 +1,120 @@
+#ifndef WINDOW_TRACKER_H
+#define WINDOW_TRACKER_H
+
+#include <stdint.h>
+
+#define WINDOW_EVENT_ADDED 1
+#define WINDOW_EVENT_REMOVED 2
+#define WINDOW_EVENT_CHANGED 3
+// Only window.window is set: the new _NET_ACTIVE_WINDOW, 0 if none.
+#define WINDOW_EVENT_FOCUS 4
+// Only window.window is set: its _NET_WM_ICON changed.
+#define WINDOW_EVENT_ICON 5
+// Only window.desktop is set: the new _NET_CURRENT_DESKTOP, -1 if unknown.
+#define WINDOW_EVENT_DESKTOP 6
+// Nothing is set: the connection to the X server or compositor was lost and
+// no more events follow. Call stop_window_tracker(); start_window_tracker()
+// may be tried again.
+#define WINDOW_EVENT_STOPPED 7
+
+// Bits for set_window_filter().
+// Report only windows on the current desktop (or on all desktops).
+#define WINDOW_FILTER_CURRENT_DESKTOP (1 << 0)
+// Drop windows a taskbar should not show: skip-taskbar and special types.
+#define WINDOW_FILTER_TASKBAR (1 << 1)
+
+// Bits of window_record.state.
+// Minimized (_NET_WM_STATE_HIDDEN).
+#define WINDOW_STATE_HIDDEN (1 << 0)
+#define WINDOW_STATE_SKIP_TASKBAR (1 << 1)
+// Urgent: _NET_WM_STATE_DEMANDS_ATTENTION or the WM_HINTS urgency hint.
+#define WINDOW_STATE_DEMANDS_ATTENTION (1 << 2)
+#define WINDOW_STATE_FULLSCREEN (1 << 3)
+// _NET_WM_WINDOW_TYPE is neither normal nor dialog: a dock, menu, tooltip,
+// splash screen and so on.
+#define WINDOW_STATE_SPECIAL_TYPE (1 << 4)
+
+// Snapshot of one client window. Strings are UTF-8 and may be NULL.
+// desktop is -1 for windows shown on all desktops or without _NET_WM_DESKTOP;
+// pid is 0 when _NET_WM_PID is not set.
+typedef struct {
+    uint32_t window;
+    int32_t pid;
+    int32_t desktop;
+    uint32_t state;
+    const char* title;
+    const char* wm_class;
+    const char* wm_instance;
+} window_record;
+
+// A single change reported by the tracker. The record and its strings live in
+// the same allocation; release it with free_window_event().
+typedef struct {
+    int32_t type;
+    window_record window;
+} window_event;
+
+// All client windows in _NET_CLIENT_LIST order. Records and strings live in
+// the same allocation; release it with free_window_list().
+typedef struct {
+    int32_t count;
+    window_record* windows;
+} window_list;
+
+// One _NET_WM_ICON image as premultiplied RGBA, width * height * 4 bytes.
+// hash identifies the pixels; windows with identical icons share one image.
+typedef struct {
+    int32_t width;
+    int32_t height;
+    uint32_t hash;
+    const uint8_t* pixels;
+} window_icon;
+
+// Called from the tracker thread. Ownership of the event passes to the callee.
+typedef void (*window_event_callback)(window_event* event);
+
+// Start watching windows on a background thread. In Wayland sessions the
+// compositor's foreign-toplevel list is used when offered (IDs are then
+// assigned by the tracker, and desktops, icons and filters are unavailable);
+// otherwise _NET_CLIENT_LIST and client properties are watched on the X
+// server. Returns 0 on success, -1 if neither backend could connect or the
+// tracker is already running.
+int start_window_tracker(window_event_callback callback);
+void stop_window_tracker();
+void free_window_event(window_event* event);
+
+// Fetch every client window with all GetProperty requests pipelined, so a
+// full resync costs about one round-trip. Returns NULL without an X server.
+window_list* get_window_list();
+void free_window_list(window_list* list);
+
+// Store _NET_ACTIVE_WINDOW in window, 0 if nothing is active, without
+// starting the tracker. Returns -1 without an X server.
+int get_active_window(uint32_t* window);
+
+// Restrict which windows the tracker and get_window_list() report. When the
+// tracker is running, windows that start or stop passing the filter are
+// reported as added or removed, also when the current desktop changes.
+void set_window_filter(uint32_t filter);
+
+// EWMH requests sent straight to the window manager as ClientMessages on the
+// root window. Each returns 0 once the request is flushed to the server, or
+// -1 without an X connection.
+int activate_window(uint32_t window);
+int close_window(uint32_t window);
+int minimize_window(uint32_t window);
+int move_window_to_desktop(uint32_t window, int32_t desktop);
+// Activate the first client whose title or WM_CLASS contains needle,
+// ignoring case (like `wmctrl -a`). Returns -1 if none matched.
+int activate_window_matching(const char* needle);
+
+// Return the _NET_WM_ICON image best suited to drawing at size pixels: the
+// smallest at least that large, else the largest. While the tracker runs,
+// results are cached per window and size until the icon changes or the
+// window closes. Returns NULL
+// if the window has no icon. Release with release_window_icon(); the pixels
+// stay valid until then.
+window_icon* get_window_icon(uint32_t window, int32_t size);
+void release_window_icon(window_icon* icon);
+
+#endif